@@ -30,12 +30,11 @@ void Application::key_callback(i32 key, i32 code, i32 action, i32 mods)
         }
         filename += ".hdr";
 
-        raytracer.set_sample_ratio(1.0f);
-        raytracer.trace_scene(&scene, {
+        start_render({
             .samples = 500,
             .iterations = 10,
             .method = TraceMethod::LIGHT_SOURCE
-        });
+        }, 1.0f);
     }
     if(key == GLFW_KEY_B && action == GLFW_PRESS)
     {
@@ -48,12 +47,11 @@ void Application::key_callback(i32 key, i32 code, i32 action, i32 mods)
         }
         filename += ".hdr";
 
-        raytracer.set_sample_ratio(0.0f);
-        raytracer.trace_scene(&scene, {
+        start_render({
             .samples = 500,
             .iterations = 10,
             .method = TraceMethod::BRDF
-        });
+        }, 0.0f);
     }
     if(key == GLFW_KEY_M && action == GLFW_PRESS)
     {
@@ -66,12 +64,11 @@ void Application::key_callback(i32 key, i32 code, i32 action, i32 mods)
         }
         filename += ".hdr";
 
-        raytracer.set_sample_ratio(0.5f);
-        raytracer.trace_scene(&scene, {
+        start_render({
             .samples = 500,
             .iterations = 10,
             .method = TraceMethod::MULTI_IMPORTANCE
-        });
+        }, 0.5f);
     }
     if(key == GLFW_KEY_W && action == GLFW_PRESS)
     {
@@ -84,41 +81,50 @@ void Application::key_callback(i32 key, i32 code, i32 action, i32 mods)
         }
         filename += ".hdr";
 
-        raytracer.set_sample_ratio(0.5f);
-        raytracer.trace_scene(&scene, {
+        start_render({
             .samples = 500,
             .iterations = 10,
             .method = TraceMethod::MULTI_IMPORTANCE_WEIGHTS
-        });
+        }, 0.5f);
+    }
+    else if(key == GLFW_KEY_C && action == GLFW_PRESS)
+    {
+        if(render_thread.joinable()) { std::cout << "cancelling render" << std::endl; }
+        stop_render();
     }
     else if(key == GLFW_KEY_RIGHT && action == GLFW_PRESS)
     {
-        image_idx = (image_idx + 1) % 11;
+        stop_render();
+        image_idx = (image_idx + 1) % ENV_MAP_COUNT;
         load_env_map_image();
     }
     else if(key == GLFW_KEY_LEFT && action == GLFW_PRESS)
     {
-        image_idx = glm::min(11u, u32(i32(image_idx - 1) % 11));
+        stop_render();
+        image_idx = (image_idx + ENV_MAP_COUNT - 1) % ENV_MAP_COUNT;
         load_env_map_image();
     }
     else if(key == GLFW_KEY_E && action == GLFW_PRESS)
     {
+        stop_render();
         scene.use_env_map = !scene.use_env_map;
         if(show_env_map) { std::cout << "Environment map is now on" << std::endl; }
         else             { std::cout << "Environment map is now off" << std::endl; }
     }
     else if(key == GLFW_KEY_S && action == GLFW_PRESS)
     {
-        std::vector<f32> img(WINDOW_DIMENSIONS.x * WINDOW_DIMENSIONS.y * 3);
-        for(size_t i = 0; i < raytracer.result_image.size(); i++)
+        if(filename.empty()) { std::cout << "ERROR could not write to file as no image was yet rendered" << std::endl; return; }
+        // saves the last finished iteration straight from the frame buffer, the render may still be running
+        try
         {
-            img.at(i * 3) = raytracer.result_image.at(i).R;
-            img.at(i * 3 + 1) = raytracer.result_image.at(i).G;
-            img.at(i * 3 + 2) = raytracer.result_image.at(i).B;
+            // the frame is copied out so the buffer is not held while the file is written, otherwise
+            // the render thread could not publish the next iteration until the write finished
+            std::vector<f32> frame_copy;
+            frame_buffer.read([&](const std::vector<f32> & frame) { frame_copy = frame; });
+            save_hdr_image("results/" + filename, frame_copy, WINDOW_DIMENSIONS.x, WINDOW_DIMENSIONS.y);
+            std::cout << "Image succesfully saved to results/" << filename << std::endl;
         }
-        if(filename.empty()) { std::cout << "ERROR could not write to file as no image was yet rendered" << std::endl;}
-        save_hdr_image(std::string("results/" + filename).c_str(), img, WINDOW_DIMENSIONS.x, WINDOW_DIMENSIONS.y );
-        std::cout << "Image succesfully saved to results/" << filename << std::endl;
+        catch(const std::exception & e) { std::cout << "ERROR " << e.what() << std::endl; }
     }
     return;
 }
@@ -154,8 +160,11 @@ Application::Application() :
                 std::placeholders::_2)
         }
     ),
-    scene{create_default_scene()},
+    env_map_cache{ENV_MAP_CACHE_MEMORY_LIMIT},
+    scene{Scene::create_default_scene()},
     raytracer{WINDOW_DIMENSIONS},
+    frame_buffer{WINDOW_DIMENSIONS},
+    cancel_render{false},
     image_idx{0},
     show_env_map{false}
 { 
@@ -164,114 +173,42 @@ Application::Application() :
 
 Application::~Application()
 {
+    stop_render();
 }
 
-void Application::load_env_map_image()
+void Application::start_render(const Raytracer::TraceInfo & info, f32 sample_ratio)
 {
-    auto path_from_index = [](int index) -> std::string
-    {
-        std::array<std::string, 11> img_num { "001", "004", "007", "010", "011", "013", "015", "016", "020", "023", "024" };
-        return "assets/textures/EM/raw" + img_num[index] + ".hdr";
-    };
-    load_hdr_image(path_from_index(image_idx), scene.env_map.image, scene.env_map.width, scene.env_map.height);
-    scene.env_map.init();
-    std::cout << "[Application::load_env_map_image()] Image " << image_idx <<  " loaded!" << std::endl;
+    // restarting replaces the render in progress
+    stop_render();
+    cancel_render.store(false);
+    raytracer.set_sample_ratio(sample_ratio);
+
+    Raytracer::TraceInfo render_info = info;
+    render_info.frame_buffer = &frame_buffer;
+    render_info.cancel = &cancel_render;
+    render_thread = std::thread([this, render_info]() { raytracer.trace_scene(&scene, render_info); });
 }
 
-Scene Application::create_default_scene()
+void Application::stop_render()
 {
-    Scene scene = Scene(Camera::CameraInfo{
-        .origin = {0.0, 6.0, 18.0},
-        .look_at = {0.0, 0.0, 0.0},
-        .up = {0.0, 1.0, 0.0},
-        .fov = 35.0 * M_PI / 180.0
-    });
-
-    Material::MaterialCreateInfo mat_table_info = {
-        .Le = {0.0, 0.0, 0.0},
-        .diffuse_albedo = {0.8, 0.8, 0.8},
-        .specular_albedo = {0.2, 0.2, 0.2},
-        .shininess = 500.0
-    };
-
-    Material::MaterialCreateInfo mat_light_base_info = {
-        .Le = {1.0, 1.0, 1.0},
-        .diffuse_albedo = {0.0, 0.0, 0.0},
-        .specular_albedo = {0.0, 0.0, 0.0},
-        .shininess = 0.0
-    };
-
-    scene.scene_materials.reserve(8);
-    mat_light_base_info.Le = {531.715, 265.857, 132.929};
-    scene.scene_materials.emplace_back(mat_light_base_info);
-    mat_light_base_info.Le = {50.8868, 101.774, 25.4434};
-    scene.scene_materials.emplace_back(mat_light_base_info);
-    mat_light_base_info.Le = {8.14188, 4.07094, 16.2838};
-    scene.scene_materials.emplace_back(mat_light_base_info);
-    mat_light_base_info.Le = {2.6054, 0.65135, 1.3027};
-    scene.scene_materials.emplace_back(mat_light_base_info);
-
-    scene.scene_materials.emplace_back(mat_table_info);
-    mat_table_info.shininess = 1000.0;
-    mat_table_info.diffuse_albedo = {0.7, 0.7, 0.7},
-    mat_table_info.specular_albedo = {0.3, 0.3, 0.3},
-    scene.scene_materials.emplace_back(mat_table_info);
-    mat_table_info.shininess = 5000.0;
-    mat_table_info.diffuse_albedo = {0.5, 0.5, 0.5},
-    mat_table_info.specular_albedo = {0.5, 0.5, 0.5},
-    scene.scene_materials.emplace_back(mat_table_info);
-    mat_table_info.shininess = 10000.0;
-    mat_table_info.diffuse_albedo = {0.2, 0.2, 0.2},
-    mat_table_info.specular_albedo = {0.8, 0.8, 0.8},
-    scene.scene_materials.emplace_back(mat_table_info);
-    f64vec3 light_center_pos = {0, 4, -6};
-
-    scene.scene_objects.emplace_back(Rectangle({ 
-        .material = &scene.scene_materials.at(4),
-        .origin = {0.0, -4.0,  2.0 },
-        .normal = {0.0, 0.9935, 0.1131},
-        .dimensions = {8.0, 1.0}}));
-
-    scene.scene_objects.emplace_back(Rectangle({ 
-        .material = &scene.scene_materials.at(5),
-        .origin = {0.0, -3.5, -2.0},
-        .normal = {0.0, 0.9496, 0.3133},
-        .dimensions = {8.0, 1.0}}));
-
-    scene.scene_objects.emplace_back(Rectangle({
-        .material = &scene.scene_materials.at(6),
-        .origin = {0.0, -2.5, -6.0},
-        .normal = {0.0, 0.8166, 0.5751},
-        .dimensions = {8.0, 1.0}}));
-
-    scene.scene_objects.emplace_back(Rectangle({
-        .material = &scene.scene_materials.at(7),
-        .origin = {0.0, -1.0, -10.0},
-        .normal = {0.0, 0.5400, 0.8416},
-        .dimensions = {8.0, 1.0}}));
-
-    scene.scene_objects.emplace_back(Sphere({
-        .material = &scene.scene_materials.at(0), 
-        .origin = light_center_pos + f64vec3{-4.5, 0.0, 0.0},
-        .radius = 0.07}));
-
-    scene.scene_objects.emplace_back(Sphere({
-        .material = &scene.scene_materials.at(1),
-        .origin = light_center_pos + f64vec3{-1.5, 0.0, 0.0},
-        .radius = 0.16}));
-
-    scene.scene_objects.emplace_back(Sphere({
-        .material = &scene.scene_materials.at(2),
-        .origin = light_center_pos + f64vec3{ 1.5, 0.0, 0.0},
-        .radius = 0.4}));
-
-    scene.scene_objects.emplace_back(Sphere({
-        .material = &scene.scene_materials.at(3), 
-        .origin = light_center_pos + f64vec3{ 4.5, 0.0, 0.0},
-        .radius = 1.0}));
+    if(!render_thread.joinable()) { return; }
+    // tiles already being traced are finished, the rest of the queued work is dropped
+    cancel_render.store(true);
+    render_thread.join();
+}
 
-    scene.calculate_total_power();
-    return scene;
+void Application::load_env_map_image()
+{
+    scene.env_map = env_map_cache.get(get_env_map_path(image_idx));
+    scene.env_map_path = get_env_map_path(image_idx);
+    // the neighbours are the most likely next maps so they are loaded while the current one is in use
+    env_map_cache.prefetch(get_env_map_path((image_idx + 1) % ENV_MAP_COUNT));
+    env_map_cache.prefetch(get_env_map_path((image_idx + ENV_MAP_COUNT - 1) % ENV_MAP_COUNT));
+
+    auto stats = env_map_cache.get_stats();
+    std::cout << "[Application::load_env_map_image()] Image " << image_idx <<  " loaded!"
+              << " cache hits " << stats.hits << " misses " << stats.misses
+              << " memory " << (stats.memory_used >> 20) << "/" << (stats.memory_limit >> 20) << " MB" << std::endl;
 }
 
 void Application::run_loop()
@@ -279,20 +216,16 @@ void Application::run_loop()
     while(!window.get_window_should_close())
     {
         glfwPollEvents();
-        std::vector<f32> img(WINDOW_DIMENSIONS.x * WINDOW_DIMENSIONS.y * 3);
-        for(size_t i = 0; i < raytracer.result_image.size(); i++)
-        {
-            img.at(i * 3) = raytracer.result_image.at(i).R;
-            img.at(i * 3 + 1) = raytracer.result_image.at(i).G;
-            img.at(i * 3 + 2) = raytracer.result_image.at(i).B;
-        }
         if(show_env_map)
         {
-            glDrawPixels(scene.env_map.width, scene.env_map.height, GL_RGB, GL_FLOAT, scene.env_map.image.data());
-            // glDrawPixels(scene.env_map.width, scene.env_map.height, GL_LUMINANCE, GL_FLOAT, scene.env_map.heat_map.data());
+            glDrawPixels(scene.env_map->width, scene.env_map->height, GL_RGB, GL_FLOAT, scene.env_map->image.data());
+            // glDrawPixels(scene.env_map->width, scene.env_map->height, GL_LUMINANCE, GL_FLOAT, scene.env_map->heat_map.data());
         } else 
         {
-            glDrawPixels(WINDOW_DIMENSIONS.x, WINDOW_DIMENSIONS.y, GL_RGB, GL_FLOAT, img.data());
+            frame_buffer.read([&](const std::vector<f32> & frame)
+            {
+                glDrawPixels(WINDOW_DIMENSIONS.x, WINDOW_DIMENSIONS.y, GL_RGB, GL_FLOAT, frame.data());
+            });
         }
         window.swap_buffers();
     }
@@ -1,11 +1,16 @@
 #pragma once
 
+#include <atomic>
+#include <thread>
+
 #include "window.hpp"
 #include "types.hpp"
 #include "utils.hpp"
 #include "raytracing_backend/scene.hpp"
 #include "raytracing_backend/camera.hpp"
 #include "raytracing_backend/raytracer.hpp"
+#include "raytracing_backend/frame_buffer.hpp"
+#include "raytracing_backend/env_map_cache.hpp"
 #include "raytracing_backend/material.hpp"
 #include "raytracing_backend/objects.hpp"
 
@@ -14,6 +19,8 @@ struct Application
 {
     public:
         const u32vec2 WINDOW_DIMENSIONS = {600, 600};
+        // upper bound of memory held by the loaded env maps, maps over the limit are evicted least recently used first
+        const size_t ENV_MAP_CACHE_MEMORY_LIMIT = size_t(512) << 20;
         Application();
         ~Application();
 
@@ -21,8 +28,13 @@ struct Application
 
     private:
         AppWindow window;
+        EnvMapCache env_map_cache;
         Scene scene;
         Raytracer raytracer;
+        // written by the render thread, drawn by run_loop without waiting for the render
+        FrameBuffer frame_buffer;
+        std::thread render_thread;
+        std::atomic<bool> cancel_render;
 
         u32 image_idx;
         std::string filename;
@@ -34,6 +46,9 @@ struct Application
         void key_callback(i32 key, i32 code, i32 action, i32 mods);
         void window_resized_callback(i32 width, i32 height);
 
-        Scene create_default_scene();
         void load_env_map_image();
+        // traces the scene on the render thread, a render already in progress is cancelled first
+        void start_render(const Raytracer::TraceInfo & info, f32 sample_ratio);
+        // blocks until the render thread finishes the tiles it is currently tracing
+        void stop_render();
 };
\ No newline at end of file
@@ -0,0 +1,794 @@
+#include <stdexcept>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+#include <array>
+#include <filesystem>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "types.hpp"
+#include "utils.hpp"
+#include "raytracing_backend/scene.hpp"
+#include "raytracing_backend/raytracer.hpp"
+#include "raytracing_backend/mesh.hpp"
+
+// Microbenchmarks of the raytracing backend kernels together with end to end trace_scene
+// throughput. All inputs are generated from fixed seeds so runs are comparable, results are
+// written as JSON so they can be tracked over time.
+
+struct BenchmarkOptions
+{
+    // index into the bundled maps, path to a .hdr file or "synthetic"
+    std::string env_map = "synthetic";
+    std::string output = "";
+    u32vec2 dimensions = {160, 120};
+    u32 samples = 32;
+    u32 iterations = 2;
+    // iteration budget of the fixed and adaptive sampling comparison
+    u32 adaptive_iterations = 16;
+    f32 target_relative_error = 0.02f;
+    u32 threads = 0;
+    // number of times each kernel measurement is repeated, the fastest repetition is reported
+    u32 repetitions = 5;
+    // quads along each side of the generated mesh, two triangles each - 708 gives about a million triangles
+    u32 mesh_resolution = 708;
+};
+
+struct KernelResult
+{
+    std::string name;
+    f64 ns_per_op;
+    u64 operations;
+};
+
+struct TraceResult
+{
+    std::string method;
+    f64 seconds;
+    u64 rays;
+    f64 rays_per_second;
+    // the same trace rendered in single precision with the same seed
+    f64 f32_seconds;
+    f64 f32_rays_per_second;
+    f64 f32_speedup;
+    // error of the single precision image relative to the double precision one
+    f64 f32_rmse;
+    f64 f32_relative_error;
+};
+
+struct AdaptiveResult
+{
+    std::string scene;
+    std::string mode;
+    f64 seconds;
+    f64 mean_samples_per_pixel;
+    u32 min_samples_per_pixel;
+    u32 max_samples_per_pixel;
+    f64 mean_relative_error;
+};
+
+struct MeshResult
+{
+    std::string format;
+    u64 triangles;
+    f64 load_seconds;
+    // vertex and index buffers together with the hierarchy
+    f64 bytes_per_triangle;
+    f64 ns_per_ray;
+    // any hit query of the same rays
+    f64 occluded_ns_per_ray;
+};
+
+struct TraversalResult
+{
+    std::string order;
+    u32 tile_size;
+    f64 seconds;
+    f64 rays_per_second;
+    // false when the hardware counters can not be opened (no PMU access, perf_event_paranoid, not linux)
+    bool counters_available;
+    u64 l1d_read_misses;
+    u64 llc_misses;
+};
+
+/// @brief Hardware cache miss counters of the whole process read through perf_event_open.
+/// The counters are inherited only by threads created after start and the counts of a thread
+/// are added once it exits, so the raytracer has to be created after start and destroyed before stop
+struct CacheMissCounters
+{
+    bool available = false;
+    u64 l1d_read_misses = 0;
+    u64 llc_misses = 0;
+
+    void start()
+    {
+#if defined(__linux__)
+        const std::array<std::pair<u32, u64>, 2> events = {{
+            {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES}
+        }};
+        available = true;
+        for(u32 i = 0; i < events.size(); i++)
+        {
+            perf_event_attr attributes = {};
+            attributes.size = sizeof(perf_event_attr);
+            attributes.type = events[i].first;
+            attributes.config = events[i].second;
+            attributes.inherit = 1;
+            attributes.exclude_kernel = 1;
+            attributes.exclude_hv = 1;
+            file_descriptors[i] = i32(syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0));
+            available = available && file_descriptors[i] != -1;
+        }
+#endif
+    }
+
+    void stop()
+    {
+#if defined(__linux__)
+        std::array<u64, 2> values = {0, 0};
+        for(u32 i = 0; i < file_descriptors.size(); i++)
+        {
+            if(file_descriptors[i] == -1) { continue; }
+            if(read(file_descriptors[i], &values[i], sizeof(u64)) != sizeof(u64)) { available = false; }
+            close(file_descriptors[i]);
+            file_descriptors[i] = -1;
+        }
+        l1d_read_misses = values[0];
+        llc_misses = values[1];
+#endif
+    }
+
+    private:
+        std::array<i32, 2> file_descriptors = {-1, -1};
+};
+
+const u32 BENCHMARK_SEED = 42;
+const u32 KERNEL_INPUT_COUNT = 4096;
+
+// accumulates kernel outputs so the compiler can not drop the measured calls
+static volatile f64 sink = 0.0;
+
+static void print_usage(const char * program)
+{
+    std::cout <<
+        "Usage: " << program << " [options]\n"
+        "  --env-map <index|path|synthetic> bundled env map index, path to .hdr file or generated map\n"
+        "  --width <n> --height <n>         resolution of the trace_scene benchmark\n"
+        "  --samples <n>                    samples per pixel per iteration\n"
+        "  --iterations <n>                 iterations of the trace_scene benchmark\n"
+        "  --adaptive-iterations <n>        iteration budget of the fixed and adaptive sampling comparison\n"
+        "  --adaptive <error>               target relative error of the adaptive sampling\n"
+        "  --threads <n>                    worker threads, 0 = hardware concurrency\n"
+        "  --repetitions <n>                repetitions of each kernel measurement\n"
+        "  --mesh-resolution <n>            quads along each side of the generated mesh\n"
+        "  --output <path>                  write the JSON report to file instead of stdout\n";
+}
+
+static auto parse_options(int argc, char * argv[]) -> BenchmarkOptions
+{
+    BenchmarkOptions options = {};
+    for(int i = 1; i < argc; i++)
+    {
+        std::string_view arg = argv[i];
+        if(arg == "--help" || arg == "-h")
+        {
+            print_usage(argv[0]);
+            std::exit(EXIT_SUCCESS);
+        }
+        if(i + 1 >= argc) { throw std::runtime_error("[parse_options()] Missing value for " + std::string(arg)); }
+        std::string value = argv[++i];
+
+        if(arg == "--env-map")                  { options.env_map = value; }
+        else if(arg == "--width")               { options.dimensions.x = u32(std::stoul(value)); }
+        else if(arg == "--height")              { options.dimensions.y = u32(std::stoul(value)); }
+        else if(arg == "--samples")             { options.samples = u32(std::stoul(value)); }
+        else if(arg == "--iterations")          { options.iterations = u32(std::stoul(value)); }
+        else if(arg == "--adaptive-iterations") { options.adaptive_iterations = u32(std::stoul(value)); }
+        else if(arg == "--adaptive")            { options.target_relative_error = std::stof(value); }
+        else if(arg == "--threads")             { options.threads = u32(std::stoul(value)); }
+        else if(arg == "--repetitions")         { options.repetitions = glm::max(u32(std::stoul(value)), 1u); }
+        else if(arg == "--mesh-resolution")     { options.mesh_resolution = glm::max(u32(std::stoul(value)), 1u); }
+        else if(arg == "--output")              { options.output = value; }
+        else { throw std::runtime_error("[parse_options()] Unknown option " + std::string(arg)); }
+    }
+    return options;
+}
+
+// sky gradient with a small bright sun so the sampling tables are not uniform
+static void create_synthetic_env_map(EnvironmentMap & env_map)
+{
+    env_map.width = 1024;
+    env_map.height = 512;
+    env_map.image = std::vector<f32>(env_map.width * env_map.height * 3);
+    for(i32 y = 0; y < env_map.height; y++)
+    {
+        for(i32 x = 0; x < env_map.width; x++)
+        {
+            f32 sky = 0.2f + 0.8f * (1.0f - f32(y) / f32(env_map.height));
+            bool sun = glm::abs(x - 300) < 6 && glm::abs(y - 120) < 6;
+            i32 index = (y * env_map.width + x) * 3;
+            env_map.image.at(index) = sun ? 500.0f : sky * 0.6f;
+            env_map.image.at(index + 1) = sun ? 450.0f : sky * 0.8f;
+            env_map.image.at(index + 2) = sun ? 400.0f : sky;
+        }
+    }
+    env_map.init();
+}
+
+static void load_env_map(const BenchmarkOptions & options, Scene & scene)
+{
+    if(options.env_map == "synthetic")
+    {
+        create_synthetic_env_map(*scene.env_map);
+        return;
+    }
+    std::string path = options.env_map;
+    if(!path.empty() && path.find_first_not_of("0123456789") == std::string::npos)
+    {
+        path = get_env_map_path(u32(std::stoul(path)) % ENV_MAP_COUNT);
+    }
+    scene.env_map->load(path);
+}
+
+/// @brief runs the kernel over all inputs repeatedly and reports the fastest repetition
+/// @param kernel is called with the input index and returns a value that is fed to the sink
+static auto measure_kernel(const std::string & name, u32 input_count, u32 repetitions, const std::function<f64(u32)> & kernel) -> KernelResult
+{
+    // make sure each repetition runs long enough for the clock resolution to not matter
+    const u32 rounds = glm::max(1u, 200000u / input_count);
+    f64 best_ns = INFINITY;
+    for(u32 repetition = 0; repetition < repetitions; repetition++)
+    {
+        f64 accumulated = 0.0;
+        auto start = std::chrono::steady_clock::now();
+        for(u32 round = 0; round < rounds; round++)
+        {
+            for(u32 i = 0; i < input_count; i++) { accumulated += kernel(i); }
+        }
+        std::chrono::duration<f64, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+        sink = sink + accumulated;
+        best_ns = glm::min(best_ns, elapsed.count() / f64(u64(rounds) * input_count));
+    }
+    return {.name = name, .ns_per_op = best_ns, .operations = u64(rounds) * input_count};
+}
+
+static auto method_name(TraceMethod method) -> std::string
+{
+    switch(method)
+    {
+        case TraceMethod::LIGHT_SOURCE:             { return "LIGHT_SOURCE"; }
+        case TraceMethod::BRDF:                     { return "BRDF"; }
+        case TraceMethod::MULTI_IMPORTANCE:         { return "MULTI_IMPORTANCE"; }
+        case TraceMethod::MULTI_IMPORTANCE_WEIGHTS: { return "MULTI_IMPORTANCE_WEIGHTS"; }
+    }
+    return "UNKNOWN";
+}
+
+static auto sample_ratio_from_method(TraceMethod method) -> f32
+{
+    switch(method)
+    {
+        case TraceMethod::LIGHT_SOURCE: { return 1.0f; }
+        case TraceMethod::BRDF:         { return 0.0f; }
+        default:                        { return 0.5f; }
+    }
+}
+
+static auto run_kernel_benchmarks(const BenchmarkOptions & options, Scene & scene) -> std::vector<KernelResult>
+{
+    std::vector<KernelResult> results;
+    Sampler input_sampler = Sampler(BENCHMARK_SEED, 0, 0);
+
+    // camera rays spread over the whole screen
+    std::vector<u32vec2> screen_coords;
+    std::vector<Ray> camera_rays;
+    for(u32 i = 0; i < KERNEL_INPUT_COUNT; i++)
+    {
+        u32vec2 coords = u32vec2(
+            u32(input_sampler.get_random_double() * options.dimensions.x),
+            u32(input_sampler.get_random_double() * options.dimensions.y));
+        screen_coords.push_back(coords);
+        camera_rays.push_back(scene.camera.get_ray(coords, options.dimensions));
+    }
+
+    results.push_back(measure_kernel("Camera::get_ray", KERNEL_INPUT_COUNT, options.repetitions, [&](u32 i)
+    {
+        return scene.camera.get_ray(screen_coords[i], options.dimensions).direction.x;
+    }));
+
+    // rays aimed at the objects so both hits and misses are exercised
+    const Sphere & sphere = std::get<Sphere>(scene.scene_objects.at(7));
+    const Rectangle & rectangle = std::get<Rectangle>(scene.scene_objects.at(0));
+    std::vector<Ray> sphere_rays;
+    std::vector<Ray> rectangle_rays;
+    for(u32 i = 0; i < KERNEL_INPUT_COUNT; i++)
+    {
+        f64vec3 jitter = input_sampler.get_random_double_vec() * 2.0 - 1.0;
+        sphere_rays.emplace_back(scene.camera.origin, sphere.origin + jitter * (sphere.radius * 1.5) - scene.camera.origin);
+        f64vec3 rectangle_target = rectangle.origin +
+            rectangle.right * (jitter.x * rectangle.dimensions.x * 1.5) +
+            rectangle.forward * (jitter.y * rectangle.dimensions.y * 1.5);
+        rectangle_rays.emplace_back(scene.camera.origin, rectangle_target - scene.camera.origin);
+    }
+
+    results.push_back(measure_kernel("Intersect::operator()(Sphere)", KERNEL_INPUT_COUNT, options.repetitions, [&](u32 i)
+    {
+        return Intersect{sphere_rays[i]}(sphere).hit_distance;
+    }));
+    results.push_back(measure_kernel("Intersect::operator()(Rectangle)", KERNEL_INPUT_COUNT, options.repetitions, [&](u32 i)
+    {
+        return Intersect{rectangle_rays[i]}(rectangle).hit_distance;
+    }));
+
+    // shading inputs taken from actual primary hits on the tables
+    std::vector<Intersect::HitInfo> hits;
+    std::vector<Ray> hit_rays;
+    for(u32 i = 0; hits.size() < KERNEL_INPUT_COUNT && i < KERNEL_INPUT_COUNT * 16; i++)
+    {
+        const Ray & ray = camera_rays[i % KERNEL_INPUT_COUNT];
+        auto hit = scene.bvh.closest_hit({.ray = ray, .objects = scene.scene_objects, .skip_spheres = true});
+        if(hit.hit_distance < 0.0) { continue; }
+        hits.push_back(hit);
+        hit_rays.push_back(ray);
+    }
+    if(hits.empty()) { throw std::runtime_error("[run_kernel_benchmarks()] No primary hits in the default scene"); }
+    const u32 hit_count = u32(hits.size());
+
+    std::vector<f64vec3> light_directions;
+    for(u32 i = 0; i < hit_count; i++)
+    {
+        Sampler sampler = Sampler(BENCHMARK_SEED, i, 1);
+        f64vec3 direction = glm::normalize(hits[i].normal + (sampler.get_random_double_vec() * 2.0 - 1.0) * 0.9);
+        light_directions.push_back(direction);
+    }
+
+    results.push_back(measure_kernel("Material::BRDF", hit_count, options.repetitions, [&](u32 i)
+    {
+        return hits[i].material->BRDF({hits[i].normal, -hit_rays[i].direction, light_directions[i]}).r;
+    }));
+    results.push_back(measure_kernel("Material::sample_probability", hit_count, options.repetitions, [&](u32 i)
+    {
+        return hits[i].material->sample_probability({hits[i].normal, -hit_rays[i].direction, light_directions[i]});
+    }));
+    results.push_back(measure_kernel("Material::sample_direction", hit_count, options.repetitions, [&](u32 i)
+    {
+        Sampler sampler = Sampler(BENCHMARK_SEED, i, 2);
+        auto direction = hits[i].material->sample_direction(hits[i].normal, -hit_rays[i].direction, sampler);
+        return direction.has_value() ? direction.value().x : 0.0;
+    }));
+
+    std::vector<f64vec3> env_directions;
+    for(u32 i = 0; i < KERNEL_INPUT_COUNT; i++)
+    {
+        Sampler sampler = Sampler(BENCHMARK_SEED, i, 3);
+        env_directions.push_back(scene.env_map->sample_direction(sampler));
+    }
+    results.push_back(measure_kernel("EnvironmentMap::sample_direction_alias", KERNEL_INPUT_COUNT, options.repetitions, [&](u32 i)
+    {
+        Sampler sampler = Sampler(BENCHMARK_SEED, i, 4);
+        return scene.env_map->sample_direction_alias(sampler).z;
+    }));
+    results.push_back(measure_kernel("EnvironmentMap::sample_direction_cdf", KERNEL_INPUT_COUNT, options.repetitions, [&](u32 i)
+    {
+        Sampler sampler = Sampler(BENCHMARK_SEED, i, 4);
+        return scene.env_map->sample_direction_cdf(sampler).z;
+    }));
+    results.push_back(measure_kernel("EnvironmentMap::sample_probability", KERNEL_INPUT_COUNT, options.repetitions, [&](u32 i)
+    {
+        return scene.env_map->sample_probability(env_directions[i]);
+    }));
+
+    results.push_back(measure_kernel("BVH::closest_hit", KERNEL_INPUT_COUNT, options.repetitions, [&](u32 i)
+    {
+        return scene.bvh.closest_hit({.ray = camera_rays[i], .objects = scene.scene_objects, .skip_spheres = false}).hit_distance;
+    }));
+    // the any hit query of the shadow rays on the same rays
+    results.push_back(measure_kernel("BVH::occluded", KERNEL_INPUT_COUNT, options.repetitions, [&](u32 i)
+    {
+        return f64(scene.bvh.occluded({.ray = camera_rays[i], .objects = scene.scene_objects, .skip_spheres = false}, INFINITY));
+    }));
+
+    // primary visibility of 2x2 pixel quads, scalar rays against the SIMD packet path
+    std::vector<RayPacket> quad_packets;
+    std::vector<Ray> quad_rays;
+    for(u32 i = 0; i < KERNEL_INPUT_COUNT / PACKET_SIZE; i++)
+    {
+        u32vec2 base = screen_coords[i] / 2u * 2u;
+        std::array<Ray, PACKET_SIZE> rays = {camera_rays[i], camera_rays[i], camera_rays[i], camera_rays[i]};
+        for(u32 lane = 0; lane < PACKET_SIZE; lane++)
+        {
+            rays[lane] = scene.camera.get_ray(base + u32vec2(lane % 2, lane / 2), options.dimensions);
+            quad_rays.push_back(rays[lane]);
+        }
+        quad_packets.emplace_back(rays, PACKET_FULL_MASK);
+    }
+    results.push_back(measure_kernel("primary_visibility_scalar (per ray)", u32(quad_rays.size()), options.repetitions, [&](u32 i)
+    {
+        return scene.bvh.closest_hit({.ray = quad_rays[i], .objects = scene.scene_objects, .skip_spheres = false}).hit_distance;
+    }));
+    KernelResult packet_result = measure_kernel("primary_visibility_packet (per ray)", u32(quad_packets.size()), options.repetitions, [&](u32 i)
+    {
+        return scene.bvh.closest_hit(BVH::PacketTraceInfo{.packet = quad_packets[i], .objects = scene.scene_objects, .skip_spheres = false})[0].hit_distance;
+    });
+    packet_result.ns_per_op /= PACKET_SIZE;
+    packet_result.operations *= PACKET_SIZE;
+    results.push_back(packet_result);
+    return results;
+}
+
+/// @return duration of the trace in seconds
+template <typename T>
+static auto timed_trace(RaytracerT<T> & raytracer, Scene & scene, const BenchmarkOptions & options, TraceMethod method) -> f64
+{
+    raytracer.set_sample_ratio(sample_ratio_from_method(method));
+    auto start = std::chrono::steady_clock::now();
+    raytracer.trace_scene(&scene, {
+        .samples = options.samples,
+        .iterations = options.iterations,
+        .method = method,
+        .seed = BENCHMARK_SEED
+    });
+    std::chrono::duration<f64> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+static auto run_trace_benchmarks(const BenchmarkOptions & options, Scene & scene, bool use_env_map) -> std::vector<TraceResult>
+{
+    std::vector<TraceResult> results;
+    scene.use_env_map = use_env_map;
+    RaytracerT<f64> raytracer = RaytracerT<f64>(options.dimensions, options.threads);
+    RaytracerT<f32> raytracer_f32 = RaytracerT<f32>(options.dimensions, options.threads);
+    for(TraceMethod method : {TraceMethod::LIGHT_SOURCE, TraceMethod::BRDF, TraceMethod::MULTI_IMPORTANCE, TraceMethod::MULTI_IMPORTANCE_WEIGHTS})
+    {
+        f64 seconds = timed_trace(raytracer, scene, options, method);
+        f64 f32_seconds = timed_trace(raytracer_f32, scene, options, method);
+
+        f64 squared_error = 0.0;
+        f64 squared_reference = 0.0;
+        const u32 pixel_count = raytracer.accumulation.get_pixel_count();
+        for(u32 i = 0; i < pixel_count; i++)
+        {
+            const f64vec3 reference = raytracer.accumulation.get_mean(i);
+            const f64vec3 difference = raytracer_f32.accumulation.get_mean(i) - reference;
+            squared_error += glm::dot(difference, difference);
+            squared_reference += glm::dot(reference, reference);
+        }
+
+        // every pixel traces one primary ray and one secondary ray per sample
+        u64 rays = u64(options.dimensions.x) * options.dimensions.y * options.iterations * (1 + u64(options.samples));
+        results.push_back({
+            .method = method_name(method),
+            .seconds = seconds,
+            .rays = rays,
+            .rays_per_second = f64(rays) / seconds,
+            .f32_seconds = f32_seconds,
+            .f32_rays_per_second = f64(rays) / f32_seconds,
+            .f32_speedup = seconds / f32_seconds,
+            .f32_rmse = glm::sqrt(squared_error / f64(pixel_count * 3)),
+            .f32_relative_error = squared_reference > 0.0 ? glm::sqrt(squared_error / squared_reference) : 0.0
+        });
+    }
+    return results;
+}
+
+// traces the env map scene with each traversal order and tile size, every configuration gets
+// its own raytracer so the cache miss counters cover exactly its worker threads
+static auto run_traversal_benchmarks(const BenchmarkOptions & options, Scene & scene) -> std::vector<TraversalResult>
+{
+    std::vector<TraversalResult> results;
+    scene.use_env_map = true;
+    for(TraversalOrder order : {TraversalOrder::SCANLINE, TraversalOrder::MORTON})
+    {
+        for(u32 tile_size : {8u, 16u, 32u, 64u})
+        {
+            CacheMissCounters counters;
+            counters.start();
+            f64 seconds;
+            {
+                Raytracer raytracer = Raytracer(options.dimensions, options.threads);
+                raytracer.set_sample_ratio(sample_ratio_from_method(TraceMethod::LIGHT_SOURCE));
+                seconds = raytracer.trace_scene(&scene, {
+                    .samples = options.samples,
+                    .iterations = options.iterations,
+                    .method = TraceMethod::LIGHT_SOURCE,
+                    .seed = BENCHMARK_SEED,
+                    .tile_size = tile_size,
+                    .traversal_order = order
+                }).seconds;
+            }
+            counters.stop();
+
+            u64 rays = u64(options.dimensions.x) * options.dimensions.y * options.iterations * (1 + u64(options.samples));
+            results.push_back({
+                .order = order == TraversalOrder::MORTON ? "MORTON" : "SCANLINE",
+                .tile_size = tile_size,
+                .seconds = seconds,
+                .rays_per_second = f64(rays) / seconds,
+                .counters_available = counters.available,
+                .l1d_read_misses = counters.l1d_read_misses,
+                .llc_misses = counters.llc_misses
+            });
+        }
+    }
+    return results;
+}
+
+// renders with the same iteration budget spent uniformly and adaptively so the error and time can be compared
+static auto run_adaptive_benchmarks(const BenchmarkOptions & options, Scene & scene) -> std::vector<AdaptiveResult>
+{
+    std::vector<AdaptiveResult> results;
+    Raytracer raytracer = Raytracer(options.dimensions, options.threads);
+    raytracer.set_sample_ratio(sample_ratio_from_method(TraceMethod::MULTI_IMPORTANCE_WEIGHTS));
+    for(bool use_env_map : {true, false})
+    {
+        scene.use_env_map = use_env_map;
+        for(bool adaptive : {false, true})
+        {
+            auto start = std::chrono::steady_clock::now();
+            raytracer.trace_scene(&scene, {
+                .samples = options.samples,
+                .iterations = options.adaptive_iterations,
+                .method = TraceMethod::MULTI_IMPORTANCE_WEIGHTS,
+                .seed = BENCHMARK_SEED,
+                .adaptive = adaptive,
+                .target_relative_error = options.target_relative_error
+            });
+            std::chrono::duration<f64> elapsed = std::chrono::steady_clock::now() - start;
+
+            const std::vector<u32> & counts = raytracer.accumulation.count;
+            auto [min_iterations, max_iterations] = std::minmax_element(counts.begin(), counts.end());
+            u64 total_iterations = 0;
+            for(u32 iterations : counts) { total_iterations += iterations; }
+            results.push_back({
+                .scene = use_env_map ? "env_map" : "light_sources",
+                .mode = adaptive ? "adaptive" : "fixed",
+                .seconds = elapsed.count(),
+                .mean_samples_per_pixel = f64(total_iterations * options.samples) / f64(counts.size()),
+                .min_samples_per_pixel = *min_iterations * options.samples,
+                .max_samples_per_pixel = *max_iterations * options.samples,
+                .mean_relative_error = raytracer.accumulation.get_mean_relative_error()
+            });
+        }
+    }
+    return results;
+}
+
+// height of the wavy surface the generated mesh samples so its hierarchy is not a flat grid
+static auto get_mesh_height(f32 x, f32 z) -> f32
+{
+    return 0.5f * std::sin(x * 3.0f) * std::cos(z * 2.0f);
+}
+
+/// @brief writes a heightfield of resolution x resolution quads as .obj and as binary .ply, loads
+/// both with load_mesh and measures closest hit queries of rays shot down onto the surface
+static auto run_mesh_benchmarks(const BenchmarkOptions & options) -> std::vector<MeshResult>
+{
+    const u32 resolution = options.mesh_resolution;
+    const u32 vertex_count = (resolution + 1) * (resolution + 1);
+    const u32 triangle_count = 2 * resolution * resolution;
+    auto get_position = [&](u32 x, u32 z) -> f32vec3
+    {
+        f32 world_x = f32(x) / f32(resolution) * 10.0f - 5.0f;
+        f32 world_z = f32(z) / f32(resolution) * 10.0f - 5.0f;
+        return {world_x, get_mesh_height(world_x, world_z), world_z};
+    };
+    auto for_each_triangle = [&](const std::function<void(u32, u32, u32)> & callback)
+    {
+        for(u32 z = 0; z < resolution; z++)
+        {
+            for(u32 x = 0; x < resolution; x++)
+            {
+                u32 corner = z * (resolution + 1) + x;
+                callback(corner, corner + 1, corner + resolution + 1);
+                callback(corner + 1, corner + resolution + 2, corner + resolution + 1);
+            }
+        }
+    };
+
+    const std::filesystem::path directory = std::filesystem::temp_directory_path();
+    const std::string obj_path = (directory / "rso_benchmark_mesh.obj").string();
+    const std::string ply_path = (directory / "rso_benchmark_mesh.ply").string();
+    {
+        std::ofstream obj(obj_path);
+        for(u32 z = 0; z <= resolution; z++)
+        {
+            for(u32 x = 0; x <= resolution; x++)
+            {
+                f32vec3 position = get_position(x, z);
+                obj << "v " << position.x << " " << position.y << " " << position.z << "\n";
+            }
+        }
+        for_each_triangle([&](u32 a, u32 b, u32 c) { obj << "f " << a + 1 << " " << b + 1 << " " << c + 1 << "\n"; });
+        if(!obj) { throw std::runtime_error("[run_mesh_benchmarks()] Failed to write " + obj_path); }
+    }
+    {
+        std::ofstream ply(ply_path, std::ios::binary);
+        ply << "ply\nformat binary_little_endian 1.0\n"
+            << "element vertex " << vertex_count << "\nproperty float x\nproperty float y\nproperty float z\n"
+            << "element face " << triangle_count << "\nproperty list uchar uint vertex_indices\nend_header\n";
+        for(u32 z = 0; z <= resolution; z++)
+        {
+            for(u32 x = 0; x <= resolution; x++)
+            {
+                f32vec3 position = get_position(x, z);
+                ply.write(reinterpret_cast<const char *>(&position), sizeof(position));
+            }
+        }
+        for_each_triangle([&](u32 a, u32 b, u32 c)
+        {
+            const u8 count = 3;
+            const std::array<u32, 3> indices = {a, b, c};
+            ply.write(reinterpret_cast<const char *>(&count), sizeof(count));
+            ply.write(reinterpret_cast<const char *>(indices.data()), sizeof(indices));
+        });
+        if(!ply) { throw std::runtime_error("[run_mesh_benchmarks()] Failed to write " + ply_path); }
+    }
+
+    // rays from above the surface in random directions, most of them hit it
+    Sampler input_sampler = Sampler(BENCHMARK_SEED, 1, 0);
+    std::vector<Ray> rays;
+    for(u32 i = 0; i < KERNEL_INPUT_COUNT; i++)
+    {
+        f64vec3 start = f64vec3(input_sampler.get_random_double() * 10.0 - 5.0, 2.0, input_sampler.get_random_double() * 10.0 - 5.0);
+        f64vec3 direction = f64vec3(input_sampler.get_random_double() - 0.5, -1.0, input_sampler.get_random_double() - 0.5);
+        rays.emplace_back(start, direction);
+    }
+
+    std::vector<MeshResult> results;
+    for(const auto & [format, path] : {std::pair<std::string, std::string>{"obj", obj_path}, {"ply", ply_path}})
+    {
+        auto start = std::chrono::steady_clock::now();
+        std::shared_ptr<const MeshData> data = load_mesh(path);
+        std::chrono::duration<f64> load_time = std::chrono::steady_clock::now() - start;
+
+        const Material material = Material({.Le = {0.0, 0.0, 0.0}, .diffuse_albedo = {0.5, 0.5, 0.5}, .specular_albedo = {0.0, 0.0, 0.0}, .shininess = 1.0});
+        const Mesh mesh = Mesh({.material = &material, .data = data});
+        KernelResult intersect = measure_kernel("Intersect::operator()(Mesh)", KERNEL_INPUT_COUNT, options.repetitions, [&](u32 i)
+        {
+            return Intersect{rays[i]}(mesh).hit_distance;
+        });
+        KernelResult occludes = measure_kernel("Occludes::operator()(Mesh)", KERNEL_INPUT_COUNT, options.repetitions, [&](u32 i)
+        {
+            return f64(Occludes{rays[i], INFINITY}(mesh));
+        });
+        results.push_back({
+            .format = format,
+            .triangles = data->triangles.size(),
+            .load_seconds = load_time.count(),
+            .bytes_per_triangle = f64(data->get_memory_size()) / f64(data->triangles.size()),
+            .ns_per_ray = intersect.ns_per_op,
+            .occluded_ns_per_ray = occludes.ns_per_op
+        });
+    }
+    std::error_code error;
+    std::filesystem::remove(obj_path, error);
+    std::filesystem::remove(ply_path, error);
+    return results;
+}
+
+static auto to_json(
+    const BenchmarkOptions & options,
+    const std::vector<KernelResult> & kernels,
+    const std::vector<TraceResult> & env_traces,
+    const std::vector<TraceResult> & light_traces,
+    const std::vector<AdaptiveResult> & adaptive,
+    const std::vector<TraversalResult> & traversal,
+    const std::vector<MeshResult> & meshes) -> std::string
+{
+    std::ostringstream json;
+    json.precision(6);
+    json << "{\n";
+    json << "  \"env_map\": \"" << options.env_map << "\",\n";
+    json << "  \"resolution\": [" << options.dimensions.x << ", " << options.dimensions.y << "],\n";
+    json << "  \"samples\": " << options.samples << ",\n";
+    json << "  \"iterations\": " << options.iterations << ",\n";
+    json << "  \"kernels\": [\n";
+    for(size_t i = 0; i < kernels.size(); i++)
+    {
+        json << "    { \"name\": \"" << kernels[i].name << "\", \"ns_per_op\": " << kernels[i].ns_per_op
+             << ", \"operations\": " << kernels[i].operations << " }" << (i + 1 < kernels.size() ? "," : "") << "\n";
+    }
+    json << "  ],\n";
+    auto write_traces = [&](const std::string & name, const std::vector<TraceResult> & traces, bool last)
+    {
+        json << "  \"" << name << "\": [\n";
+        for(size_t i = 0; i < traces.size(); i++)
+        {
+            json << "    { \"method\": \"" << traces[i].method << "\", \"seconds\": " << traces[i].seconds
+                 << ", \"rays\": " << traces[i].rays << ", \"rays_per_second\": " << traces[i].rays_per_second
+                 << ", \"f32_seconds\": " << traces[i].f32_seconds << ", \"f32_rays_per_second\": " << traces[i].f32_rays_per_second
+                 << ", \"f32_speedup\": " << traces[i].f32_speedup << ", \"f32_rmse\": " << traces[i].f32_rmse
+                 << ", \"f32_relative_error\": " << traces[i].f32_relative_error
+                 << " }" << (i + 1 < traces.size() ? "," : "") << "\n";
+        }
+        json << "  ]" << (last ? "" : ",") << "\n";
+    };
+    write_traces("trace_scene_env_map", env_traces, false);
+    write_traces("trace_scene_light_sources", light_traces, false);
+    json << "  \"adaptive_sampling\": [\n";
+    for(size_t i = 0; i < adaptive.size(); i++)
+    {
+        json << "    { \"scene\": \"" << adaptive[i].scene << "\", \"mode\": \"" << adaptive[i].mode
+             << "\", \"seconds\": " << adaptive[i].seconds << ", \"mean_samples_per_pixel\": " << adaptive[i].mean_samples_per_pixel
+             << ", \"min_samples_per_pixel\": " << adaptive[i].min_samples_per_pixel
+             << ", \"max_samples_per_pixel\": " << adaptive[i].max_samples_per_pixel
+             << ", \"mean_relative_error\": " << adaptive[i].mean_relative_error
+             << " }" << (i + 1 < adaptive.size() ? "," : "") << "\n";
+    }
+    json << "  ],\n";
+    json << "  \"traversal\": [\n";
+    for(size_t i = 0; i < traversal.size(); i++)
+    {
+        json << "    { \"order\": \"" << traversal[i].order << "\", \"tile_size\": " << traversal[i].tile_size
+             << ", \"seconds\": " << traversal[i].seconds << ", \"rays_per_second\": " << traversal[i].rays_per_second;
+        if(traversal[i].counters_available)
+        {
+            json << ", \"l1d_read_misses\": " << traversal[i].l1d_read_misses << ", \"llc_misses\": " << traversal[i].llc_misses;
+        }
+        else { json << ", \"l1d_read_misses\": null, \"llc_misses\": null"; }
+        json << " }" << (i + 1 < traversal.size() ? "," : "") << "\n";
+    }
+    json << "  ],\n";
+    json << "  \"meshes\": [\n";
+    for(size_t i = 0; i < meshes.size(); i++)
+    {
+        json << "    { \"format\": \"" << meshes[i].format << "\", \"triangles\": " << meshes[i].triangles
+             << ", \"load_seconds\": " << meshes[i].load_seconds << ", \"bytes_per_triangle\": " << meshes[i].bytes_per_triangle
+             << ", \"ns_per_ray\": " << meshes[i].ns_per_ray
+             << ", \"occluded_ns_per_ray\": " << meshes[i].occluded_ns_per_ray << " }" << (i + 1 < meshes.size() ? "," : "") << "\n";
+    }
+    json << "  ]\n";
+    json << "}\n";
+    return json.str();
+}
+
+int main(int argc, char * argv[])
+{
+    try
+    {
+        BenchmarkOptions options = parse_options(argc, argv);
+        // the backend logs its progress to stdout, keep it out of the JSON report
+        std::streambuf * stdout_buffer = std::cout.rdbuf(std::cerr.rdbuf());
+
+        Scene scene = Scene::create_default_scene();
+        load_env_map(options, scene);
+
+        auto kernels = run_kernel_benchmarks(options, scene);
+        auto env_traces = run_trace_benchmarks(options, scene, true);
+        auto light_traces = run_trace_benchmarks(options, scene, false);
+        auto adaptive = run_adaptive_benchmarks(options, scene);
+        auto traversal = run_traversal_benchmarks(options, scene);
+        auto meshes = run_mesh_benchmarks(options);
+        std::cout.rdbuf(stdout_buffer);
+
+        std::string json = to_json(options, kernels, env_traces, light_traces, adaptive, traversal, meshes);
+        if(options.output.empty()) { std::cout << json; }
+        else
+        {
+            std::ofstream file(options.output);
+            if(!file) { throw std::runtime_error("[main()] Failed to open file " + options.output); }
+            file << json;
+            std::cout << "Benchmark results written to " << options.output << std::endl;
+        }
+    }
+    catch(const std::exception& e)
+    {
+        std::cerr << e.what() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,571 @@
+#include "distributed.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <thread>
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <spawn.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char ** environ;
+
+// larger messages are treated as a broken connection instead of being allocated
+const u64 MAX_MESSAGE_SIZE = u64(1) << 32;
+// anyone can connect to the coordinator, until a worker introduced itself its messages are limited to a HELLO
+const u64 MAX_HELLO_MESSAGE_SIZE = 64;
+// workers started before their coordinator keep trying to connect for this long
+const f64 WORKER_CONNECT_TIMEOUT = 60.0;
+
+enum class MessageType : u32
+{
+    // worker -> coordinator, protocol version
+    HELLO,
+    // coordinator -> worker, render arguments
+    JOB,
+    // coordinator -> worker, tile index and tile
+    TILE,
+    // worker -> coordinator, tile index and TileResult
+    TILE_RESULT,
+    // coordinator -> worker, no more tiles, the worker exits
+    DONE
+};
+
+struct MessageHeader
+{
+    MessageType type;
+    u32 reserved;
+    u64 size;
+};
+
+#pragma region tile_result
+auto TileResult::from_accumulation(const AccumulationBuffer & accumulation, u32 image_width, const RenderTile & tile, const TraceStats & stats) -> TileResult
+{
+    TileResult result = {.tile = tile, .stats = stats};
+    const u32 pixel_count = tile.get_pixel_count();
+    result.sum_r.reserve(pixel_count);
+    result.sum_g.reserve(pixel_count);
+    result.sum_b.reserve(pixel_count);
+    result.luminance_squared_sum.reserve(pixel_count);
+    result.count.reserve(pixel_count);
+    for(u32 y = tile.start.y; y < tile.end.y; y++)
+    {
+        for(u32 x = tile.start.x; x < tile.end.x; x++)
+        {
+            const u32 index = y * image_width + x;
+            result.sum_r.push_back(accumulation.sum_r[index]);
+            result.sum_g.push_back(accumulation.sum_g[index]);
+            result.sum_b.push_back(accumulation.sum_b[index]);
+            result.luminance_squared_sum.push_back(accumulation.luminance_squared_sum[index]);
+            result.count.push_back(accumulation.count[index]);
+        }
+    }
+    return result;
+}
+
+void TileResult::store(AccumulationBuffer & accumulation, u32 image_width) const
+{
+    u32 tile_index = 0;
+    for(u32 y = tile.start.y; y < tile.end.y; y++)
+    {
+        for(u32 x = tile.start.x; x < tile.end.x; x++, tile_index++)
+        {
+            const u32 index = y * image_width + x;
+            accumulation.sum_r[index] = sum_r[tile_index];
+            accumulation.sum_g[index] = sum_g[tile_index];
+            accumulation.sum_b[index] = sum_b[tile_index];
+            accumulation.luminance_squared_sum[index] = luminance_squared_sum[tile_index];
+            accumulation.count[index] = count[tile_index];
+        }
+    }
+}
+#pragma endregion tile_result
+
+#pragma region payload
+struct PayloadWriter
+{
+    std::vector<char> data;
+
+    template <typename Value>
+    void write(const Value & value) { write_bytes(&value, sizeof(Value)); }
+    void write_bytes(const void * bytes, size_t size)
+    {
+        const char * begin = static_cast<const char *>(bytes);
+        data.insert(data.end(), begin, begin + size);
+    }
+    void write_string(const std::string & text)
+    {
+        write(u32(text.size()));
+        write_bytes(text.data(), text.size());
+    }
+    template <typename Value>
+    void write_vector(const std::vector<Value> & values) { write_bytes(values.data(), values.size() * sizeof(Value)); }
+};
+
+struct PayloadReader
+{
+    std::span<const char> data;
+
+    template <typename Value>
+    auto read() -> Value
+    {
+        Value value;
+        read_bytes(&value, sizeof(Value));
+        return value;
+    }
+    void read_bytes(void * destination, size_t size)
+    {
+        if(size > data.size()) { throw std::runtime_error("[PayloadReader::read_bytes()] Message is truncated"); }
+        std::memcpy(destination, data.data(), size);
+        data = data.subspan(size);
+    }
+    auto read_string() -> std::string
+    {
+        std::string text(read<u32>(), '\0');
+        read_bytes(text.data(), text.size());
+        return text;
+    }
+    template <typename Value>
+    void read_vector(std::vector<Value> & values, size_t count)
+    {
+        // the count comes from the message, it must not allocate more than the message holds
+        if(count > data.size() / sizeof(Value)) { throw std::runtime_error("[PayloadReader::read_vector()] Message is truncated"); }
+        values.resize(count);
+        read_bytes(values.data(), count * sizeof(Value));
+    }
+};
+
+static void write_tile_result(PayloadWriter & writer, u32 tile_index, const TileResult & result)
+{
+    writer.write(tile_index);
+    writer.write(result.tile);
+    // the receiver merges the counters both sides know about
+    writer.write(u32(TRACE_COUNTER_COUNT));
+    writer.write(result.stats.counters);
+    writer.write_vector(result.sum_r);
+    writer.write_vector(result.sum_g);
+    writer.write_vector(result.sum_b);
+    writer.write_vector(result.luminance_squared_sum);
+    writer.write_vector(result.count);
+}
+
+// the tile has to be one of the given tiles, its planes are only read once the bounds match
+static auto read_tile_result(PayloadReader & reader, const std::vector<RenderTile> & tiles, u32 & tile_index) -> TileResult
+{
+    TileResult result = {};
+    tile_index = reader.read<u32>();
+    result.tile = reader.read<RenderTile>();
+    if(tile_index >= tiles.size()) { throw std::runtime_error("[read_tile_result()] Invalid tile index"); }
+    if(result.tile.start != tiles.at(tile_index).start || result.tile.end != tiles.at(tile_index).end)
+    {
+        throw std::runtime_error("[read_tile_result()] Tile bounds do not match the tile");
+    }
+    const u32 counter_count = reader.read<u32>();
+    for(u32 i = 0; i < counter_count; i++)
+    {
+        u64 counter = reader.read<u64>();
+        if(i < TRACE_COUNTER_COUNT) { result.stats.counters[i] = counter; }
+    }
+    const u32 pixel_count = result.tile.get_pixel_count();
+    reader.read_vector(result.sum_r, pixel_count);
+    reader.read_vector(result.sum_g, pixel_count);
+    reader.read_vector(result.sum_b, pixel_count);
+    reader.read_vector(result.luminance_squared_sum, pixel_count);
+    reader.read_vector(result.count, pixel_count);
+    return result;
+}
+#pragma endregion payload
+
+#pragma region connection
+/// @brief Blocking TCP connection exchanging whole messages
+struct Connection
+{
+    explicit Connection(int socket) : socket{socket}
+    {
+        // header and payload are written separately, with Nagle's algorithm the second write of every
+        // message would wait for the delayed ack of the first one
+        int no_delay = 1;
+        setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+    }
+    ~Connection() { if(socket >= 0) { close(socket); } }
+
+    Connection(const Connection &) = delete;
+    Connection & operator=(const Connection &) = delete;
+
+    void send(MessageType type, const std::vector<char> & payload = {});
+    // @return false once the other side closed the connection
+    auto receive(MessageType & type, std::vector<char> & payload, u64 max_size = MAX_MESSAGE_SIZE) -> bool;
+    [[nodiscard]] inline auto get_socket() const -> int { return socket; }
+
+    private:
+        int socket;
+
+        void send_bytes(const void * bytes, size_t size);
+        // @return false when the connection was closed before the first byte
+        auto receive_bytes(void * destination, size_t size) -> bool;
+};
+
+void Connection::send_bytes(const void * bytes, size_t size)
+{
+    const char * data = static_cast<const char *>(bytes);
+    while(size > 0)
+    {
+        // a closed connection reports an error instead of raising SIGPIPE
+        ssize_t sent = ::send(socket, data, size, MSG_NOSIGNAL);
+        if(sent < 0 && errno == EINTR) { continue; }
+        if(sent <= 0) { throw std::runtime_error("[Connection::send()] " + std::string(std::strerror(errno))); }
+        data += sent;
+        size -= size_t(sent);
+    }
+}
+
+auto Connection::receive_bytes(void * destination, size_t size) -> bool
+{
+    char * data = static_cast<char *>(destination);
+    size_t received = 0;
+    while(received < size)
+    {
+        ssize_t count = recv(socket, data + received, size - received, 0);
+        if(count < 0 && errno == EINTR) { continue; }
+        if(count < 0) { throw std::runtime_error("[Connection::receive()] " + std::string(std::strerror(errno))); }
+        if(count == 0)
+        {
+            if(received == 0) { return false; }
+            throw std::runtime_error("[Connection::receive()] Connection closed in the middle of a message");
+        }
+        received += size_t(count);
+    }
+    return true;
+}
+
+void Connection::send(MessageType type, const std::vector<char> & payload)
+{
+    MessageHeader header = {.type = type, .reserved = 0, .size = payload.size()};
+    send_bytes(&header, sizeof(header));
+    send_bytes(payload.data(), payload.size());
+}
+
+auto Connection::receive(MessageType & type, std::vector<char> & payload, u64 max_size) -> bool
+{
+    MessageHeader header;
+    if(!receive_bytes(&header, sizeof(header))) { return false; }
+    if(header.size > max_size) { throw std::runtime_error("[Connection::receive()] Invalid message size"); }
+    type = header.type;
+    payload.resize(header.size);
+    if(!payload.empty() && !receive_bytes(payload.data(), payload.size()))
+    {
+        throw std::runtime_error("[Connection::receive()] Connection closed in the middle of a message");
+    }
+    return true;
+}
+
+// splits host:port at the last colon so numeric IPv6 hosts keep their colons
+static auto split_address(const std::string & address) -> std::pair<std::string, std::string>
+{
+    size_t colon = address.rfind(':');
+    if(colon == std::string::npos) { throw std::runtime_error("[split_address()] Expected host:port, got " + address); }
+    std::string host = address.substr(0, colon);
+    if(host.size() >= 2 && host.front() == '[' && host.back() == ']') { host = host.substr(1, host.size() - 2); }
+    return {host, address.substr(colon + 1)};
+}
+
+using AddressList = std::unique_ptr<addrinfo, decltype(&freeaddrinfo)>;
+
+static auto resolve_address(const std::string & address, bool passive) -> AddressList
+{
+    auto [host, port] = split_address(address);
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = passive ? AI_PASSIVE : 0;
+    addrinfo * addresses = nullptr;
+    int error = getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &addresses);
+    if(error != 0) { throw std::runtime_error("[resolve_address()] " + address + ": " + gai_strerror(error)); }
+    return AddressList(addresses, &freeaddrinfo);
+}
+
+// @return listening socket and the port it is bound to
+static auto listen_on(const std::string & address) -> std::pair<int, u16>
+{
+    AddressList addresses = resolve_address(address, true);
+    for(addrinfo * candidate = addresses.get(); candidate != nullptr; candidate = candidate->ai_next)
+    {
+        int socket = ::socket(candidate->ai_family, candidate->ai_socktype, candidate->ai_protocol);
+        if(socket < 0) { continue; }
+        int reuse = 1;
+        setsockopt(socket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        if(bind(socket, candidate->ai_addr, candidate->ai_addrlen) == 0 && listen(socket, SOMAXCONN) == 0)
+        {
+            sockaddr_storage bound = {};
+            socklen_t bound_size = sizeof(bound);
+            getsockname(socket, reinterpret_cast<sockaddr *>(&bound), &bound_size);
+            char port[NI_MAXSERV];
+            getnameinfo(reinterpret_cast<sockaddr *>(&bound), bound_size, nullptr, 0, port, sizeof(port), NI_NUMERICSERV);
+            return {socket, u16(std::stoul(port))};
+        }
+        close(socket);
+    }
+    throw std::runtime_error("[listen_on()] Failed to listen on " + address + ": " + std::strerror(errno));
+}
+
+static auto connect_to(const std::string & address) -> int
+{
+    AddressList addresses = resolve_address(address, false);
+    for(addrinfo * candidate = addresses.get(); candidate != nullptr; candidate = candidate->ai_next)
+    {
+        int socket = ::socket(candidate->ai_family, candidate->ai_socktype, candidate->ai_protocol);
+        if(socket < 0) { continue; }
+        if(connect(socket, candidate->ai_addr, candidate->ai_addrlen) == 0) { return socket; }
+        close(socket);
+    }
+    return -1;
+}
+#pragma endregion connection
+
+#pragma region coordinator
+// starts the running executable as a worker connected to the coordinator
+static auto spawn_local_worker(const std::string & address, u32 threads) -> pid_t
+{
+    std::vector<std::string> arguments = {"/proc/self/exe", "--connect", address, "--threads", std::to_string(threads)};
+    std::vector<char *> argv;
+    for(auto & argument : arguments) { argv.push_back(argument.data()); }
+    argv.push_back(nullptr);
+    pid_t pid;
+    int error = posix_spawn(&pid, "/proc/self/exe", nullptr, nullptr, argv.data(), environ);
+    if(error != 0) { throw std::runtime_error("[spawn_local_worker()] " + std::string(std::strerror(error))); }
+    return pid;
+}
+
+auto run_coordinator(const CoordinatorInfo & info, AccumulationBuffer & accumulation) -> CoordinatorSummary
+{
+    const auto start = std::chrono::steady_clock::now();
+    CoordinatorSummary summary = {};
+
+    std::vector<RenderTile> tiles;
+    const u32 tile_size = glm::max(info.tile_size, 2u);
+    for(u32 y = 0; y < info.dimensions.y; y += tile_size)
+    {
+        for(u32 x = 0; x < info.dimensions.x; x += tile_size)
+        {
+            tiles.push_back({.start = {x, y}, .end = glm::min(u32vec2(x + tile_size, y + tile_size), info.dimensions)});
+        }
+    }
+    std::deque<u32> pending_tiles;
+    for(u32 i = 0; i < tiles.size(); i++) { pending_tiles.push_back(i); }
+    std::vector<bool> finished(tiles.size(), false);
+    u32 finished_count = 0;
+
+    PayloadWriter job;
+    job.write(u32(info.render_arguments.size()));
+    for(const auto & argument : info.render_arguments) { job.write_string(argument); }
+
+    auto [listen_socket, port] = listen_on(info.listen_address);
+    Connection listener = Connection(listen_socket);
+    auto [listen_host, listen_port] = split_address(info.listen_address);
+    std::cout << "Coordinator listening on " << listen_host << ":" << port << ", " << tiles.size() << " tiles" << std::endl;
+
+    std::vector<pid_t> local_workers;
+    if(info.local_workers > 0)
+    {
+        const u32 hardware_threads = glm::max(std::thread::hardware_concurrency(), 1u);
+        const u32 threads = info.local_worker_threads > 0 ? info.local_worker_threads : glm::max(hardware_threads / info.local_workers, 1u);
+        // local workers reach a coordinator listening on all interfaces through the loopback address
+        const bool any_host = listen_host.empty() || listen_host == "0.0.0.0" || listen_host == "::" || listen_host == "[::]";
+        const std::string local_address = (any_host ? std::string("127.0.0.1") : listen_host) + ":" + std::to_string(port);
+        for(u32 i = 0; i < info.local_workers; i++) { local_workers.push_back(spawn_local_worker(local_address, threads)); }
+    }
+    u32 running_local_workers = u32(local_workers.size());
+
+    struct WorkerConnection
+    {
+        std::unique_ptr<Connection> connection;
+        // tile the worker is tracing
+        std::optional<u32> tile = std::nullopt;
+        // sent its HELLO, only then larger messages are accepted
+        bool greeted = false;
+        // sent back at least one tile
+        bool contributed = false;
+    };
+    std::vector<WorkerConnection> workers;
+
+    auto assign_tile = [&](WorkerConnection & worker)
+    {
+        if(pending_tiles.empty()) { return; }
+        u32 tile_index = pending_tiles.front();
+        pending_tiles.pop_front();
+        PayloadWriter tile;
+        tile.write(tile_index);
+        tile.write(tiles.at(tile_index));
+        worker.tile = tile_index;
+        worker.connection->send(MessageType::TILE, tile.data);
+    };
+    // @return false when the worker has to be dropped
+    auto handle_message = [&](WorkerConnection & worker) -> bool
+    {
+        MessageType type;
+        std::vector<char> payload;
+        if(!worker.connection->receive(type, payload, worker.greeted ? MAX_MESSAGE_SIZE : MAX_HELLO_MESSAGE_SIZE)) { return false; }
+        PayloadReader reader = {.data = payload};
+        if(!worker.greeted && type != MessageType::HELLO) { throw std::runtime_error("[run_coordinator()] Worker did not send a HELLO first"); }
+        if(type == MessageType::HELLO)
+        {
+            u32 version = reader.read<u32>();
+            if(version != DISTRIBUTED_PROTOCOL_VERSION)
+            {
+                throw std::runtime_error("[run_coordinator()] Worker uses protocol version " + std::to_string(version));
+            }
+            worker.greeted = true;
+            worker.connection->send(MessageType::JOB, job.data);
+            assign_tile(worker);
+        }
+        else if(type == MessageType::TILE_RESULT)
+        {
+            u32 tile_index;
+            TileResult result = read_tile_result(reader, tiles, tile_index);
+            if(!worker.tile.has_value() || *worker.tile != tile_index) { throw std::runtime_error("[run_coordinator()] Worker sent a tile it was not given"); }
+            worker.tile.reset();
+            if(!finished.at(tile_index))
+            {
+                result.store(accumulation, info.dimensions.x);
+                summary.stats.merge(result.stats);
+                finished.at(tile_index) = true;
+                finished_count++;
+                std::cout << "Traced tile " << finished_count << " of " << tiles.size() << std::endl;
+            }
+            if(!worker.contributed)
+            {
+                worker.contributed = true;
+                summary.worker_count++;
+            }
+            assign_tile(worker);
+        }
+        else { throw std::runtime_error("[run_coordinator()] Unexpected message from worker"); }
+        return true;
+    };
+
+    while(finished_count < tiles.size())
+    {
+        std::vector<pollfd> sockets = {{.fd = listener.get_socket(), .events = POLLIN, .revents = 0}};
+        for(const auto & worker : workers) { sockets.push_back({.fd = worker.connection->get_socket(), .events = POLLIN, .revents = 0}); }
+        // wakes up regularly to notice local workers which exited without connecting
+        if(poll(sockets.data(), sockets.size(), 1000) < 0 && errno != EINTR)
+        {
+            throw std::runtime_error("[run_coordinator()] " + std::string(std::strerror(errno)));
+        }
+
+        // workers are dropped back to front so the indices of the sockets stay valid
+        for(size_t i = workers.size(); i-- > 0;)
+        {
+            if(sockets.at(i + 1).revents == 0) { continue; }
+            WorkerConnection & worker = workers.at(i);
+            bool keep = false;
+            try { keep = handle_message(worker); }
+            catch(const std::exception & e) { std::cerr << e.what() << '\n'; }
+            if(keep) { continue; }
+            if(worker.tile.has_value())
+            {
+                pending_tiles.push_front(*worker.tile);
+                summary.reassigned_tiles++;
+            }
+            workers.erase(workers.begin() + i);
+            // the tiles of the dropped worker go to the idle ones
+            for(auto & idle : workers)
+            {
+                if(!idle.tile.has_value()) { assign_tile(idle); }
+            }
+        }
+        if(sockets.front().revents & POLLIN)
+        {
+            int socket = accept(listener.get_socket(), nullptr, nullptr);
+            if(socket >= 0) { workers.push_back({.connection = std::make_unique<Connection>(socket)}); }
+        }
+
+        for(pid_t & pid : local_workers)
+        {
+            if(pid > 0 && waitpid(pid, nullptr, WNOHANG) == pid)
+            {
+                pid = 0;
+                running_local_workers--;
+            }
+        }
+        if(!local_workers.empty() && running_local_workers == 0 && workers.empty() && finished_count < tiles.size())
+        {
+            throw std::runtime_error("[run_coordinator()] All local workers exited before the render finished");
+        }
+    }
+
+    for(auto & worker : workers)
+    {
+        try { worker.connection->send(MessageType::DONE); }
+        catch(const std::exception & e) { std::cerr << e.what() << '\n'; }
+    }
+    workers.clear();
+    for(pid_t pid : local_workers)
+    {
+        if(pid > 0) { waitpid(pid, nullptr, 0); }
+    }
+    summary.seconds = std::chrono::duration<f64>(std::chrono::steady_clock::now() - start).count();
+    return summary;
+}
+#pragma endregion coordinator
+
+#pragma region worker
+void run_worker(const std::string & coordinator_address, const TileRendererFactory & create_renderer)
+{
+    const auto start = std::chrono::steady_clock::now();
+    int socket = connect_to(coordinator_address);
+    while(socket < 0)
+    {
+        if(std::chrono::duration<f64>(std::chrono::steady_clock::now() - start).count() > WORKER_CONNECT_TIMEOUT)
+        {
+            throw std::runtime_error("[run_worker()] Failed to connect to " + coordinator_address);
+        }
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        socket = connect_to(coordinator_address);
+    }
+    Connection connection = Connection(socket);
+
+    PayloadWriter hello;
+    hello.write(DISTRIBUTED_PROTOCOL_VERSION);
+    connection.send(MessageType::HELLO, hello.data);
+
+    TileRenderer render_tile;
+    MessageType type;
+    std::vector<char> payload;
+    while(connection.receive(type, payload))
+    {
+        PayloadReader reader = {.data = payload};
+        if(type == MessageType::JOB)
+        {
+            std::vector<std::string> render_arguments(reader.read<u32>());
+            for(auto & argument : render_arguments) { argument = reader.read_string(); }
+            render_tile = create_renderer(render_arguments);
+        }
+        else if(type == MessageType::TILE)
+        {
+            if(!render_tile) { throw std::runtime_error("[run_worker()] Received a tile before the job"); }
+            u32 tile_index = reader.read<u32>();
+            RenderTile tile = reader.read<RenderTile>();
+            PayloadWriter result;
+            write_tile_result(result, tile_index, render_tile(tile));
+            connection.send(MessageType::TILE_RESULT, result.data);
+        }
+        else if(type == MessageType::DONE) { return; }
+        else { throw std::runtime_error("[run_worker()] Unexpected message from coordinator"); }
+    }
+    throw std::runtime_error("[run_worker()] Coordinator closed the connection");
+}
+#pragma endregion worker
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "types.hpp"
+#include "raytracing_backend/accumulation_buffer.hpp"
+#include "raytracing_backend/trace_stats.hpp"
+
+// Coordinator and worker processes of a render split into tiles. The coordinator listens on a
+// TCP address, hands the render arguments and then one tile at a time to every connected worker
+// and assembles the accumulated tiles they send back. Workers can be spawned on the same machine
+// or started on other nodes with the address of the coordinator.
+// All messages are a fixed size header followed by the payload, numbers are sent in the byte
+// order of the machines so all nodes of a render have to share it.
+
+// also covers the order of the trace counters which are sent by their index
+const u32 DISTRIBUTED_PROTOCOL_VERSION = 3;
+
+// part of the image traced by a worker as a whole, all iterations at once
+struct RenderTile
+{
+    u32vec2 start;
+    u32vec2 end;
+
+    [[nodiscard]] inline auto get_pixel_count() const -> u32 { return (end.x - start.x) * (end.y - start.y); }
+};
+
+/// @brief Accumulated sums of the pixels of a tile, the planes are stored row by row
+/// and only cover the tile so their size is tile.get_pixel_count()
+struct TileResult
+{
+    RenderTile tile;
+    std::vector<f64> sum_r = {};
+    std::vector<f64> sum_g = {};
+    std::vector<f64> sum_b = {};
+    std::vector<f64> luminance_squared_sum = {};
+    std::vector<u32> count = {};
+    TraceStats stats;
+
+    // copies the tile out of an accumulation buffer covering the whole image
+    static auto from_accumulation(const AccumulationBuffer & accumulation, u32 image_width, const RenderTile & tile, const TraceStats & stats) -> TileResult;
+    // copies the tile into an accumulation buffer covering the whole image
+    void store(AccumulationBuffer & accumulation, u32 image_width) const;
+};
+
+struct CoordinatorInfo
+{
+    // host:port the coordinator listens on, port 0 picks a free port
+    std::string listen_address = "127.0.0.1:0";
+    // worker processes started on this machine, more workers can connect to the listen address at any time
+    u32 local_workers = 0;
+    // threads of every local worker, 0 shares the hardware threads between them
+    u32 local_worker_threads = 0;
+    // render options sent to every worker, each worker parses them and loads the scene once
+    std::vector<std::string> render_arguments;
+    u32vec2 dimensions;
+    // edge of the square tiles handed to the workers, every worker splits them further for its threads
+    u32 tile_size = 64;
+};
+
+struct CoordinatorSummary
+{
+    // counters of all workers, all zero when the workers were built without RSO_ENABLE_TRACE_STATS
+    TraceStats stats;
+    // workers which sent back at least one tile
+    u32 worker_count = 0;
+    // tiles traced again after the worker they were handed to disconnected
+    u32 reassigned_tiles = 0;
+    f64 seconds = 0.0;
+};
+
+/// @brief Distributes the tiles of the image over the workers and blocks until all of them came back
+/// @param accumulation receives the sums of all tiles, has to cover info.dimensions
+auto run_coordinator(const CoordinatorInfo & info, AccumulationBuffer & accumulation) -> CoordinatorSummary;
+
+// traces all iterations of a tile, created once per worker from the render arguments of the coordinator
+using TileRenderer = std::function<TileResult(const RenderTile &)>;
+using TileRendererFactory = std::function<TileRenderer(const std::vector<std::string> & render_arguments)>;
+
+/// @brief Connects to the coordinator and traces the tiles it hands out until it sends the last one
+/// @param coordinator_address host:port the coordinator listens on
+void run_worker(const std::string & coordinator_address, const TileRendererFactory & create_renderer);
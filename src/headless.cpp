@@ -0,0 +1,699 @@
+#include <stdexcept>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <sstream>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "types.hpp"
+#include "utils.hpp"
+#include "raytracing_backend/scene.hpp"
+#include "raytracing_backend/raytracer.hpp"
+#include "raytracing_backend/env_map_cache.hpp"
+#if defined(RSO_ENABLE_DISTRIBUTED)
+#include "distributed.hpp"
+#endif
+
+// Command line renderer which does not need GLFW/OpenGL or a display server.
+// Renders a single image with the given settings, writes it out as .hdr and exits,
+// or renders all jobs of a batch manifest in one process.
+
+struct RenderOptions
+{
+    // "default" or path to a scene file
+    std::string scene = "default";
+    // index into the bundled maps, path to a .hdr file or "none" to disable the env map,
+    // empty uses the env map of the scene file or the first bundled map for the default scene
+    std::string env_map = "";
+    // optional scene file the loaded scene is written to, .rsoscene for the binary format
+    std::string save_scene = "";
+    TraceMethod method = TraceMethod::LIGHT_SOURCE;
+    u32 samples = 500;
+    u32 iterations = 10;
+    u32vec2 dimensions = {600, 600};
+    // 0 uses one worker per hardware thread
+    u32 threads = 0;
+    u32 seed = 123;
+    // adaptive sampling, a target error of 0 renders every pixel with the same number of iterations
+    f32 target_relative_error = 0.0f;
+    u32 max_iterations = 64;
+    // termination policies, 0 disables them - iterations stays the upper bound
+    f64 time_budget = 0.0;
+    f32 target_noise = 0.0f;
+    // optional .hdr image with the number of samples traced for each pixel
+    std::string sample_counts_output = "";
+    // optional .json file with the ray and sample counters of the render
+    std::string stats_output = "";
+    // optional prefix of the depth, normal and albedo .hdr images taken from the primary hits
+    std::string aov_output = "";
+    u32 tile_size = 16;
+    TraversalOrder traversal_order = TraversalOrder::SCANLINE;
+    // render in single precision, the scene is converted once before tracing
+    bool single_precision = false;
+    std::string output = "results/render.hdr";
+    // distributed rendering - the coordinator spawns workers local worker processes and hands tiles of
+    // distributed_tile_size to them and to the workers connecting to listen, a worker connects to the
+    // coordinator at connect and takes all render options from it
+    u32 workers = 0;
+    std::string listen = "";
+    std::string connect = "";
+    u32 distributed_tile_size = 64;
+    // optional batch manifest, every job of it is rendered with these options as defaults
+    std::string batch = "";
+};
+
+static void print_usage(const char * program)
+{
+    std::cout <<
+        "Usage: " << program << " [options]\n"
+        "  --scene <default|path>          default scene or a .scene/.rsoscene file\n"
+        "  --save-scene <path>             write the scene to a .scene (text) or .rsoscene (binary) file\n"
+        "  --env-map <index|path|none>     bundled env map index, path to .hdr file or none\n"
+        "  --method <light|brdf|mis|mis-weights>\n"
+        "  --samples <n>                   samples per pixel per iteration\n"
+        "  --iterations <n>                number of progressive iterations, the budget in adaptive mode\n"
+        "  --adaptive <error>              stop sampling pixels once their relative error is below the target\n"
+        "  --max-iterations <n>            upper bound on the iterations of a single pixel in adaptive mode\n"
+        "  --sample-counts <path>          write the per pixel sample counts as .hdr file\n"
+        "  --stats <path>                  write the ray and sample counters as .json file\n"
+        "  --aov <prefix>                  write <prefix>_depth/_normal/_albedo.hdr from the primary hits\n"
+        "  --time-budget <seconds>         stop the render once the wall clock time runs out\n"
+        "  --target-noise <error>          stop the render once the mean relative error drops below the target\n"
+        "  --width <n> --height <n>        output resolution\n"
+        "  --threads <n>                   worker threads, 0 = hardware concurrency\n"
+        "  --seed <n>                      seed of the random sequences\n"
+        "  --precision <f32|f64>           floating point precision of the render\n"
+        "  --tile-size <n>                 edge of the square tiles handed to the worker threads\n"
+        "  --traversal <scanline|morton>   order of the tiles and of the pixels inside them\n"
+        "  --output <path>                 output .hdr file\n"
+        "  --workers <n>                   coordinator - trace the tiles in n local worker processes\n"
+        "  --listen <host:port>            coordinator - address remote workers connect to\n"
+        "  --distributed-tile-size <n>     coordinator - edge of the square tiles handed to the workers\n"
+        "  --connect <host:port>           worker - trace tiles for the coordinator at the address\n"
+        "  --batch <path>                  render all jobs of the manifest, the other options are their defaults\n";
+}
+
+static auto parse_method(std::string_view name) -> TraceMethod
+{
+    if(name == "light")       { return TraceMethod::LIGHT_SOURCE; }
+    if(name == "brdf")        { return TraceMethod::BRDF; }
+    if(name == "mis")         { return TraceMethod::MULTI_IMPORTANCE; }
+    if(name == "mis-weights") { return TraceMethod::MULTI_IMPORTANCE_WEIGHTS; }
+    throw std::runtime_error("[parse_method()] Unknown trace method " + std::string(name));
+}
+
+static auto parse_traversal_order(std::string_view name) -> TraversalOrder
+{
+    if(name == "scanline") { return TraversalOrder::SCANLINE; }
+    if(name == "morton")   { return TraversalOrder::MORTON; }
+    throw std::runtime_error("[parse_traversal_order()] Unknown traversal order " + std::string(name));
+}
+
+static auto parse_single_precision(std::string_view name) -> bool
+{
+    if(name == "f32") { return true; }
+    if(name == "f64") { return false; }
+    throw std::runtime_error("[parse_single_precision()] Unknown precision " + std::string(name));
+}
+
+static auto method_name(TraceMethod method) -> std::string
+{
+    switch(method)
+    {
+        case TraceMethod::LIGHT_SOURCE:             { return "light"; }
+        case TraceMethod::BRDF:                     { return "brdf"; }
+        case TraceMethod::MULTI_IMPORTANCE:         { return "mis"; }
+        case TraceMethod::MULTI_IMPORTANCE_WEIGHTS: { return "mis-weights"; }
+    }
+    return "unknown";
+}
+
+static auto stop_reason_name(TraceStopReason reason) -> std::string
+{
+    switch(reason)
+    {
+        case TraceStopReason::ITERATIONS_DONE: { return "all iterations done"; }
+        case TraceStopReason::TIME_BUDGET:     { return "time budget reached"; }
+        case TraceStopReason::NOISE_TARGET:    { return "noise target reached"; }
+        case TraceStopReason::CANCELLED:       { return "cancelled"; }
+    }
+    return "unknown";
+}
+
+// sample ratio used by the viewer for each of the methods
+static auto sample_ratio_from_method(TraceMethod method) -> f32
+{
+    switch(method)
+    {
+        case TraceMethod::LIGHT_SOURCE: { return 1.0f; }
+        case TraceMethod::BRDF:         { return 0.0f; }
+        default:                        { return 0.5f; }
+    }
+}
+
+static auto parse_options(const std::string & program, const std::vector<std::string> & arguments) -> RenderOptions
+{
+    RenderOptions options = {};
+    for(size_t i = 0; i < arguments.size(); i++)
+    {
+        std::string_view arg = arguments.at(i);
+        if(arg == "--help" || arg == "-h")
+        {
+            print_usage(program.c_str());
+            std::exit(EXIT_SUCCESS);
+        }
+        if(i + 1 >= arguments.size()) { throw std::runtime_error("[parse_options()] Missing value for " + std::string(arg)); }
+        std::string value = arguments.at(++i);
+
+        if(arg == "--scene")               { options.scene = value; }
+        else if(arg == "--save-scene")     { options.save_scene = value; }
+        else if(arg == "--env-map")        { options.env_map = value; }
+        else if(arg == "--method")         { options.method = parse_method(value); }
+        else if(arg == "--samples")        { options.samples = u32(std::stoul(value)); }
+        else if(arg == "--iterations")     { options.iterations = u32(std::stoul(value)); }
+        else if(arg == "--adaptive")       { options.target_relative_error = std::stof(value); }
+        else if(arg == "--max-iterations") { options.max_iterations = u32(std::stoul(value)); }
+        else if(arg == "--sample-counts")  { options.sample_counts_output = value; }
+        else if(arg == "--stats")          { options.stats_output = value; }
+        else if(arg == "--aov")            { options.aov_output = value; }
+        else if(arg == "--time-budget")    { options.time_budget = std::stod(value); }
+        else if(arg == "--target-noise")   { options.target_noise = std::stof(value); }
+        else if(arg == "--width")          { options.dimensions.x = u32(std::stoul(value)); }
+        else if(arg == "--height")         { options.dimensions.y = u32(std::stoul(value)); }
+        else if(arg == "--threads")        { options.threads = u32(std::stoul(value)); }
+        else if(arg == "--seed")           { options.seed = u32(std::stoul(value)); }
+        else if(arg == "--precision")      { options.single_precision = parse_single_precision(value); }
+        else if(arg == "--tile-size")      { options.tile_size = u32(std::stoul(value)); }
+        else if(arg == "--traversal")      { options.traversal_order = parse_traversal_order(value); }
+        else if(arg == "--output")         { options.output = value; }
+        else if(arg == "--workers")        { options.workers = u32(std::stoul(value)); }
+        else if(arg == "--listen")         { options.listen = value; }
+        else if(arg == "--connect")        { options.connect = value; }
+        else if(arg == "--distributed-tile-size") { options.distributed_tile_size = u32(std::stoul(value)); }
+        else if(arg == "--batch")          { options.batch = value; }
+        else { throw std::runtime_error("[parse_options()] Unknown option " + std::string(arg)); }
+    }
+    if(options.dimensions.x == 0 || options.dimensions.y == 0)
+    {
+        throw std::runtime_error("[parse_options()] Resolution must be non zero");
+    }
+    return options;
+}
+
+// shortest text which parses back to exactly the same value, std::to_string rounds to 6 decimals
+static auto float_to_string(f32 value) -> std::string
+{
+    std::array<char, 32> buffer;
+    auto result = std::to_chars(buffer.data(), buffer.data() + buffer.size(), value);
+    return std::string(buffer.data(), result.ptr);
+}
+
+// options which change the rendered image, sent by the coordinator to its workers
+static auto get_render_arguments(const RenderOptions & options) -> std::vector<std::string>
+{
+    return {
+        "--scene", options.scene,
+        "--env-map", options.env_map,
+        "--method", method_name(options.method),
+        "--samples", std::to_string(options.samples),
+        "--iterations", std::to_string(options.iterations),
+        "--adaptive", float_to_string(options.target_relative_error),
+        "--max-iterations", std::to_string(options.max_iterations),
+        "--width", std::to_string(options.dimensions.x),
+        "--height", std::to_string(options.dimensions.y),
+        "--seed", std::to_string(options.seed),
+        "--precision", options.single_precision ? "f32" : "f64",
+        "--tile-size", std::to_string(options.tile_size),
+        "--traversal", options.traversal_order == TraversalOrder::MORTON ? "morton" : "scanline"
+    };
+}
+
+// .hdr file of the env map selected by the options, empty when the scene is rendered without one
+// @param scene_env_map_path env map named by the scene file, used when the options do not select one
+static auto get_env_map_option_path(const RenderOptions & options, const std::string & scene_env_map_path) -> std::string
+{
+    if(options.env_map == "none") { return ""; }
+    if(options.env_map.empty()) { return options.scene == "default" ? get_env_map_path(0) : scene_env_map_path; }
+    if(options.env_map.find_first_not_of("0123456789") == std::string::npos)
+    {
+        u32 index = u32(std::stoul(options.env_map));
+        if(index >= ENV_MAP_COUNT) { throw std::runtime_error("[get_env_map_option_path()] Env map index out of range"); }
+        return get_env_map_path(index);
+    }
+    return options.env_map;
+}
+
+static auto load_scene(const RenderOptions & options) -> Scene
+{
+    bool default_scene = options.scene == "default";
+    // scene files only decode the env map they name when the options do not replace it
+    const bool use_scene_env_map = options.env_map.empty();
+    Scene scene = default_scene ? Scene::create_default_scene() : Scene::load_scene_from_file(options.scene, use_scene_env_map);
+    if(use_scene_env_map && !default_scene) { return scene; }
+
+    scene.env_map_path = get_env_map_option_path(options, scene.env_map_path);
+    scene.use_env_map = !scene.env_map_path.empty();
+    if(scene.use_env_map) { scene.env_map->load(scene.env_map_path); }
+    return scene;
+}
+
+static void save_scene(const Scene & scene, const RenderOptions & options)
+{
+    scene.save_scene_to_file(options.save_scene);
+    std::cout << "Scene saved to " << options.save_scene << std::endl;
+}
+
+template <typename T>
+static auto get_trace_info(const RenderOptions & options) -> typename RaytracerT<T>::TraceInfo
+{
+    return {
+        .samples = options.samples,
+        .iterations = options.iterations,
+        .method = options.method,
+        .seed = options.seed,
+        .tile_size = options.tile_size,
+        .traversal_order = options.traversal_order,
+        .adaptive = options.target_relative_error > 0.0f,
+        .target_relative_error = options.target_relative_error,
+        .max_iterations = options.max_iterations,
+        .time_budget = options.time_budget,
+        .target_noise = options.target_noise
+    };
+}
+
+template <typename TraceSummary>
+static void print_render_summary(const RenderOptions & options, const AccumulationBuffer & accumulation, const TraceSummary & summary)
+{
+    std::cout << "Render took " << summary.seconds << " s, " << stop_reason_name(summary.stop_reason)
+              << " after " << summary.completed_iterations << " iterations" << std::endl;
+
+    auto [min_iterations, max_iterations] = std::minmax_element(accumulation.count.begin(), accumulation.count.end());
+    std::cout << "Samples per pixel min " << *min_iterations * options.samples
+              << " mean " << f64(summary.total_samples) / f64(accumulation.get_pixel_count())
+              << " max " << *max_iterations * options.samples
+              << ", mean relative error " << summary.mean_relative_error
+              << " over " << summary.error_coverage * 100.0 << " % of the pixels" << std::endl;
+    if(!TRACE_STATS_ENABLED) { std::cout << "Built without RSO_ENABLE_TRACE_STATS, no counters were collected" << std::endl; }
+    else
+    {
+        std::cout << "Wasted samples light " << summary.stats.get_wasted_sample_rate(LIGHT_SOURCE_SAMPLES, LIGHT_SOURCE_WASTED)
+                  << " brdf " << summary.stats.get_wasted_sample_rate(BRDF_SAMPLES, BRDF_WASTED)
+                  << " total " << summary.stats.get_wasted_sample_rate() << std::endl;
+    }
+}
+
+// writes the image and the optional outputs, only reads the arguments so it can run next to the next render
+template <typename TraceSummary>
+static void save_render_outputs(const RenderOptions & options, const AccumulationBuffer & accumulation, const TraceSummary & summary)
+{
+    const u32 width = options.dimensions.x;
+    if(!options.stats_output.empty())
+    {
+        std::ofstream file(options.stats_output);
+        if(!file.is_open()) { throw std::runtime_error("[save_render_outputs()] Failed to open " + options.stats_output); }
+        file << "{\n";
+        file << "  \"method\": \"" << method_name(options.method) << "\",\n";
+        file << "  \"precision\": \"" << (options.single_precision ? "f32" : "f64") << "\",\n";
+        file << "  \"samples\": " << options.samples << ",\n";
+        file << "  \"completed_iterations\": " << summary.completed_iterations << ",\n";
+        file << "  \"seconds\": " << summary.seconds << ",\n";
+        file << "  \"stats\": " << summary.stats.to_json(2) << "\n";
+        file << "}\n";
+        std::cout << "Trace stats saved to " << options.stats_output << std::endl;
+    }
+    if(!options.sample_counts_output.empty())
+    {
+        save_hdr_image(options.sample_counts_output, [&](i32 y, std::span<f32> rgb)
+        {
+            for(u32 x = 0; x < width; x++)
+            {
+                f32 samples = f32(accumulation.count[y * width + x] * options.samples);
+                rgb[x * 3] = samples;
+                rgb[x * 3 + 1] = samples;
+                rgb[x * 3 + 2] = samples;
+            }
+        }, width, options.dimensions.y);
+        std::cout << "Sample counts saved to " << options.sample_counts_output << std::endl;
+    }
+
+    save_hdr_image(options.output, [&](i32 y, std::span<f32> rgb)
+    {
+        for(u32 x = 0; x < width; x++)
+        {
+            f64vec3 color = accumulation.get_mean(y * width + x);
+            rgb[x * 3] = f32(color.r);
+            rgb[x * 3 + 1] = f32(color.g);
+            rgb[x * 3 + 2] = f32(color.b);
+        }
+    }, width, options.dimensions.y);
+    std::cout << "Image succesfully saved to " << options.output << std::endl;
+}
+
+// depth, normal (mapped from [-1, 1] to [0, 1]) and albedo of the cached primary hits,
+// pixels whose ray missed the scene or which were never traced are black
+template <typename T>
+static void save_aovs(const RenderOptions & options, const RaytracerT<T> & raytracer, const Scene & scene)
+{
+    const u32 width = options.dimensions.x;
+    const PrimaryHitBufferT<T> & hits = raytracer.primary_hits;
+    auto save_aov = [&](const std::string & name, const std::function<f64vec3(u32)> & get_value)
+    {
+        const std::string path = options.aov_output + "_" + name + ".hdr";
+        save_hdr_image(path, [&](i32 y, std::span<f32> rgb)
+        {
+            for(u32 x = 0; x < width; x++)
+            {
+                const u32 index = y * width + x;
+                const bool is_hit = hits.valid[index] && hits.distances[index] >= T(0.0);
+                f64vec3 value = is_hit ? get_value(index) : f64vec3(0.0);
+                rgb[x * 3] = f32(value.r);
+                rgb[x * 3 + 1] = f32(value.g);
+                rgb[x * 3 + 2] = f32(value.b);
+            }
+        }, width, options.dimensions.y);
+        std::cout << "AOV saved to " << path << std::endl;
+    };
+    save_aov("depth", [&](u32 index) { return f64vec3(f64(hits.distances[index])); });
+    save_aov("normal", [&](u32 index) { return f64vec3(hits.normals[index]) * 0.5 + 0.5; });
+    save_aov("albedo", [&](u32 index)
+    {
+        const Material & material = scene.scene_materials.at(hits.materials[index]);
+        return material.diffuse_albedo + material.specular_albedo;
+    });
+}
+
+template <typename T>
+static void render(Scene & scene, const RenderOptions & options)
+{
+    RaytracerT<T> raytracer = RaytracerT<T>(options.dimensions, options.threads);
+    raytracer.set_sample_ratio(sample_ratio_from_method(options.method));
+    auto summary = raytracer.trace_scene(&scene, get_trace_info<T>(options));
+    print_render_summary(options, raytracer.accumulation, summary);
+    save_render_outputs(options, raytracer.accumulation, summary);
+    if(!options.aov_output.empty()) { save_aovs(options, raytracer, scene); }
+}
+
+
+// Batch manifest - one line per group of jobs and # starts a comment. Every entry of a line is a command line
+// option without the leading dashes and its value, e.g. env-map=3, options a line does not give keep their
+// value from the command line. Comma separated values render every combination of them and {option} in the
+// output paths is replaced by the value the job uses:
+//   scene=default env-map=0,1,2 method=light,mis samples=500 output=results/{method}_{env-map}.hdr
+static auto load_batch_manifest(const std::string & program, const std::vector<std::string> & arguments, const std::string & path) -> std::vector<RenderOptions>
+{
+    std::ifstream file(path);
+    if(!file.is_open()) { throw std::runtime_error("[load_batch_manifest()] Failed to open " + path); }
+    std::vector<std::string> default_arguments;
+    for(size_t i = 0; i < arguments.size(); i++)
+    {
+        if(arguments.at(i) == "--batch") { i++; }
+        else { default_arguments.push_back(arguments.at(i)); }
+    }
+
+    std::vector<RenderOptions> jobs;
+    std::unordered_set<std::string> outputs;
+    std::string line;
+    for(u32 line_number = 1; std::getline(file, line); line_number++)
+    {
+        auto error = [&](const std::string & message)
+        {
+            return std::runtime_error("[load_batch_manifest()] " + path + ": line " + std::to_string(line_number) + ": " + message);
+        };
+        std::istringstream entries(line.substr(0, line.find('#')));
+        std::vector<std::pair<std::string, std::vector<std::string>>> entry_values;
+        std::string entry;
+        while(entries >> entry)
+        {
+            size_t equals = entry.find('=');
+            if(equals == std::string::npos || equals == 0) { throw error("Expected option=value, got " + entry); }
+            std::vector<std::string> values;
+            std::istringstream value_list(entry.substr(equals + 1));
+            std::string value;
+            while(std::getline(value_list, value, ',')) { values.push_back(value); }
+            if(values.empty()) { values.push_back(""); }
+            entry_values.push_back({entry.substr(0, equals), values});
+        }
+        if(entry_values.empty()) { continue; }
+
+        // one job per combination of the values, the first entry of the line changes slowest
+        std::vector<size_t> choices(entry_values.size(), 0);
+        while(true)
+        {
+            std::vector<std::string> job_arguments = default_arguments;
+            for(size_t i = 0; i < entry_values.size(); i++)
+            {
+                job_arguments.push_back("--" + entry_values.at(i).first);
+                job_arguments.push_back(entry_values.at(i).second.at(choices.at(i)));
+            }
+            RenderOptions job;
+            try { job = parse_options(program, job_arguments); }
+            catch(const std::exception & e) { throw error(e.what()); }
+            if(job.workers > 0 || !job.listen.empty() || !job.connect.empty() || !job.batch.empty())
+            {
+                throw error("Batch jobs can not be distributed or start other batches");
+            }
+            for(std::string * output : {&job.output, &job.stats_output, &job.sample_counts_output, &job.aov_output})
+            {
+                for(size_t i = 0; i < entry_values.size(); i++)
+                {
+                    const std::string placeholder = "{" + entry_values.at(i).first + "}";
+                    for(size_t position = output->find(placeholder); position != std::string::npos; position = output->find(placeholder, position))
+                    {
+                        output->replace(position, placeholder.size(), entry_values.at(i).second.at(choices.at(i)));
+                    }
+                }
+            }
+            // a missing placeholder would silently overwrite the image of another job
+            if(!outputs.insert(job.output).second) { throw error("Output " + job.output + " is written by more than one job"); }
+            jobs.push_back(job);
+
+            size_t entry_index = entry_values.size();
+            while(entry_index > 0 && ++choices.at(entry_index - 1) == entry_values.at(entry_index - 1).second.size())
+            {
+                choices.at(entry_index - 1) = 0;
+                entry_index--;
+            }
+            if(entry_index == 0) { break; }
+        }
+    }
+    if(jobs.empty()) { throw std::runtime_error("[load_batch_manifest()] " + path + " has no jobs"); }
+    return jobs;
+}
+
+// raytracer kept for all batch jobs with the same resolution and thread count so its worker threads stay alive
+template <typename T>
+struct BatchRaytracer
+{
+    std::unique_ptr<RaytracerT<T>> raytracer;
+    u32vec2 dimensions = {0, 0};
+    u32 threads = 0;
+};
+
+template <typename T>
+static void render_batch_job(BatchRaytracer<T> & batch_raytracer, Scene & scene, const RenderOptions & job, std::future<void> & pending_outputs)
+{
+    if(!batch_raytracer.raytracer || batch_raytracer.dimensions != job.dimensions || batch_raytracer.threads != job.threads)
+    {
+        batch_raytracer.raytracer.reset();
+        batch_raytracer = {
+            .raytracer = std::make_unique<RaytracerT<T>>(job.dimensions, job.threads),
+            .dimensions = job.dimensions,
+            .threads = job.threads
+        };
+    }
+    RaytracerT<T> & raytracer = *batch_raytracer.raytracer;
+    raytracer.set_sample_ratio(sample_ratio_from_method(job.method));
+    auto summary = raytracer.trace_scene(&scene, get_trace_info<T>(job));
+    print_render_summary(job, raytracer.accumulation, summary);
+    // the primary hits are kept for the next job so they are written before it starts
+    if(!job.aov_output.empty()) { save_aovs(job, raytracer, scene); }
+
+    // the outputs of the previous job were written while this one rendered, this job's outputs
+    // are written from a copy of its estimates while the next job renders
+    if(pending_outputs.valid()) { pending_outputs.get(); }
+    pending_outputs = std::async(std::launch::async, [job, accumulation = raytracer.accumulation, summary]()
+    {
+        save_render_outputs(job, accumulation, summary);
+    });
+}
+
+static void render_batch(const std::string & program, const std::vector<std::string> & arguments, const std::string & manifest)
+{
+    const auto start = std::chrono::steady_clock::now();
+    const std::vector<RenderOptions> jobs = load_batch_manifest(program, arguments, manifest);
+    std::cout << "Batch " << manifest << " with " << jobs.size() << " jobs" << std::endl;
+
+    struct BatchScene
+    {
+        Scene scene;
+        // env map named by the scene file, the jobs replace it with their own
+        std::string env_map_path;
+    };
+    // scenes with their acceleration structures, decoded env maps and raytracers are kept for all jobs
+    std::unordered_map<std::string, std::unique_ptr<BatchScene>> scenes;
+    EnvMapCache env_maps;
+    BatchRaytracer<f64> raytracer_f64;
+    BatchRaytracer<f32> raytracer_f32;
+    std::future<void> pending_outputs;
+
+    auto get_scene = [&](const RenderOptions & job) -> BatchScene &
+    {
+        auto cached = scenes.find(job.scene);
+        if(cached != scenes.end()) { return *cached->second; }
+        // every job takes its env map from the cache, also the one named by the scene file
+        Scene scene = job.scene == "default" ? Scene::create_default_scene() : Scene::load_scene_from_file(job.scene, false);
+        std::string env_map_path = scene.env_map_path;
+        auto batch_scene = std::make_unique<BatchScene>(BatchScene{.scene = std::move(scene), .env_map_path = env_map_path});
+        return *scenes.emplace(job.scene, std::move(batch_scene)).first->second;
+    };
+    // env maps of scene files are only known once the scene is loaded, those are loaded when the job starts
+    auto prefetch_env_map = [&](const RenderOptions & job)
+    {
+        auto cached = scenes.find(job.scene);
+        if(job.env_map.empty() && job.scene != "default" && cached == scenes.end()) { return; }
+        std::string path = get_env_map_option_path(job, cached != scenes.end() ? cached->second->env_map_path : "");
+        if(!path.empty()) { env_maps.prefetch(path); }
+    };
+
+    for(size_t i = 0; i < jobs.size(); i++)
+    {
+        const RenderOptions & job = jobs.at(i);
+        std::cout << "Job " << i + 1 << " of " << jobs.size() << " - " << job.output << std::endl;
+        BatchScene & batch_scene = get_scene(job);
+        Scene & scene = batch_scene.scene;
+        scene.env_map_path = get_env_map_option_path(job, batch_scene.env_map_path);
+        scene.use_env_map = !scene.env_map_path.empty();
+        if(scene.use_env_map) { scene.env_map = env_maps.get(scene.env_map_path); }
+        // the next env map is decoded on the loader thread of the cache while this job renders
+        if(i + 1 < jobs.size()) { prefetch_env_map(jobs.at(i + 1)); }
+        if(!job.save_scene.empty()) { save_scene(scene, job); }
+
+        if(job.single_precision) { render_batch_job(raytracer_f32, scene, job, pending_outputs); }
+        else { render_batch_job(raytracer_f64, scene, job, pending_outputs); }
+    }
+    if(pending_outputs.valid()) { pending_outputs.get(); }
+
+    auto stats = env_maps.get_stats();
+    std::cout << "Batch of " << jobs.size() << " jobs took "
+              << std::chrono::duration<f64>(std::chrono::steady_clock::now() - start).count() << " s, "
+              << scenes.size() << " scenes loaded, env map cache hits " << stats.hits << " misses " << stats.misses << std::endl;
+}
+
+#if defined(RSO_ENABLE_DISTRIBUTED)
+// the worker keeps the scene and the raytracer for all tiles of the render
+template <typename T>
+static auto create_tile_renderer(const RenderOptions & options) -> TileRenderer
+{
+    auto scene = std::make_shared<Scene>(load_scene(options));
+    auto raytracer = std::make_shared<RaytracerT<T>>(options.dimensions, options.threads);
+    raytracer->set_sample_ratio(sample_ratio_from_method(options.method));
+    // every tile only clears and traces its own region, the scene is prepared once for all of them
+    const auto trace_info = get_trace_info<T>(options);
+    return [=](const RenderTile & tile) -> TileResult
+    {
+        auto info = trace_info;
+        info.region_start = tile.start;
+        info.region_end = tile.end;
+        auto summary = raytracer->trace_scene(scene.get(), info);
+        return TileResult::from_accumulation(raytracer->accumulation, options.dimensions.x, tile, summary.stats);
+    };
+}
+
+static void run_render_worker(const RenderOptions & worker_options)
+{
+    run_worker(worker_options.connect, [&](const std::vector<std::string> & render_arguments)
+    {
+        RenderOptions options = parse_options("", render_arguments);
+        // the threads are a property of the node the worker runs on
+        options.threads = worker_options.threads;
+        if(options.single_precision) { return create_tile_renderer<f32>(options); }
+        return create_tile_renderer<f64>(options);
+    });
+}
+
+static void render_distributed(const RenderOptions & options)
+{
+    if(options.time_budget > 0.0 || options.target_noise > 0.0f)
+    {
+        throw std::runtime_error("[render_distributed()] Time budget and noise target are not supported by distributed renders");
+    }
+    if(!options.aov_output.empty()) { throw std::runtime_error("[render_distributed()] AOVs are not supported by distributed renders"); }
+    AccumulationBuffer accumulation = AccumulationBuffer(options.dimensions.x * options.dimensions.y);
+    auto coordinator = run_coordinator({
+        .listen_address = options.listen.empty() ? "127.0.0.1:0" : options.listen,
+        .local_workers = options.workers,
+        .local_worker_threads = options.threads,
+        .render_arguments = get_render_arguments(options),
+        .dimensions = options.dimensions,
+        .tile_size = options.distributed_tile_size
+    }, accumulation);
+    std::cout << "Tiles traced by " << coordinator.worker_count << " workers, " << coordinator.reassigned_tiles
+              << " tiles reassigned after a worker disconnected" << std::endl;
+
+    Raytracer::TraceSummary summary = {
+        .stop_reason = ITERATIONS_DONE,
+        // every tile runs all of its iterations, adaptive tiles count the ones they skip as finished
+        .completed_iterations = options.target_relative_error > 0.0f ? glm::max(options.max_iterations, options.iterations) : options.iterations,
+        .total_samples = 0,
+        .seconds = coordinator.seconds,
+        .mean_relative_error = accumulation.get_mean_relative_error(),
+        .error_coverage = accumulation.get_relative_error_coverage(),
+        .stats = coordinator.stats
+    };
+    for(u32 iterations : accumulation.count) { summary.total_samples += u64(iterations) * options.samples; }
+    print_render_summary(options, accumulation, summary);
+    save_render_outputs(options, accumulation, summary);
+}
+#endif
+
+int main(int argc, char * argv[])
+{
+    try
+    {
+        const std::vector<std::string> arguments = std::vector<std::string>(argv + 1, argv + argc);
+        RenderOptions options = parse_options(argv[0], arguments);
+        if(!options.batch.empty())
+        {
+            render_batch(argv[0], arguments, options.batch);
+            return EXIT_SUCCESS;
+        }
+        const bool is_worker = !options.connect.empty();
+        const bool is_coordinator = options.workers > 0 || !options.listen.empty();
+#if defined(RSO_ENABLE_DISTRIBUTED)
+        if(is_worker)
+        {
+            run_render_worker(options);
+            return EXIT_SUCCESS;
+        }
+        if(is_coordinator)
+        {
+            // the workers load their own copy of the scene, the coordinator only loads it to save it
+            if(!options.save_scene.empty()) { save_scene(load_scene(options), options); }
+            render_distributed(options);
+            return EXIT_SUCCESS;
+        }
+#else
+        if(is_worker || is_coordinator) { throw std::runtime_error("[main()] Built without support for distributed rendering"); }
+#endif
+        Scene scene = load_scene(options);
+        if(!options.save_scene.empty()) { save_scene(scene, options); }
+
+        if(options.single_precision) { render<f32>(scene, options); }
+        else { render<f64>(scene, options); }
+    }
+    catch(const std::exception& e)
+    {
+        std::cerr << e.what() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,65 @@
+#include "accumulation_buffer.hpp"
+
+#include <algorithm>
+
+AccumulationBuffer::AccumulationBuffer(u32 pixel_count) :
+    sum_r(pixel_count, 0.0),
+    sum_g(pixel_count, 0.0),
+    sum_b(pixel_count, 0.0),
+    luminance_squared_sum(pixel_count, 0.0),
+    count(pixel_count, 0)
+{
+}
+
+void AccumulationBuffer::clear()
+{
+    std::fill(sum_r.begin(), sum_r.end(), 0.0);
+    std::fill(sum_g.begin(), sum_g.end(), 0.0);
+    std::fill(sum_b.begin(), sum_b.end(), 0.0);
+    std::fill(luminance_squared_sum.begin(), luminance_squared_sum.end(), 0.0);
+    std::fill(count.begin(), count.end(), 0u);
+}
+
+void AccumulationBuffer::clear(u32 image_width, u32vec2 region_start, u32vec2 region_end)
+{
+    for(u32 y = region_start.y; y < region_end.y; y++)
+    {
+        const u32 row_start = y * image_width + region_start.x;
+        const u32 row_end = y * image_width + region_end.x;
+        std::fill(sum_r.begin() + row_start, sum_r.begin() + row_end, 0.0);
+        std::fill(sum_g.begin() + row_start, sum_g.begin() + row_end, 0.0);
+        std::fill(sum_b.begin() + row_start, sum_b.begin() + row_end, 0.0);
+        std::fill(luminance_squared_sum.begin() + row_start, luminance_squared_sum.begin() + row_end, 0.0);
+        std::fill(count.begin() + row_start, count.begin() + row_end, 0u);
+    }
+}
+
+auto AccumulationBuffer::get_relative_error(u32 index) const -> f64
+{
+    const f64 n = f64(count[index]);
+    if(count[index] < 2) { return 0.0; }
+    const f64 mean_luminance = get_luminance(sum_r[index], sum_g[index], sum_b[index]) / n;
+    // sample variance of the estimates, clamped as rounding can push it slightly below zero
+    const f64 variance = glm::max((luminance_squared_sum[index] - mean_luminance * mean_luminance * n) / (n - 1.0), 0.0);
+    // variance of the mean is the sample variance over the number of iterations
+    return glm::sqrt(variance / n) / glm::max(mean_luminance, RELATIVE_ERROR_LUMINANCE_FLOOR);
+}
+
+auto AccumulationBuffer::get_mean_relative_error() const -> f64
+{
+    f64 error_sum = 0.0;
+    u32 estimated_pixels = 0;
+    for(u32 i = 0; i < count.size(); i++)
+    {
+        if(!has_relative_error(i)) { continue; }
+        error_sum += get_relative_error(i);
+        estimated_pixels++;
+    }
+    return estimated_pixels > 0 ? error_sum / f64(estimated_pixels) : 0.0;
+}
+
+auto AccumulationBuffer::get_relative_error_coverage() const -> f64
+{
+    if(count.empty()) { return 0.0; }
+    return f64(std::count_if(count.begin(), count.end(), [](u32 iterations) { return iterations >= 2; })) / f64(count.size());
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <vector>
+
+#include "types.hpp"
+
+/// @brief Per pixel sums of the iteration estimates stored as separate planes so each iteration
+/// only adds into the sums, the mean and the variance of a pixel are resolved on demand.
+/// The sums grow with the iteration count so they are kept in double precision for both
+/// raytracer precisions, otherwise the variance computed from the squared sums would cancel out
+struct AccumulationBuffer
+{
+    std::vector<f64> sum_r;
+    std::vector<f64> sum_g;
+    std::vector<f64> sum_b;
+    // sum of the squared luminance of the estimates
+    std::vector<f64> luminance_squared_sum;
+    // number of iterations accumulated in each pixel, every iteration averages TraceInfo::samples samples
+    std::vector<u32> count;
+
+    AccumulationBuffer(u32 pixel_count);
+
+    void clear();
+    // clears only the pixels in [region_start, region_end) of an image image_width pixels wide
+    void clear(u32 image_width, u32vec2 region_start, u32vec2 region_end);
+    // no bounds checks, called once per pixel and iteration from the render loop
+    inline void add(u32 index, f64 r, f64 g, f64 b)
+    {
+        const f64 luminance = get_luminance(r, g, b);
+        sum_r[index] += r;
+        sum_g[index] += g;
+        sum_b[index] += b;
+        luminance_squared_sum[index] += luminance * luminance;
+        count[index]++;
+    }
+    [[nodiscard]] inline auto get_mean(u32 index) const -> f64vec3
+    {
+        if(count[index] == 0) { return f64vec3(0.0); }
+        return f64vec3(sum_r[index], sum_g[index], sum_b[index]) / f64(count[index]);
+    }
+    /// @brief estimated standard error of the mean luminance relative to the luminance itself
+    /// computed from the spread of the per iteration estimates, pixels with less than two iterations report 0
+    [[nodiscard]] auto get_relative_error(u32 index) const -> f64;
+    // the relative error needs at least two iterations, the 0 reported before that is not an estimate
+    [[nodiscard]] inline auto has_relative_error(u32 index) const -> bool { return count[index] >= 2; }
+    /// @brief relative error averaged over the pixels which have an estimate of it, 0 when no pixel has one
+    [[nodiscard]] auto get_mean_relative_error() const -> f64;
+    /// @brief fraction of the pixels averaged by get_mean_relative_error
+    [[nodiscard]] auto get_relative_error_coverage() const -> f64;
+    [[nodiscard]] inline auto get_pixel_count() const -> u32 { return u32(count.size()); }
+
+    static inline auto get_luminance(f64 r, f64 g, f64 b) -> f64 { return 0.2126 * r + 0.7152 * g + 0.0722 * b; }
+
+    private:
+        // keeps the relative error of (nearly) black pixels finite
+        static constexpr f64 RELATIVE_ERROR_LUMINANCE_FLOOR = 1e-3;
+};
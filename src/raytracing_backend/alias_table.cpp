@@ -0,0 +1,69 @@
+#include "alias_table.hpp"
+
+void build_alias_table(std::span<const f64> weights, std::span<AliasEntry> table)
+{
+    const u32 count = u32(weights.size());
+    if(count == 0) { return; }
+
+    f64 total_weight = 0.0;
+    for(f64 weight : weights) { total_weight += weight; }
+
+    // distribution with no weight at all, sample every index uniformly
+    if(total_weight <= 0.0)
+    {
+        for(u32 i = 0; i < count; i++) { table[i] = {.threshold = 1.0f, .alias = i}; }
+        return;
+    }
+
+    // scaled probabilities, the average bucket has the value 1.0
+    std::vector<f64> scaled(count);
+    std::vector<u32> small;
+    std::vector<u32> large;
+    small.reserve(count);
+    large.reserve(count);
+    for(u32 i = 0; i < count; i++)
+    {
+        scaled[i] = weights[i] * count / total_weight;
+        if(scaled[i] < 1.0) { small.push_back(i); }
+        else                { large.push_back(i); }
+    }
+
+    // Vose's method - fill each under full bucket with the excess of an over full one
+    while(!small.empty() && !large.empty())
+    {
+        u32 small_index = small.back();
+        small.pop_back();
+        u32 large_index = large.back();
+
+        table[small_index] = {.threshold = f32(scaled[small_index]), .alias = large_index};
+        scaled[large_index] = (scaled[large_index] + scaled[small_index]) - 1.0;
+        if(scaled[large_index] < 1.0)
+        {
+            large.pop_back();
+            small.push_back(large_index);
+        }
+    }
+    // whatever is left is full up to rounding errors
+    for(u32 index : large) { table[index] = {.threshold = 1.0f, .alias = index}; }
+    for(u32 index : small) { table[index] = {.threshold = 1.0f, .alias = index}; }
+}
+
+auto sample_alias_table(std::span<const AliasEntry> table, f64 u) -> AliasSample
+{
+    const f64 scaled = u * f64(table.size());
+    const u32 bucket = glm::min(u32(scaled), u32(table.size() - 1));
+    const f64 fraction = scaled - f64(bucket);
+    const AliasEntry & entry = table[bucket];
+
+    if(fraction < entry.threshold)
+    {
+        return {.index = bucket, .remainder = fraction / entry.threshold};
+    }
+    return {.index = entry.alias, .remainder = glm::min((fraction - entry.threshold) / (1.0 - entry.threshold), 1.0 - EPSILON)};
+}
+
+void AliasTable::init(std::span<const f64> weights)
+{
+    entries = std::vector<AliasEntry>(weights.size());
+    build_alias_table(weights, entries);
+}
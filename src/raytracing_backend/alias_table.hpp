@@ -0,0 +1,35 @@
+#pragma once
+
+#include <span>
+#include <vector>
+
+#include "types.hpp"
+
+/// @brief One bucket of a Walker/Vose alias table - the bucket returns its own index with
+/// probability threshold and the index of its alias otherwise
+struct AliasEntry
+{
+    f32 threshold = 1.0f;
+    u32 alias = 0;
+};
+
+struct AliasSample
+{
+    u32 index;
+    // the part of the random number not used for picking the index, remapped to [0, 1)
+    f64 remainder;
+};
+
+/// @brief builds the alias table for the (not necessarily normalized) weights into table,
+/// table needs to have the same size as weights
+void build_alias_table(std::span<const f64> weights, std::span<AliasEntry> table);
+/// @brief picks an index with probability proportional to its weight in constant time
+[[nodiscard]] auto sample_alias_table(std::span<const AliasEntry> table, f64 u) -> AliasSample;
+
+struct AliasTable
+{
+    std::vector<AliasEntry> entries;
+
+    void init(std::span<const f64> weights);
+    [[nodiscard]] inline auto sample(f64 u) const -> AliasSample { return sample_alias_table(entries, u); }
+};
@@ -0,0 +1,320 @@
+#include "bvh.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+
+// number of buckets the centroid range is split into when evaluating SAH
+const u32 SAH_BUCKET_COUNT = 12;
+// relative cost of traversing a node compared to a single primitive intersection
+const f64 SAH_TRAVERSAL_COST = 0.5;
+const u32 MAX_LEAF_PRIMITIVES = 4;
+
+template <typename T>
+void BVHT<T>::build(const std::vector<ObjectT<T>> & objects)
+{
+    std::vector<AABBT<T>> primitive_bounds;
+    primitive_bounds.reserve(objects.size());
+    for(const auto & object : objects) { primitive_bounds.push_back(std::visit(GetBounds{}, object)); }
+    build(primitive_bounds);
+}
+
+template <typename T>
+void BVHT<T>::build(const std::vector<AABBT<T>> & primitive_bounds)
+{
+    nodes.clear();
+    primitive_indices.clear();
+    if(primitive_bounds.empty()) { return; }
+
+    std::vector<BuildPrimitive> primitives;
+    primitives.reserve(primitive_bounds.size());
+    for(u32 i = 0; i < primitive_bounds.size(); i++)
+    {
+        primitives.push_back({.bounds = primitive_bounds[i], .centroid = primitive_bounds[i].centroid(), .index = i});
+    }
+
+    nodes.reserve(2 * primitive_bounds.size());
+    primitive_indices.reserve(primitive_bounds.size());
+    build_recursive(primitives, 0, u32(primitives.size()), 0);
+}
+
+template <typename T>
+auto BVHT<T>::build_recursive(std::vector<BuildPrimitive> & primitives, u32 start, u32 end, u32 depth) -> u32
+{
+    u32 node_index = u32(nodes.size());
+    nodes.emplace_back();
+
+    AABBT<T> bounds = {};
+    AABBT<T> centroid_bounds = {};
+    for(u32 i = start; i < end; i++)
+    {
+        bounds.grow(primitives.at(i).bounds);
+        centroid_bounds.grow(primitives.at(i).centroid);
+    }
+    nodes.at(node_index).bounds = bounds;
+
+    auto make_leaf = [&]() -> u32
+    {
+        nodes.at(node_index).offset = u32(primitive_indices.size());
+        nodes.at(node_index).count = end - start;
+        for(u32 i = start; i < end; i++) { primitive_indices.push_back(primitives.at(i).index); }
+        return node_index;
+    };
+
+    u32 primitive_count = end - start;
+    if(primitive_count == 1) { return make_leaf(); }
+
+    // split along the axis with the largest centroid extent
+    tvec3<T> extent = centroid_bounds.max - centroid_bounds.min;
+    u32 axis = 0;
+    if(extent.y > extent.x) { axis = 1; }
+    if(extent.z > extent[axis]) { axis = 2; }
+    // all centroids are in the same spot - no split will separate them, the test is exact as small
+    // meshes have centroids much closer than the scene epsilon
+    if(extent[axis] == T(0.0)) { return make_leaf(); }
+
+    auto split_median = [&]() -> u32
+    {
+        u32 mid = start + primitive_count / 2;
+        std::nth_element(primitives.begin() + start, primitives.begin() + mid, primitives.begin() + end,
+            [&](const BuildPrimitive & a, const BuildPrimitive & b) { return a.centroid[axis] < b.centroid[axis]; });
+        return mid;
+    };
+    auto build_children = [&](u32 mid) -> u32
+    {
+        build_recursive(primitives, start, mid, depth + 1);
+        u32 right_child = build_recursive(primitives, mid, end, depth + 1);
+        nodes.at(node_index).offset = right_child;
+        nodes.at(node_index).axis = axis;
+        return node_index;
+    };
+    if(depth >= BVH_MAX_SAH_DEPTH) { return build_children(split_median()); }
+
+    struct Bucket
+    {
+        u32 count = 0;
+        AABBT<T> bounds;
+    };
+    std::array<Bucket, SAH_BUCKET_COUNT> buckets = {};
+    auto bucket_from_centroid = [&](const tvec3<T> & centroid) -> u32
+    {
+        u32 bucket = u32(SAH_BUCKET_COUNT * ((centroid[axis] - centroid_bounds.min[axis]) / extent[axis]));
+        return glm::min(bucket, SAH_BUCKET_COUNT - 1);
+    };
+    for(u32 i = start; i < end; i++)
+    {
+        Bucket & bucket = buckets.at(bucket_from_centroid(primitives.at(i).centroid));
+        bucket.count += 1;
+        bucket.bounds.grow(primitives.at(i).bounds);
+    }
+
+    // sweep the buckets from both sides to evaluate the cost of each split plane
+    std::array<f64, SAH_BUCKET_COUNT - 1> split_costs = {};
+    AABBT<T> running_bounds = {};
+    u32 running_count = 0;
+    for(u32 i = 0; i < SAH_BUCKET_COUNT - 1; i++)
+    {
+        running_bounds.grow(buckets.at(i).bounds);
+        running_count += buckets.at(i).count;
+        split_costs.at(i) = running_count * running_bounds.surface_area();
+    }
+    running_bounds = {};
+    running_count = 0;
+    for(u32 i = SAH_BUCKET_COUNT - 1; i > 0; i--)
+    {
+        running_bounds.grow(buckets.at(i).bounds);
+        running_count += buckets.at(i).count;
+        split_costs.at(i - 1) += running_count * running_bounds.surface_area();
+    }
+
+    u32 best_split = 0;
+    for(u32 i = 1; i < SAH_BUCKET_COUNT - 1; i++)
+    {
+        if(split_costs.at(i) < split_costs.at(best_split)) { best_split = i; }
+    }
+    f64 split_cost = SAH_TRAVERSAL_COST + split_costs.at(best_split) / bounds.surface_area();
+    f64 leaf_cost = f64(primitive_count);
+    if(primitive_count <= MAX_LEAF_PRIMITIVES && leaf_cost <= split_cost) { return make_leaf(); }
+
+    auto middle = std::partition(primitives.begin() + start, primitives.begin() + end,
+        [&](const BuildPrimitive & primitive) { return bucket_from_centroid(primitive.centroid) <= best_split; });
+    u32 mid = u32(std::distance(primitives.begin(), middle));
+    // degenerate split, fall back to splitting the primitives in half
+    if(mid == start || mid == end) { mid = split_median(); }
+
+    return build_children(mid);
+}
+
+template <typename T>
+auto BVHT<T>::closest_hit(const TraceInfo & info) const -> HitInfo
+{
+    HitInfo closest_hit {};
+    if(nodes.empty()) { return closest_hit; }
+
+    const tvec3<T> inv_direction = T(1.0) / info.ray.direction;
+    // most rays in env map scenes escape the scene entirely - test them against the scene bounds first
+    TRACE_STAT(BVH_NODE_TESTS);
+    if(intersect_bounds(nodes.front().bounds, info.ray, inv_direction, T(INFINITY)) < T(0.0)) { return closest_hit; }
+
+    traverse_closest(0, info, inv_direction, closest_hit);
+    return closest_hit;
+}
+
+template <typename T>
+void BVHT<T>::traverse_closest(u32 root_index, const TraceInfo & info, const tvec3<T> & inv_direction, HitInfo & closest_hit) const
+{
+    const IntersectT<T> intersect = IntersectT<T>{info.ray};
+    T max_distance = closest_hit.hit_distance < T(0.0) ? T(INFINITY) : closest_hit.hit_distance;
+
+    traverse(root_index, info.ray, inv_direction, max_distance, [&](u32 slot) -> T
+    {
+        const ObjectT<T> & object = info.objects[primitive_indices[slot]];
+        if(info.skip_spheres && std::holds_alternative<SphereT<T>>(object)) { return T(-1.0); }
+
+        TRACE_STAT(OBJECT_TESTS);
+        HitInfo hit = std::visit(intersect, object);
+        if(hit.hit_distance < EPSILON_V<T>) { return T(-1.0); }
+        if(closest_hit.hit_distance >= T(0.0) && hit.hit_distance >= closest_hit.hit_distance) { return T(-1.0); }
+        closest_hit = hit;
+        closest_hit.object = &object;
+        return hit.hit_distance;
+    });
+}
+
+template <typename T>
+auto BVHT<T>::occluded(const TraceInfo & info, T max_distance) const -> bool
+{
+    if(nodes.empty()) { return false; }
+
+    const tvec3<T> inv_direction = T(1.0) / info.ray.direction;
+    const OccludesT<T> occludes = OccludesT<T>{info.ray, max_distance};
+    return traverse_any(0, info.ray, inv_direction, max_distance, [&](u32 slot) -> bool
+    {
+        const ObjectT<T> & object = info.objects[primitive_indices[slot]];
+        if(info.skip_spheres && std::holds_alternative<SphereT<T>>(object)) { return false; }
+
+        TRACE_STAT(OBJECT_TESTS);
+        return std::visit(occludes, object);
+    });
+}
+
+/// @brief slab test of all packet lanes against the box
+/// @return bitmask of the lanes entering the box before their current closest hit
+static inline auto intersect_bounds(const AABB & bounds, const RayPacket & packet, const f64x4 & max_distance) -> u32
+{
+    f64x4 t0_x = (f64x4::splat(bounds.min.x) - packet.start.x) * packet.inv_direction.x;
+    f64x4 t1_x = (f64x4::splat(bounds.max.x) - packet.start.x) * packet.inv_direction.x;
+    f64x4 t0_y = (f64x4::splat(bounds.min.y) - packet.start.y) * packet.inv_direction.y;
+    f64x4 t1_y = (f64x4::splat(bounds.max.y) - packet.start.y) * packet.inv_direction.y;
+    f64x4 t0_z = (f64x4::splat(bounds.min.z) - packet.start.z) * packet.inv_direction.z;
+    f64x4 t1_z = (f64x4::splat(bounds.max.z) - packet.start.z) * packet.inv_direction.z;
+
+    f64x4 t_enter = max(max(min(t0_x, t1_x), min(t0_y, t1_y)), max(min(t0_z, t1_z), f64x4::splat(0.0)));
+    // exit distances are scaled by their rounding error like in the scalar test
+    const f64x4 exit_scale = f64x4::splat(1.0 + 2.0 * rounding_gamma<f64>(3));
+    f64x4 t_exit = min(min(max(t0_x, t1_x) * exit_scale, max(t0_y, t1_y) * exit_scale), min(max(t0_z, t1_z) * exit_scale, max_distance));
+    return (t_enter <= t_exit).to_bitmask();
+}
+
+template <typename T>
+auto BVHT<T>::closest_hit(const PacketTraceInfo & info) const -> std::array<HitInfo, PACKET_SIZE>
+    requires std::is_same_v<T, f64>
+{
+    std::array<Intersect::HitInfo, PACKET_SIZE> hits = {};
+    if(nodes.empty() || info.packet.active_mask == 0) { return hits; }
+
+    const RayPacket & packet = info.packet;
+    const f64x4 active_lanes = f64x4::from_bitmask(packet.active_mask);
+    const f64x4 epsilon = f64x4::splat(EPSILON);
+    // distance and index of the closest primitive of each lane, index -1.0 marks no hit
+    f64x4 closest_distance = f64x4::splat(INFINITY);
+    f64x4 closest_primitive = f64x4::splat(-1.0);
+
+    // all lanes share the traversal order of the first active ray
+    const Ray & leading_ray = packet.rays[std::countr_zero(packet.active_mask)];
+    const bool direction_negative[3] = {
+        leading_ray.direction.x < 0.0,
+        leading_ray.direction.y < 0.0,
+        leading_ray.direction.z < 0.0
+    };
+
+    std::array<u32, BVH_TRAVERSAL_STACK_SIZE> stack;
+    u32 stack_size = 0;
+    u32 node_index = 0;
+
+    while(true)
+    {
+        const Node & node = nodes[node_index];
+        TRACE_STAT(PACKET_NODE_TESTS);
+        u32 lane_mask = intersect_bounds(node.bounds, packet, closest_distance) & packet.active_mask;
+
+        if(std::popcount(lane_mask) == 1)
+        {
+            // only a single lane is left in this subtree, packet traversal would only waste the other lanes
+            u32 lane = u32(std::countr_zero(lane_mask));
+            const Ray & ray = packet.rays[lane];
+            Intersect::HitInfo lane_hit = {};
+            f64 lane_distance = closest_distance.lane(lane);
+            if(lane_distance < INFINITY) { lane_hit.hit_distance = lane_distance; }
+
+            traverse_closest(node_index, {.ray = ray, .objects = info.objects, .skip_spheres = info.skip_spheres}, 1.0 / ray.direction, lane_hit);
+            if(lane_hit.object != nullptr)
+            {
+                f64x4 lane_select = f64x4::from_bitmask(1u << lane);
+                closest_distance = select(lane_select, f64x4::splat(lane_hit.hit_distance), closest_distance);
+                closest_primitive = select(lane_select, f64x4::splat(f64(lane_hit.object - info.objects.data())), closest_primitive);
+            }
+            lane_mask = 0;
+        }
+
+        if(lane_mask != 0 && node.count > 0)
+        {
+            for(u32 i = node.offset; i < node.offset + node.count; i++)
+            {
+                u32 primitive = primitive_indices[i];
+                const Object & object = info.objects[primitive];
+                if(info.skip_spheres && std::holds_alternative<Sphere>(object)) { continue; }
+
+                TRACE_STAT(PACKET_OBJECT_TESTS);
+                f64x4 hit_distance = std::visit(IntersectPacket{packet}, object);
+                f64x4 closer = (hit_distance >= epsilon) & (hit_distance < closest_distance) & active_lanes;
+                closest_distance = select(closer, hit_distance, closest_distance);
+                closest_primitive = select(closer, f64x4::splat(f64(primitive)), closest_primitive);
+            }
+        }
+        else if(lane_mask != 0)
+        {
+            assert(stack_size < BVH_TRAVERSAL_STACK_SIZE);
+            // visit the child closer to the ray origin first so the far one can be culled
+            if(direction_negative[node.axis])
+            {
+                stack[stack_size++] = node_index + 1;
+                node_index = node.offset;
+            } else
+            {
+                stack[stack_size++] = node.offset;
+                node_index = node_index + 1;
+            }
+            continue;
+        }
+
+        if(stack_size == 0) { break; }
+        node_index = stack[--stack_size];
+    }
+
+    // hit attributes are computed once per lane for the winning primitive only
+    for(u32 lane = 0; lane < PACKET_SIZE; lane++)
+    {
+        if(!((packet.active_mask >> lane) & 1u)) { continue; }
+        f64 primitive = closest_primitive.lane(lane);
+        if(primitive < 0.0) { continue; }
+
+        const Object & object = info.objects[u32(primitive)];
+        hits[lane] = std::visit(Intersect{packet.rays[lane]}, object);
+        hits[lane].object = &object;
+    }
+    return hits;
+}
+
+template struct BVHT<f32>;
+template struct BVHT<f64>;
\ No newline at end of file
@@ -0,0 +1,228 @@
+#pragma once
+
+#include <array>
+#include <cassert>
+#include <limits>
+#include <vector>
+
+#include "operations.hpp"
+#include "objects.hpp"
+#include "ray_packet.hpp"
+#include "trace_stats.hpp"
+#include "types.hpp"
+
+const u32 BVH_TRAVERSAL_STACK_SIZE = 64;
+// SAH splits can peel off a single primitive at every level, past this depth the build splits at the
+// median instead - that adds at most log2 of the u32 primitive count so the traversal stack never overflows
+const u32 BVH_MAX_SAH_DEPTH = BVH_TRAVERSAL_STACK_SIZE - 32;
+
+/// @brief bound on the relative rounding error of n chained floating point operations
+template <typename T>
+constexpr auto rounding_gamma(u32 n) -> T
+{
+    return T(n) * std::numeric_limits<T>::epsilon() * T(0.5) / (T(1.0) - T(n) * std::numeric_limits<T>::epsilon() * T(0.5));
+}
+
+/// @brief conservative slab test of the ray against the box, the bounds may be stored in a lower
+/// precision than the ray - they are converted exactly and the test runs in the precision of the ray
+/// The exit distances are scaled by the rounding error of their computation so rays grazing the
+/// boundary of a box never miss it (robust BVH traversal by Ize)
+/// @return distance at which the ray enters the box or -1.0 when the box is missed
+///         or is further than max_distance
+template <typename T, typename U>
+inline auto intersect_bounds(const AABBT<U> & bounds, const RayT<T> & ray, const tvec3<T> & inv_direction, T max_distance) -> T
+{
+    tvec3<T> t0 = (tvec3<T>(bounds.min) - ray.start) * inv_direction;
+    tvec3<T> t1 = (tvec3<T>(bounds.max) - ray.start) * inv_direction;
+    tvec3<T> t_near = glm::min(t0, t1);
+    tvec3<T> t_far = glm::max(t0, t1) * (T(1.0) + T(2.0) * rounding_gamma<T>(3));
+    T t_enter = glm::max(glm::max(t_near.x, t_near.y), glm::max(t_near.z, T(0.0)));
+    T t_exit = glm::min(glm::min(t_far.x, t_far.y), glm::min(t_far.z, max_distance));
+    return t_enter <= t_exit ? t_enter : T(-1.0);
+}
+
+/// @brief Bounding volume hierarchy over the scene objects built using the surface area heuristic
+/// Nodes are stored in depth first order - the left child of an interior node directly follows
+/// its parent, the index of the right child is stored in the node itself
+template <typename T>
+struct BVHT
+{
+    using HitInfo = typename IntersectT<T>::HitInfo;
+
+    struct Node
+    {
+        AABBT<T> bounds;
+        // interior node -> index of the right child, leaf -> index of the first primitive
+        u32 offset = 0;
+        // number of primitives in the leaf, 0 for interior nodes
+        u32 count = 0;
+        // axis along which the node was split, used to order the traversal
+        u32 axis = 0;
+    };
+
+    struct TraceInfo
+    {
+        const RayT<T> & ray;
+        const std::vector<ObjectT<T>> & objects;
+        // spheres act only as light sources and are ignored when the env map is in use
+        bool skip_spheres = false;
+    };
+
+    // ray packets are double precision only
+    struct PacketTraceInfo
+    {
+        const RayPacket & packet;
+        const std::vector<ObjectT<T>> & objects;
+        bool skip_spheres = false;
+    };
+
+    std::vector<Node> nodes;
+    // indices into the scene object array referenced by the leaves
+    std::vector<u32> primitive_indices;
+
+    void build(const std::vector<ObjectT<T>> & objects);
+    // builds the hierarchy over any primitives given by their bounds, used for the triangles of meshes
+    void build(const std::vector<AABBT<T>> & primitive_bounds);
+    [[nodiscard]] auto closest_hit(const TraceInfo & info) const -> HitInfo;
+    /// @brief closest hit for each active lane of the packet, lanes which stop sharing the
+    /// traversed nodes continue through the subtree as single rays
+    [[nodiscard]] auto closest_hit(const PacketTraceInfo & info) const -> std::array<HitInfo, PACKET_SIZE>
+        requires std::is_same_v<T, f64>;
+    /// @brief any hit query for shadow rays - true as soon as any object blocks the ray before
+    /// max_distance, the traversal stops there and no hit attributes are computed
+    [[nodiscard]] auto occluded(const TraceInfo & info, T max_distance) const -> bool;
+    [[nodiscard]] inline auto get_bounds() const -> AABBT<T> { return nodes.empty() ? AABBT<T>{} : nodes.front().bounds; }
+    /// @brief visits the leaves of the subtree rooted at root_index which the ray enters before
+    /// max_distance, the child closer to the ray origin first
+    /// The ray may be more precise than the hierarchy, the single precision hierarchies of meshes are
+    /// traversed with the double precision rays so the boxes are tested against the exact ray
+    /// @param intersect_slot called with every primitive_indices slot of the visited leaves, returns the
+    /// distance of a new closest hit which then culls the rest of the traversal or a negative value
+    template <typename U, typename IntersectSlot>
+    void traverse(u32 root_index, const RayT<U> & ray, const tvec3<U> & inv_direction, U max_distance, IntersectSlot && intersect_slot) const;
+    /// @brief visits the leaves of the subtree like traverse until a slot blocks the ray
+    /// @param test_slot called with every primitive_indices slot of the visited leaves, returns true when
+    /// the primitive is hit before max_distance which ends the traversal
+    /// @return true when any slot blocked the ray
+    template <typename U, typename TestSlot>
+    [[nodiscard]] auto traverse_any(u32 root_index, const RayT<U> & ray, const tvec3<U> & inv_direction, U max_distance, TestSlot && test_slot) const -> bool;
+
+    private:
+        struct BuildPrimitive
+        {
+            AABBT<T> bounds;
+            tvec3<T> centroid;
+            u32 index;
+        };
+
+        auto build_recursive(std::vector<BuildPrimitive> & primitives, u32 start, u32 end, u32 depth) -> u32;
+        // traverses the subtree rooted at root_index, closest_hit is only replaced by closer hits
+        void traverse_closest(u32 root_index, const TraceInfo & info, const tvec3<T> & inv_direction, HitInfo & closest_hit) const;
+};
+using BVH = BVHT<f64>;
+
+template <typename T>
+template <typename U, typename IntersectSlot>
+void BVHT<T>::traverse(u32 root_index, const RayT<U> & ray, const tvec3<U> & inv_direction, U max_distance, IntersectSlot && intersect_slot) const
+{
+    const bool direction_negative[3] = {
+        ray.direction.x < U(0.0),
+        ray.direction.y < U(0.0),
+        ray.direction.z < U(0.0)
+    };
+
+    std::array<u32, BVH_TRAVERSAL_STACK_SIZE> stack;
+    u32 stack_size = 0;
+    u32 node_index = root_index;
+
+    while(true)
+    {
+        const Node & node = nodes[node_index];
+        TRACE_STAT(BVH_NODE_TESTS);
+        if(intersect_bounds(node.bounds, ray, inv_direction, max_distance) >= U(0.0))
+        {
+            if(node.count > 0)
+            {
+                for(u32 slot = node.offset; slot < node.offset + node.count; slot++)
+                {
+                    U hit_distance = intersect_slot(slot);
+                    if(hit_distance >= U(0.0)) { max_distance = hit_distance; }
+                }
+                if(stack_size == 0) { break; }
+                node_index = stack[--stack_size];
+            }
+            else
+            {
+                assert(stack_size < BVH_TRAVERSAL_STACK_SIZE);
+                // visit the child closer to the ray origin first so the far one can be culled
+                if(direction_negative[node.axis])
+                {
+                    stack[stack_size++] = node_index + 1;
+                    node_index = node.offset;
+                } else
+                {
+                    stack[stack_size++] = node.offset;
+                    node_index = node_index + 1;
+                }
+            }
+        }
+        else
+        {
+            if(stack_size == 0) { break; }
+            node_index = stack[--stack_size];
+        }
+    }
+}
+
+template <typename T>
+template <typename U, typename TestSlot>
+auto BVHT<T>::traverse_any(u32 root_index, const RayT<U> & ray, const tvec3<U> & inv_direction, U max_distance, TestSlot && test_slot) const -> bool
+{
+    const bool direction_negative[3] = {
+        ray.direction.x < U(0.0),
+        ray.direction.y < U(0.0),
+        ray.direction.z < U(0.0)
+    };
+
+    std::array<u32, BVH_TRAVERSAL_STACK_SIZE> stack;
+    u32 stack_size = 0;
+    u32 node_index = root_index;
+
+    while(true)
+    {
+        const Node & node = nodes[node_index];
+        TRACE_STAT(BVH_NODE_TESTS);
+        if(intersect_bounds(node.bounds, ray, inv_direction, max_distance) >= U(0.0))
+        {
+            if(node.count > 0)
+            {
+                for(u32 slot = node.offset; slot < node.offset + node.count; slot++)
+                {
+                    if(test_slot(slot)) { return true; }
+                }
+                if(stack_size == 0) { break; }
+                node_index = stack[--stack_size];
+            }
+            else
+            {
+                assert(stack_size < BVH_TRAVERSAL_STACK_SIZE);
+                // the closer child is still more likely to hold a blocker
+                if(direction_negative[node.axis])
+                {
+                    stack[stack_size++] = node_index + 1;
+                    node_index = node.offset;
+                } else
+                {
+                    stack[stack_size++] = node.offset;
+                    node_index = node_index + 1;
+                }
+            }
+        }
+        else
+        {
+            if(stack_size == 0) { break; }
+            node_index = stack[--stack_size];
+        }
+    }
+    return false;
+}
@@ -2,7 +2,9 @@
 
 Camera::Camera(const CameraInfo & info) :
     origin{info.origin},
-    look_at{info.look_at}
+    look_at{info.look_at},
+    world_up{info.up},
+    fov{info.fov}
 {
     f64vec3 w = origin - look_at;
     f64 f = glm::length(w);
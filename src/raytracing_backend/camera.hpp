@@ -16,6 +16,9 @@ struct Camera
     f64vec3 look_at;
     f64vec3 right;
     f64vec3 up;
+    // creation parameters kept so the camera can be saved with the scene
+    f64vec3 world_up;
+    f64 fov;
 
     Camera(const CameraInfo & info);
     Ray get_ray(u32vec2 screen_coords, u32vec2 screen_dimensions) const;
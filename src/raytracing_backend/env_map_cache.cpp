@@ -0,0 +1,143 @@
+#include "env_map_cache.hpp"
+
+EnvMapCache::EnvMapCache(size_t memory_limit) :
+    use_counter{0},
+    stop{false}
+{
+    stats.memory_limit = memory_limit;
+    loader_thread = std::thread(&EnvMapCache::loader_loop, this);
+}
+
+EnvMapCache::~EnvMapCache()
+{
+    {
+        std::lock_guard lock(mutex);
+        stop = true;
+    }
+    loader_condition.notify_all();
+    loader_thread.join();
+}
+
+auto EnvMapCache::get(const std::string & path) -> std::shared_ptr<EnvironmentMap>
+{
+    std::unique_lock lock(mutex);
+    auto entry = entries.find(path);
+    if(entry != entries.end()) { stats.hits++; }
+    else
+    {
+        stats.misses++;
+        auto promise = std::make_unique<std::promise<std::shared_ptr<EnvironmentMap>>>();
+        MapFuture map = promise->get_future().share();
+        entry = entries.emplace(path, Entry{.map = map, .pending_load = std::move(promise)}).first;
+    }
+    entry->second.last_use = ++use_counter;
+    MapFuture map = entry->second.map;
+
+    // the map is not being loaded yet - load it here instead of waiting behind the prefetch queue
+    if(entry->second.pending_load)
+    {
+        auto promise = std::move(entry->second.pending_load);
+        lock.unlock();
+        load_entry(path, std::move(promise));
+    }
+    else { lock.unlock(); }
+    // rethrows the error of a failed load
+    return map.get();
+}
+
+void EnvMapCache::prefetch(const std::string & path)
+{
+    {
+        std::lock_guard lock(mutex);
+        if(entries.contains(path)) { return; }
+        auto promise = std::make_unique<std::promise<std::shared_ptr<EnvironmentMap>>>();
+        MapFuture map = promise->get_future().share();
+        entries.emplace(path, Entry{.map = map, .pending_load = std::move(promise), .last_use = ++use_counter});
+        prefetch_queue.push_back(path);
+    }
+    loader_condition.notify_one();
+}
+
+void EnvMapCache::set_memory_limit(size_t memory_limit)
+{
+    std::lock_guard lock(mutex);
+    stats.memory_limit = memory_limit;
+    evict("");
+}
+
+auto EnvMapCache::get_stats() -> Stats
+{
+    std::lock_guard lock(mutex);
+    return stats;
+}
+
+void EnvMapCache::loader_loop()
+{
+    std::unique_lock lock(mutex);
+    while(true)
+    {
+        loader_condition.wait(lock, [&]{ return stop || !prefetch_queue.empty(); });
+        if(stop) { return; }
+
+        std::string path = std::move(prefetch_queue.front());
+        prefetch_queue.pop_front();
+        // the entry may have been claimed by get() or evicted in the meantime
+        auto entry = entries.find(path);
+        if(entry == entries.end() || !entry->second.pending_load) { continue; }
+        auto promise = std::move(entry->second.pending_load);
+
+        lock.unlock();
+        load_entry(path, std::move(promise));
+        lock.lock();
+    }
+}
+
+void EnvMapCache::load_entry(const std::string & path, std::unique_ptr<std::promise<std::shared_ptr<EnvironmentMap>>> promise)
+{
+    auto map = std::make_shared<EnvironmentMap>();
+    try
+    {
+        map->load(path);
+    }
+    catch(...)
+    {
+        // failed loads are not cached so the next request tries again
+        {
+            std::lock_guard lock(mutex);
+            entries.erase(path);
+        }
+        promise->set_exception(std::current_exception());
+        return;
+    }
+
+    {
+        std::lock_guard lock(mutex);
+        auto entry = entries.find(path);
+        if(entry != entries.end())
+        {
+            entry->second.memory_size = map->get_memory_size();
+            stats.memory_used += entry->second.memory_size;
+            evict(path);
+        }
+    }
+    promise->set_value(std::move(map));
+}
+
+void EnvMapCache::evict(const std::string & keep_path)
+{
+    while(stats.memory_used > stats.memory_limit)
+    {
+        // least recently used map which finished loading, maps still loading are never evicted
+        auto victim = entries.end();
+        for(auto entry = entries.begin(); entry != entries.end(); entry++)
+        {
+            if(entry->second.memory_size == 0 || entry->first == keep_path) { continue; }
+            if(victim == entries.end() || entry->second.last_use < victim->second.last_use) { victim = entry; }
+        }
+        if(victim == entries.end()) { return; }
+
+        stats.memory_used -= victim->second.memory_size;
+        stats.evictions++;
+        entries.erase(victim);
+    }
+}
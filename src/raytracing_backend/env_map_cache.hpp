@@ -0,0 +1,75 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#include "scene.hpp"
+#include "types.hpp"
+
+/// @brief Memory bounded LRU cache of fully initialized environment maps
+/// Maps can be prefetched on a background loader thread, requesting a cached map
+/// only hands out a shared pointer so switching maps is a pointer swap. Evicted maps
+/// stay alive for as long as a scene still holds a pointer to them
+struct EnvMapCache
+{
+    struct Stats
+    {
+        // requests for maps which were already loaded or being loaded
+        u64 hits = 0;
+        u64 misses = 0;
+        u64 evictions = 0;
+        // memory of the loaded maps held by the cache
+        size_t memory_used = 0;
+        size_t memory_limit = 0;
+    };
+
+    static const size_t DEFAULT_MEMORY_LIMIT = size_t(1) << 30;
+
+    EnvMapCache(size_t memory_limit = DEFAULT_MEMORY_LIMIT);
+    ~EnvMapCache();
+
+    EnvMapCache(const EnvMapCache &) = delete;
+    EnvMapCache & operator=(const EnvMapCache &) = delete;
+
+    // returns the cached map, waits for a prefetch in flight or loads the map on the calling thread
+    auto get(const std::string & path) -> std::shared_ptr<EnvironmentMap>;
+    // schedules the map to be loaded on the background thread, does nothing if it is already cached
+    void prefetch(const std::string & path);
+    // evicts least recently used maps until the cache fits into the new limit
+    void set_memory_limit(size_t memory_limit);
+    [[nodiscard]] auto get_stats() -> Stats;
+
+    private:
+        using MapFuture = std::shared_future<std::shared_ptr<EnvironmentMap>>;
+
+        struct Entry
+        {
+            MapFuture map;
+            // present until some thread claims the load of the map
+            std::unique_ptr<std::promise<std::shared_ptr<EnvironmentMap>>> pending_load;
+            // zero until the map is loaded
+            size_t memory_size = 0;
+            u64 last_use = 0;
+        };
+
+        std::mutex mutex;
+        std::condition_variable loader_condition;
+        std::unordered_map<std::string, Entry> entries;
+        std::deque<std::string> prefetch_queue;
+        Stats stats;
+        u64 use_counter;
+        bool stop;
+        std::thread loader_thread;
+
+        void loader_loop();
+        // loads the map and publishes it through the promise claimed from the entry
+        void load_entry(const std::string & path, std::unique_ptr<std::promise<std::shared_ptr<EnvironmentMap>>> promise);
+        // expects the mutex to be held
+        void evict(const std::string & keep_path);
+};
@@ -0,0 +1,42 @@
+#include "frame_buffer.hpp"
+
+#include <thread>
+
+FrameBuffer::FrameBuffer(const u32vec2 dimensions) :
+    dimensions{dimensions},
+    staging(dimensions.x * dimensions.y * 3),
+    buffers{std::vector<f32>(dimensions.x * dimensions.y * 3), std::vector<f32>(dimensions.x * dimensions.y * 3)},
+    published_frames{0},
+    reading_buffer{NO_BUFFER}
+{
+}
+
+void FrameBuffer::publish()
+{
+    const u64 frame = published_frames.load() + 1;
+    const u32 back_buffer = u32(frame & 1);
+    // the display may still be reading the frame published two frames ago, wait until it is done
+    // with it - the display only ever holds a buffer for the duration of a single copy
+    while(reading_buffer.load() == back_buffer) { std::this_thread::yield(); }
+
+    std::vector<f32> & buffer = buffers.at(back_buffer);
+    for(size_t i = 0; i < buffer.size(); i++) { buffer[i] = staging[i].load(std::memory_order_relaxed); }
+    published_frames.store(frame);
+}
+
+auto FrameBuffer::read(const std::function<void(const std::vector<f32> &)> & draw) -> u64
+{
+    u64 frame;
+    // announce which buffer is read and make sure it was not replaced in the meantime, the
+    // sequentially consistent accesses guarantee that either the renderer sees the announcement
+    // or this thread sees the newer frame and retries
+    do
+    {
+        frame = published_frames.load();
+        reading_buffer.store(u32(frame & 1));
+    } while(frame != published_frames.load());
+
+    draw(buffers.at(frame & 1));
+    reading_buffer.store(NO_BUFFER);
+    return frame;
+}
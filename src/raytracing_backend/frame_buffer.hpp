@@ -0,0 +1,43 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <functional>
+#include <vector>
+
+#include "types.hpp"
+
+/// @brief Double buffered RGB image used to hand progressive results from the render
+/// threads to the display. Render threads store finished pixels into a staging plane
+/// and publish it as a whole frame, the display reads the last published frame
+/// without ever taking a lock or waiting on the renderer
+struct FrameBuffer
+{
+    FrameBuffer(const u32vec2 dimensions);
+
+    // render side - called once per pixel when a tile pass is finished, not per sample
+    inline void store_pixel(u32 index, const f64vec3 & color)
+    {
+        staging.at(index * 3).store(f32(color.r), std::memory_order_relaxed);
+        staging.at(index * 3 + 1).store(f32(color.g), std::memory_order_relaxed);
+        staging.at(index * 3 + 2).store(f32(color.b), std::memory_order_relaxed);
+    }
+    // render side - copies the staging plane into the back buffer and makes it the front one
+    void publish();
+
+    // display side - calls draw with the most recently published frame
+    // @return number of frames published so far, can be used to skip redrawing unchanged frames
+    auto read(const std::function<void(const std::vector<f32> &)> & draw) -> u64;
+    [[nodiscard]] inline auto get_dimensions() const -> u32vec2 { return dimensions; }
+
+    private:
+        static const u32 NO_BUFFER = ~0u;
+
+        u32vec2 dimensions;
+        std::vector<std::atomic<f32>> staging;
+        std::array<std::vector<f32>, 2> buffers;
+        // number of published frames, the front buffer index is the lowest bit
+        std::atomic<u64> published_frames;
+        // index of the buffer the display is currently reading or NO_BUFFER
+        std::atomic<u32> reading_buffer;
+};
@@ -5,44 +5,54 @@
 #include "types.hpp"
 #include "utils.hpp"
 
-struct Material
+template <typename T>
+struct MaterialT
 {
     struct MaterialEvalInfo
     {
-        const f64vec3 normal;
+        const tvec3<T> normal;
         // outgoing view direction
-        const f64vec3 view_direction;  
+        const tvec3<T> view_direction;  
         // incoming light direction
-        const f64vec3 light_direction; 
+        const tvec3<T> light_direction; 
     };
 
     struct MaterialCreateInfo
     {
-        f64vec3 Le;
-        f64vec3 diffuse_albedo;
-        f64vec3 specular_albedo;
-        f64 shininess;
+        tvec3<T> Le;
+        tvec3<T> diffuse_albedo;
+        tvec3<T> specular_albedo;
+        T shininess;
     };
-    f64vec3 Le;  // the emitted power
-    f64vec3 diffuse_albedo;
-    f64vec3 specular_albedo;
-    f64 shininess;
+    tvec3<T> Le;  // the emitted power
+    tvec3<T> diffuse_albedo;
+    tvec3<T> specular_albedo;
+    T shininess;
 
-    Material(const MaterialCreateInfo & info);
-    auto BRDF(const MaterialEvalInfo & info) const -> f64vec3;
-    auto sample_probability(const MaterialEvalInfo & info) const -> f64;
-    auto sample_direction(const f64vec3 & normal, const f64vec3 & view_direction) const -> std::optional<f64vec3>;
+    MaterialT(const MaterialCreateInfo & info);
+    // copy of the material in other precision
+    template <typename U>
+    explicit MaterialT(const MaterialT<U> & other) :
+        Le{other.Le},
+        diffuse_albedo{other.diffuse_albedo},
+        specular_albedo{other.specular_albedo},
+        shininess{T(other.shininess)}
+    {}
+    auto BRDF(const MaterialEvalInfo & info) const -> tvec3<T>;
+    auto sample_probability(const MaterialEvalInfo & info) const -> T;
+    auto sample_direction(const tvec3<T> & normal, const tvec3<T> & view_direction, Sampler & sampler) const -> std::optional<tvec3<T>>;
 
-    inline auto get_average_diffuse_albedo() const -> f64
+    inline auto get_average_diffuse_albedo() const -> T
     {
-        return (diffuse_albedo.r + diffuse_albedo.g + diffuse_albedo.b) / 3.0;
+        return (diffuse_albedo.r + diffuse_albedo.g + diffuse_albedo.b) / T(3.0);
     }
-    inline auto get_average_specular_albedo() const -> f64
+    inline auto get_average_specular_albedo() const -> T
     {
-        return (specular_albedo.r + specular_albedo.g + specular_albedo.b) / 3.0;
+        return (specular_albedo.r + specular_albedo.g + specular_albedo.b) / T(3.0);
     }
-    inline auto get_average_emmited_radiance() const -> f64
+    inline auto get_average_emmited_radiance() const -> T
     {
-        return (Le.r + Le.g + Le.b) / 3.0; 
+        return (Le.r + Le.g + Le.b) / T(3.0); 
     }
-};
\ No newline at end of file
+};
+using Material = MaterialT<f64>;
\ No newline at end of file
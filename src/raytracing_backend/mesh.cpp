@@ -0,0 +1,468 @@
+#include "mesh.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cctype>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string_view>
+
+// the files are parsed in chunks of this size, lines longer than a chunk grow the buffer
+const size_t MESH_READ_CHUNK_SIZE = 1 << 22;
+
+static auto mesh_error(const std::string & path, const std::string & message) -> std::runtime_error
+{
+    return std::runtime_error("[load_mesh()] " + path + ": " + message);
+}
+
+#pragma region chunked_reader
+/// @brief Reads the file in fixed size chunks and hands out lines and raw bytes straight from
+/// the chunk, the returned lines are only valid until the next call
+struct ChunkedReader
+{
+    ChunkedReader(const std::string & path) : file{path, std::ios::binary}, buffer(MESH_READ_CHUNK_SIZE) {}
+
+    [[nodiscard]] auto is_open() const -> bool { return file.is_open(); }
+    // @return false once the whole file was consumed
+    auto next_line(std::string_view & line) -> bool;
+    // @return false when the file ends before size bytes were read
+    auto read(void * destination, size_t size) -> bool;
+
+    private:
+        std::ifstream file;
+        std::vector<char> buffer;
+        // unconsumed bytes of the buffer
+        size_t begin = 0;
+        size_t end = 0;
+        bool end_of_file = false;
+
+        // moves the unconsumed bytes to the front of the buffer and appends the next chunk
+        // @return false when the file was already consumed
+        auto refill() -> bool;
+};
+
+auto ChunkedReader::refill() -> bool
+{
+    if(end_of_file) { return false; }
+    std::memmove(buffer.data(), buffer.data() + begin, end - begin);
+    end -= begin;
+    begin = 0;
+    if(end == buffer.size()) { buffer.resize(buffer.size() * 2); }
+
+    file.read(buffer.data() + end, buffer.size() - end);
+    end += size_t(file.gcount());
+    if(!file) { end_of_file = true; }
+    return true;
+}
+
+auto ChunkedReader::next_line(std::string_view & line) -> bool
+{
+    while(true)
+    {
+        const char * start = buffer.data() + begin;
+        const char * line_end = static_cast<const char *>(std::memchr(start, '\n', end - begin));
+        if(line_end != nullptr)
+        {
+            line = std::string_view(start, line_end - start);
+            begin += line.size() + 1;
+            break;
+        }
+        if(!refill())
+        {
+            if(begin == end) { return false; }
+            // last line without a line break
+            line = std::string_view(buffer.data() + begin, end - begin);
+            begin = end;
+            break;
+        }
+    }
+    if(!line.empty() && line.back() == '\r') { line.remove_suffix(1); }
+    return true;
+}
+
+auto ChunkedReader::read(void * destination, size_t size) -> bool
+{
+    while(end - begin < size)
+    {
+        if(!refill()) { return false; }
+    }
+    std::memcpy(destination, buffer.data() + begin, size);
+    begin += size;
+    return true;
+}
+#pragma endregion chunked_reader
+
+static inline void skip_spaces(std::string_view & text)
+{
+    size_t count = 0;
+    while(count < text.size() && (text[count] == ' ' || text[count] == '\t')) { count++; }
+    text.remove_prefix(count);
+}
+
+static inline auto next_token(std::string_view & text) -> std::string_view
+{
+    skip_spaces(text);
+    size_t token_end = std::min(text.find_first_of(" \t"), text.size());
+    std::string_view token = text.substr(0, token_end);
+    text.remove_prefix(token_end);
+    return token;
+}
+
+// @return false when the text does not start with a number, numbers are parsed without allocating
+template <typename Number>
+static inline auto parse_number(std::string_view & text, Number & value) -> bool
+{
+    skip_spaces(text);
+    auto [number_end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+    if(error != std::errc()) { return false; }
+    text.remove_prefix(number_end - text.data());
+    return true;
+}
+
+// removes the keyword when the line starts with it followed by a space
+static inline auto consume_keyword(std::string_view & line, std::string_view keyword) -> bool
+{
+    if(line.size() <= keyword.size() || !line.starts_with(keyword)) { return false; }
+    if(line[keyword.size()] != ' ' && line[keyword.size()] != '\t') { return false; }
+    line.remove_prefix(keyword.size() + 1);
+    return true;
+}
+
+static void add_polygon(MeshData & mesh, const std::vector<u32> & polygon)
+{
+    for(u32 i = 2; i < polygon.size(); i++) { mesh.triangles.push_back({polygon[0], polygon[i - 1], polygon[i]}); }
+}
+
+#pragma region obj
+static void load_obj(const std::string & path, ChunkedReader & reader, MeshData & mesh)
+{
+    std::string_view line;
+    // vertex indices of the face being parsed, reused for all faces
+    std::vector<u32> polygon;
+    for(u64 line_number = 1; reader.next_line(line); line_number++)
+    {
+        auto error = [&](const std::string & message) { return mesh_error(path, "line " + std::to_string(line_number) + ": " + message); };
+        skip_spaces(line);
+        if(consume_keyword(line, "v"))
+        {
+            f32vec3 position;
+            if(!parse_number(line, position.x) || !parse_number(line, position.y) || !parse_number(line, position.z))
+            {
+                throw error("Invalid vertex");
+            }
+            mesh.positions.push_back(position);
+        }
+        else if(consume_keyword(line, "f"))
+        {
+            polygon.clear();
+            while(true)
+            {
+                skip_spaces(line);
+                if(line.empty()) { break; }
+                i64 index;
+                if(!parse_number(line, index)) { throw error("Invalid face"); }
+                // texture coordinate and normal indices following the position index are not used
+                line.remove_prefix(std::min(line.find_first_of(" \t"), line.size()));
+                // negative indices are relative to the end of the vertices read so far
+                i64 resolved = index < 0 ? i64(mesh.positions.size()) + index : index - 1;
+                if(resolved < 0 || index == 0) { throw error("Invalid vertex index " + std::to_string(index)); }
+                polygon.push_back(u32(resolved));
+            }
+            if(polygon.size() < 3) { throw error("Face with less than three vertices"); }
+            add_polygon(mesh, polygon);
+        }
+    }
+}
+#pragma endregion obj
+
+#pragma region ply
+enum class PlyFormat
+{
+    ASCII,
+    BINARY_LITTLE_ENDIAN,
+    BINARY_BIG_ENDIAN
+};
+
+enum class PlyType
+{
+    INT8,
+    UINT8,
+    INT16,
+    UINT16,
+    INT32,
+    UINT32,
+    FLOAT32,
+    FLOAT64
+};
+
+struct PlyProperty
+{
+    std::string name;
+    PlyType type;
+    // lists store the number of values in count_type followed by the values in type
+    bool is_list = false;
+    PlyType count_type = PlyType::UINT8;
+};
+
+struct PlyElement
+{
+    std::string name;
+    u64 count = 0;
+    std::vector<PlyProperty> properties = {};
+};
+
+static auto parse_ply_type(const std::string & path, std::string_view name) -> PlyType
+{
+    if(name == "char"   || name == "int8")    { return PlyType::INT8; }
+    if(name == "uchar"  || name == "uint8")   { return PlyType::UINT8; }
+    if(name == "short"  || name == "int16")   { return PlyType::INT16; }
+    if(name == "ushort" || name == "uint16")  { return PlyType::UINT16; }
+    if(name == "int"    || name == "int32")   { return PlyType::INT32; }
+    if(name == "uint"   || name == "uint32")  { return PlyType::UINT32; }
+    if(name == "float"  || name == "float32") { return PlyType::FLOAT32; }
+    if(name == "double" || name == "float64") { return PlyType::FLOAT64; }
+    throw mesh_error(path, "Unknown property type " + std::string(name));
+}
+
+static auto get_ply_type_size(PlyType type) -> u32
+{
+    switch(type)
+    {
+        case PlyType::INT8:
+        case PlyType::UINT8:   { return 1; }
+        case PlyType::INT16:
+        case PlyType::UINT16:  { return 2; }
+        case PlyType::INT32:
+        case PlyType::UINT32:
+        case PlyType::FLOAT32: { return 4; }
+        case PlyType::FLOAT64: { return 8; }
+    }
+    return 0;
+}
+
+/// @brief Reads the values of the body one by one - ascii values are taken from the lines of
+/// the reader, binary values are copied out of the chunk and byte swapped when needed
+struct PlyValueReader
+{
+    const std::string & path;
+    ChunkedReader & reader;
+    PlyFormat format;
+    // ascii values of the current line which were not read yet
+    std::string_view line = {};
+
+    auto read(PlyType type) -> f64
+    {
+        if(format == PlyFormat::ASCII)
+        {
+            skip_spaces(line);
+            while(line.empty())
+            {
+                if(!reader.next_line(line)) { throw mesh_error(path, "Unexpected end of file"); }
+                skip_spaces(line);
+            }
+            f64 value;
+            if(!parse_number(line, value)) { throw mesh_error(path, "Invalid value"); }
+            return value;
+        }
+
+        std::array<u8, 8> bytes;
+        const u32 size = get_ply_type_size(type);
+        if(!reader.read(bytes.data(), size)) { throw mesh_error(path, "Unexpected end of file"); }
+        if((format == PlyFormat::BINARY_BIG_ENDIAN) != (std::endian::native == std::endian::big))
+        {
+            std::reverse(bytes.begin(), bytes.begin() + size);
+        }
+        auto as = [&]<typename Value>(Value value) -> f64
+        {
+            std::memcpy(&value, bytes.data(), sizeof(Value));
+            return f64(value);
+        };
+        switch(type)
+        {
+            case PlyType::INT8:    { return as(i8{}); }
+            case PlyType::UINT8:   { return as(u8{}); }
+            case PlyType::INT16:   { return as(i16{}); }
+            case PlyType::UINT16:  { return as(u16{}); }
+            case PlyType::INT32:   { return as(i32{}); }
+            case PlyType::UINT32:  { return as(u32{}); }
+            case PlyType::FLOAT32: { return as(f32{}); }
+            case PlyType::FLOAT64: { return as(f64{}); }
+        }
+        return 0.0;
+    }
+};
+
+static auto find_ply_property(const PlyElement & element, std::initializer_list<std::string_view> names) -> i32
+{
+    for(u32 i = 0; i < element.properties.size(); i++)
+    {
+        for(std::string_view name : names)
+        {
+            if(element.properties[i].name == name) { return i32(i); }
+        }
+    }
+    return -1;
+}
+
+static void load_ply(const std::string & path, ChunkedReader & reader, MeshData & mesh)
+{
+    std::string_view line;
+    if(!reader.next_line(line) || line != "ply") { throw mesh_error(path, "Invalid ply header"); }
+
+    PlyFormat format = PlyFormat::ASCII;
+    std::vector<PlyElement> elements;
+    while(true)
+    {
+        if(!reader.next_line(line)) { throw mesh_error(path, "Unexpected end of header"); }
+        std::string_view keyword = next_token(line);
+        if(keyword == "end_header") { break; }
+        if(keyword == "format")
+        {
+            std::string_view name = next_token(line);
+            if(name == "ascii")                     { format = PlyFormat::ASCII; }
+            else if(name == "binary_little_endian") { format = PlyFormat::BINARY_LITTLE_ENDIAN; }
+            else if(name == "binary_big_endian")    { format = PlyFormat::BINARY_BIG_ENDIAN; }
+            else { throw mesh_error(path, "Unknown format " + std::string(name)); }
+        }
+        else if(keyword == "element")
+        {
+            PlyElement element = {.name = std::string(next_token(line)), .count = 0};
+            if(!parse_number(line, element.count)) { throw mesh_error(path, "Invalid element count"); }
+            elements.push_back(element);
+        }
+        else if(keyword == "property")
+        {
+            if(elements.empty()) { throw mesh_error(path, "Property outside of an element"); }
+            PlyProperty property = {};
+            std::string_view type = next_token(line);
+            if(type == "list")
+            {
+                property.is_list = true;
+                property.count_type = parse_ply_type(path, next_token(line));
+                type = next_token(line);
+            }
+            property.type = parse_ply_type(path, type);
+            property.name = std::string(next_token(line));
+            elements.back().properties.push_back(property);
+        }
+        // comment and obj_info lines are ignored
+    }
+
+    PlyValueReader values = {.path = path, .reader = reader, .format = format};
+    // vertex indices of the face being parsed, reused for all faces
+    std::vector<u32> polygon;
+    for(const PlyElement & element : elements)
+    {
+        i32 x = -1, y = -1, z = -1, indices = -1;
+        if(element.name == "vertex")
+        {
+            x = find_ply_property(element, {"x"});
+            y = find_ply_property(element, {"y"});
+            z = find_ply_property(element, {"z"});
+            if(x < 0 || y < 0 || z < 0) { throw mesh_error(path, "Vertices without x, y and z"); }
+            mesh.positions.reserve(mesh.positions.size() + element.count);
+        }
+        else if(element.name == "face")
+        {
+            indices = find_ply_property(element, {"vertex_indices", "vertex_index"});
+            if(indices < 0 || !element.properties[indices].is_list) { throw mesh_error(path, "Faces without vertex indices"); }
+            mesh.triangles.reserve(mesh.triangles.size() + element.count);
+        }
+
+        for(u64 item = 0; item < element.count; item++)
+        {
+            f32vec3 position = {0.0f, 0.0f, 0.0f};
+            for(i32 i = 0; i < i32(element.properties.size()); i++)
+            {
+                const PlyProperty & property = element.properties[i];
+                if(!property.is_list)
+                {
+                    f64 value = values.read(property.type);
+                    if(i == x)      { position.x = f32(value); }
+                    else if(i == y) { position.y = f32(value); }
+                    else if(i == z) { position.z = f32(value); }
+                    continue;
+                }
+                u64 count = u64(values.read(property.count_type));
+                if(i != indices)
+                {
+                    for(u64 value = 0; value < count; value++) { values.read(property.type); }
+                    continue;
+                }
+                if(count < 3) { throw mesh_error(path, "Face with less than three vertices"); }
+                polygon.clear();
+                for(u64 value = 0; value < count; value++)
+                {
+                    f64 index = values.read(property.type);
+                    if(index < 0.0) { throw mesh_error(path, "Negative vertex index"); }
+                    polygon.push_back(u32(index));
+                }
+                add_polygon(mesh, polygon);
+            }
+            if(x >= 0) { mesh.positions.push_back(position); }
+        }
+    }
+}
+#pragma endregion ply
+
+void MeshData::build()
+{
+    std::vector<AABBT<f32>> triangle_bounds;
+    triangle_bounds.reserve(triangles.size());
+    for(const u32vec3 & triangle : triangles)
+    {
+        AABBT<f32> bounds = {};
+        bounds.grow(positions[triangle.x]);
+        bounds.grow(positions[triangle.y]);
+        bounds.grow(positions[triangle.z]);
+        triangle_bounds.push_back(bounds);
+    }
+    bvh.build(triangle_bounds);
+
+    std::vector<u32vec3> ordered_triangles;
+    ordered_triangles.reserve(triangles.size());
+    for(u32 index : bvh.primitive_indices) { ordered_triangles.push_back(triangles[index]); }
+    triangles = std::move(ordered_triangles);
+    bvh.primitive_indices = {};
+    bvh.nodes.shrink_to_fit();
+}
+
+auto MeshData::get_memory_size() const -> size_t
+{
+    return positions.size() * sizeof(positions[0]) + triangles.size() * sizeof(triangles[0]) + bvh.nodes.size() * sizeof(bvh.nodes[0]);
+}
+
+auto load_mesh(const std::string & path) -> std::shared_ptr<const MeshData>
+{
+    const auto start = std::chrono::steady_clock::now();
+    ChunkedReader reader = ChunkedReader(path);
+    if(!reader.is_open()) { throw mesh_error(path, "Failed to open file"); }
+
+    auto mesh = std::make_shared<MeshData>();
+    mesh->source_path = path;
+    std::string extension = std::filesystem::path(path).extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return char(std::tolower(c)); });
+    if(extension == ".obj")      { load_obj(path, reader, *mesh); }
+    else if(extension == ".ply") { load_ply(path, reader, *mesh); }
+    else { throw mesh_error(path, "Unknown mesh format " + extension); }
+
+    if(mesh->triangles.empty()) { throw mesh_error(path, "Mesh has no triangles"); }
+    const u32 vertex_count = u32(mesh->positions.size());
+    for(const u32vec3 & triangle : mesh->triangles)
+    {
+        if(glm::max(triangle.x, glm::max(triangle.y, triangle.z)) >= vertex_count) { throw mesh_error(path, "Face references a missing vertex"); }
+    }
+    mesh->positions.shrink_to_fit();
+    mesh->triangles.shrink_to_fit();
+    mesh->build();
+
+    std::chrono::duration<f64> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "Mesh " << path << " loaded with " << mesh->triangles.size() << " triangles in " << elapsed.count()
+              << " s, " << (mesh->get_memory_size() >> 20) << " MB" << std::endl;
+    return mesh;
+}
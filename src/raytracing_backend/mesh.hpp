@@ -0,0 +1,31 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "bvh.hpp"
+#include "types.hpp"
+
+/// @brief Shared vertex and index buffers of a triangle mesh with its own bounding volume hierarchy
+/// Everything is stored in single precision - with the hierarchy a triangle costs less than 60 bytes
+struct MeshData
+{
+    // file the mesh was loaded from, stored in the scene files instead of the triangles
+    std::string source_path;
+    std::vector<f32vec3> positions;
+    // vertex indices of the triangles ordered like the leaves of the hierarchy so the leaves
+    // reference the triangles directly, bvh.primitive_indices is not kept
+    std::vector<u32vec3> triangles;
+    BVHT<f32> bvh;
+
+    // builds the hierarchy over the triangles and reorders them to the order of its leaves
+    void build();
+    // bytes held by the buffers and the hierarchy
+    [[nodiscard]] auto get_memory_size() const -> size_t;
+};
+
+/// @brief Loads a Wavefront .obj or a Stanford .ply (ascii or binary) mesh and builds its hierarchy
+/// The file is parsed while it is read in fixed size chunks, only positions and faces are used,
+/// polygons are split into triangle fans
+auto load_mesh(const std::string & path) -> std::shared_ptr<const MeshData>;
@@ -2,31 +2,35 @@
 
 #include <stdexcept>
 #include <utility>
+#include <memory>
 
 #include "types.hpp"
 #include "material.hpp"
 #include "utils.hpp"
 
+// vertex and index buffers of a triangle mesh together with its own acceleration structure, see mesh.hpp
+struct MeshData;
 
-struct Rectangle
+template <typename T>
+struct RectangleT
 {
     struct RectangleGeometryInfo
     { 
-        const Material* material = nullptr;
-        const f64vec3 & origin = {0.0, 0.0, 0.0};
-        const f64vec3 & normal = {0.0, 1.0, 0.0};
-        const f64vec2 & dimensions = {1.0, 1.0};
+        const MaterialT<T>* material = nullptr;
+        const tvec3<T> & origin = {0.0, 0.0, 0.0};
+        const tvec3<T> & normal = {0.0, 1.0, 0.0};
+        const tvec2<T> & dimensions = {1.0, 1.0};
     };
 
-    const Material* material;
+    const MaterialT<T>* material;
 
-    f64vec3 origin;
-    f64vec3 normal;
-    f64vec3 right;
-    f64vec3 forward;
-    f64vec2 dimensions;
+    tvec3<T> origin;
+    tvec3<T> normal;
+    tvec3<T> right;
+    tvec3<T> forward;
+    tvec2<T> dimensions;
 
-    Rectangle(const RectangleGeometryInfo & info) :
+    RectangleT(const RectangleGeometryInfo & info) :
         material{info.material},
         origin{info.origin},
         normal{glm::normalize(info.normal)},
@@ -35,25 +39,69 @@ struct Rectangle
         right = glm::normalize(glm::cross({0.0, 0.0, 1.0}, normal)); 
         forward = glm::normalize(glm::cross(normal, right));
     }
+    // copy of the rectangle in other precision using the given material
+    template <typename U>
+    RectangleT(const RectangleT<U> & other, const MaterialT<T>* material) :
+        material{material},
+        origin{other.origin},
+        normal{other.normal},
+        right{other.right},
+        forward{other.forward},
+        dimensions{other.dimensions}
+    {}
 };
 
-struct Sphere
+template <typename T>
+struct SphereT
 {
     struct SphereGeometryInfo
     {
-        const Material* material = nullptr;
-        const f64vec3 & origin = {0.0, 0.0, 0.0};
-        const f64 radius = 1.0;
+        const MaterialT<T>* material = nullptr;
+        const tvec3<T> & origin = {0.0, 0.0, 0.0};
+        const T radius = 1.0;
     };
 
-    const Material* material;
+    const MaterialT<T>* material;
 
-    f64vec3 origin;
-    f64 radius;
+    tvec3<T> origin;
+    T radius;
 
-    Sphere(const SphereGeometryInfo & info) :
+    SphereT(const SphereGeometryInfo & info) :
         material{info.material},
         origin{info.origin},
         radius{info.radius}
     {}
-};
\ No newline at end of file
+    // copy of the sphere in other precision using the given material
+    template <typename U>
+    SphereT(const SphereT<U> & other, const MaterialT<T>* material) :
+        material{material},
+        origin{other.origin},
+        radius{T(other.radius)}
+    {}
+};
+
+template <typename T>
+struct MeshT
+{
+    struct MeshGeometryInfo
+    {
+        const MaterialT<T>* material = nullptr;
+        std::shared_ptr<const MeshData> data = nullptr;
+    };
+
+    const MaterialT<T>* material;
+    // the buffers are shared by all copies of the mesh and by all scene objects using the same file,
+    // they are always stored in single precision
+    std::shared_ptr<const MeshData> data;
+
+    MeshT(const MeshGeometryInfo & info) :
+        material{info.material},
+        data{info.data}
+    {}
+    // copy of the mesh in other precision sharing the buffers
+    template <typename U>
+    MeshT(const MeshT<U> & other, const MaterialT<T>* material) :
+        material{material},
+        data{other.data}
+    {}
+};
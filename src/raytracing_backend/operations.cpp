@@ -1,4 +1,7 @@
 #include "operations.hpp"
+#include "mesh.hpp"
+#include "trace_stats.hpp"
+
 #include <cmath>
 
 // =============================================================================================
@@ -6,67 +9,235 @@
 // =============================================================================================
 #pragma region intersections
 
-auto Intersect::operator()(const Sphere & sphere) const -> HitInfo
+// distance of the closest intersection in front of the ray start, -1.0 when the sphere is missed
+template <typename T>
+static inline auto get_sphere_hit_distance(const RayT<T> & ray, const SphereT<T> & sphere) -> T
 {
-    f64vec3 ray_to_sphere = ray.start - sphere.origin;
-    f64 a = dot(ray.direction, ray.direction);
-    f64 b = dot(ray_to_sphere, ray.direction) * 2.0;
-    f64 c = dot(ray_to_sphere, ray_to_sphere) - sphere.radius * sphere.radius;
-    f64 discriminant = b * b - 4.0 * a * c;
+    tvec3<T> ray_to_sphere = ray.start - sphere.origin;
+    T a = dot(ray.direction, ray.direction);
+    T b = dot(ray_to_sphere, ray.direction) * T(2.0);
+    T c = dot(ray_to_sphere, ray_to_sphere) - sphere.radius * sphere.radius;
+    T discriminant = b * b - T(4.0) * a * c;
 
     // There is no intersection with the sphere
-    if (discriminant < 0.0) { return HitInfo{.hit_distance = -1.0}; }
-    f64 t1 = (-b + sqrt(discriminant)) / 2.0 / a;
-    f64 t2 = (-b - sqrt(discriminant)) / 2.0 / a;
-    f64 hit_distance = 0.0;
+    if (discriminant < T(0.0)) { return T(-1.0); }
+    T t1 = (-b + std::sqrt(discriminant)) / T(2.0) / a;
+    T t2 = (-b - std::sqrt(discriminant)) / T(2.0) / a;
     // Both intersections are on the opposite side than the one we shot our ray 
-    if (t1 <= 0.0 && t2 <= 0.0)      { return HitInfo{.hit_distance = -1.0};}
-    if (t1 <= 0.0 && t2 > 0.0)       { hit_distance = t2; }
-    else if (t1 > 0.0 && t2 <= 0.0)  { hit_distance = t1; }
-    else if (t1 < t2)                { hit_distance = t1; }
-    else                             { hit_distance = t2; }
-
-    f64vec3 world_hit_position = ray.start + ray.direction * hit_distance;
-    auto res = world_hit_position - sphere.origin;
-    auto foo = glm::length(res);
-    return HitInfo{
-        .hit_distance = hit_distance,
-        .hit_position = world_hit_position,
-        .normal = (world_hit_position - sphere.origin) / sphere.radius,
-        .material = sphere.material
-    };
+    if (t1 <= T(0.0) && t2 <= T(0.0))      { return T(-1.0); }
+    if (t1 <= T(0.0) && t2 > T(0.0))       { return t2; }
+    else if (t1 > T(0.0) && t2 <= T(0.0))  { return t1; }
+    else if (t1 < t2)                      { return t1; }
+    else                                   { return t2; }
 }
 
-auto Intersect::operator()(const Rectangle & rectangle) const -> HitInfo
+// distance of the intersection with the rectangle, -1.0 when the rectangle is missed
+template <typename T>
+static inline auto get_rectangle_hit_distance(const RayT<T> & ray, const RectangleT<T> & rectangle) -> T
 {
-    f64 denominator = glm::dot(rectangle.normal, ray.direction);
+    T denominator = glm::dot(rectangle.normal, ray.direction);
     // if the ray is perpendicular to the normal it must not hit the plane
-    if(glm::abs(denominator) < EPSILON) { return HitInfo{.hit_distance = -1.0}; }
+    if(glm::abs(denominator) < EPSILON_V<T>) { return T(-1.0); }
 
     // Intersection point must lie on the vector ray.start + hit_distance * ray.direction
     // this gives us the following formula for calculating the intersection distance
     // https://stackoverflow.com/questions/8812073/ray-and-square-rectangle-intersection-in-3d
-    f64 hit_distance = glm::dot(rectangle.normal, rectangle.origin - ray.start) / denominator;
-    if(hit_distance < 0.0) { return HitInfo{.hit_distance = -1.0}; }
+    T hit_distance = glm::dot(rectangle.normal, rectangle.origin - ray.start) / denominator;
+    if(hit_distance < T(0.0)) { return T(-1.0); }
 
 
-    f64vec3 world_hit_position = ray.start + (hit_distance * ray.direction);
+    tvec3<T> world_hit_position = ray.start + (hit_distance * ray.direction);
     // project the hits onto the plane the rectangle lies in 
-    f64 x_proj = glm::dot(world_hit_position - rectangle.origin, rectangle.right);
-    f64 y_proj = glm::dot(world_hit_position - rectangle.origin, rectangle.forward); 
+    T x_proj = glm::dot(world_hit_position - rectangle.origin, rectangle.right);
+    T y_proj = glm::dot(world_hit_position - rectangle.origin, rectangle.forward); 
     // compare if the projected point is inside of the rectangle
     if(glm::abs(x_proj) > rectangle.dimensions.x || glm::abs(y_proj) > rectangle.dimensions.y)
     {
-        return HitInfo{.hit_distance = -1.0};
+        return T(-1.0);
     }
-    return HitInfo {
+    return hit_distance;
+}
+
+template <typename T>
+auto IntersectT<T>::operator()(const SphereT<T> & sphere) const -> HitInfo
+{
+    T hit_distance = get_sphere_hit_distance(ray, sphere);
+    if(hit_distance < T(0.0)) { return HitInfo{.hit_distance = -1.0}; }
+
+    tvec3<T> world_hit_position = ray.start + ray.direction * hit_distance;
+    return HitInfo{
         .hit_distance = hit_distance,
         .hit_position = world_hit_position,
+        .normal = (world_hit_position - sphere.origin) / sphere.radius,
+        .material = sphere.material
+    };
+}
+
+template <typename T>
+auto IntersectT<T>::operator()(const RectangleT<T> & rectangle) const -> HitInfo
+{
+    T hit_distance = get_rectangle_hit_distance(ray, rectangle);
+    if(hit_distance < T(0.0)) { return HitInfo{.hit_distance = -1.0}; }
+
+    return HitInfo {
+        .hit_distance = hit_distance,
+        .hit_position = ray.start + (hit_distance * ray.direction),
         .normal = rectangle.normal,
         .material = rectangle.material
     };
 }
 
+// edge functions of the ray against the triangle edges in the sheared space of the ray
+template <typename T>
+struct EdgeFunctions
+{
+    T u;
+    T v;
+    T w;
+};
+
+template <typename T, typename U>
+static inline auto get_edge_functions(const tvec2<U> & a, const tvec2<U> & b, const tvec2<U> & c) -> EdgeFunctions<T>
+{
+    return {
+        .u = T(c.x * b.y - c.y * b.x),
+        .v = T(a.x * c.y - a.y * c.x),
+        .w = T(b.x * a.y - b.y * a.x)
+    };
+}
+
+// Watertight Ray/Triangle Intersection (Woop, Benthin, Wald 2013) - the vertices are translated to
+// the ray origin and sheared so the ray points along +z, the hit is then decided by 2D edge functions
+// which are evaluated the same way for both triangles sharing an edge so no ray slips between them
+template <typename T>
+struct WatertightRay
+{
+    const RayT<T> & ray;
+    u32 kx;
+    u32 ky;
+    u32 kz;
+    T shear_x;
+    T shear_y;
+    T shear_z;
+
+    WatertightRay(const RayT<T> & ray) : ray{ray}
+    {
+        const tvec3<T> abs_direction = glm::abs(ray.direction);
+        kz = abs_direction.x > abs_direction.y ? (abs_direction.x > abs_direction.z ? 0 : 2) : (abs_direction.y > abs_direction.z ? 1 : 2);
+        kx = (kz + 1) % 3;
+        ky = (kx + 1) % 3;
+        // keeps the winding of the triangles
+        if(ray.direction[kz] < T(0.0)) { std::swap(kx, ky); }
+        shear_x = ray.direction[kx] / ray.direction[kz];
+        shear_y = ray.direction[ky] / ray.direction[kz];
+        shear_z = T(1.0) / ray.direction[kz];
+    }
+
+    // distance along the ray to the triangle of the mesh, -1.0 when it is missed
+    inline auto get_hit_distance(const MeshData & data, const u32vec3 & triangle) const -> T
+    {
+        TRACE_STAT(TRIANGLE_TESTS);
+        const tvec3<T> a = tvec3<T>(data.positions[triangle.x]) - ray.start;
+        const tvec3<T> b = tvec3<T>(data.positions[triangle.y]) - ray.start;
+        const tvec3<T> c = tvec3<T>(data.positions[triangle.z]) - ray.start;
+        const tvec2<T> a_sheared = {a[kx] - shear_x * a[kz], a[ky] - shear_y * a[kz]};
+        const tvec2<T> b_sheared = {b[kx] - shear_x * b[kz], b[ky] - shear_y * b[kz]};
+        const tvec2<T> c_sheared = {c[kx] - shear_x * c[kz], c[ky] - shear_y * c[kz]};
+
+        EdgeFunctions<T> edges = get_edge_functions<T>(a_sheared, b_sheared, c_sheared);
+        // single precision can not decide rays exactly through an edge, those are evaluated again in double
+        if constexpr(std::is_same_v<T, f32>)
+        {
+            if(edges.u == T(0.0) || edges.v == T(0.0) || edges.w == T(0.0))
+            {
+                edges = get_edge_functions<T>(f64vec2(a_sheared), f64vec2(b_sheared), f64vec2(c_sheared));
+            }
+        }
+        if((edges.u < T(0.0) || edges.v < T(0.0) || edges.w < T(0.0)) && (edges.u > T(0.0) || edges.v > T(0.0) || edges.w > T(0.0)))
+        {
+            return T(-1.0);
+        }
+        T determinant = edges.u + edges.v + edges.w;
+        if(determinant == T(0.0)) { return T(-1.0); }
+
+        T scaled_distance = shear_z * (edges.u * a[kz] + edges.v * b[kz] + edges.w * c[kz]);
+        return scaled_distance / determinant;
+    }
+};
+
+template <typename T>
+auto IntersectT<T>::operator()(const MeshT<T> & mesh) const -> HitInfo
+{
+    const MeshData & data = *mesh.data;
+    const WatertightRay<T> watertight_ray = WatertightRay<T>(ray);
+
+    // the hierarchy of the mesh is single precision, its boxes are tested against the unrounded ray
+    const tvec3<T> inv_direction = T(1.0) / ray.direction;
+    T closest_distance = T(INFINITY);
+    u32 closest_triangle = 0;
+
+    data.bvh.traverse(0, ray, inv_direction, T(INFINITY), [&](u32 slot) -> T
+    {
+        T hit_distance = watertight_ray.get_hit_distance(data, data.triangles[slot]);
+        // hits closer than EPSILON are the surface the ray starts on
+        if(!(hit_distance >= EPSILON_V<T> && hit_distance < closest_distance)) { return T(-1.0); }
+        closest_distance = hit_distance;
+        closest_triangle = slot;
+        return hit_distance;
+    });
+
+    if(closest_distance == T(INFINITY)) { return HitInfo{.hit_distance = -1.0}; }
+
+    const u32vec3 & triangle = data.triangles[closest_triangle];
+    const tvec3<T> v0 = tvec3<T>(data.positions[triangle.x]);
+    const tvec3<T> v1 = tvec3<T>(data.positions[triangle.y]);
+    const tvec3<T> v2 = tvec3<T>(data.positions[triangle.z]);
+    tvec3<T> normal = glm::normalize(glm::cross(v1 - v0, v2 - v0));
+    // meshes are two sided, the normal always faces the incoming ray
+    if(glm::dot(normal, ray.direction) > T(0.0)) { normal = -normal; }
+    return HitInfo{
+        .hit_distance = closest_distance,
+        .hit_position = ray.start + ray.direction * closest_distance,
+        .normal = normal,
+        .material = mesh.material
+    };
+}
+
+template struct IntersectT<f32>;
+template struct IntersectT<f64>;
+
+template <typename T>
+auto OccludesT<T>::operator()(const SphereT<T> & sphere) const -> bool
+{
+    T hit_distance = get_sphere_hit_distance(ray, sphere);
+    return hit_distance >= EPSILON_V<T> && hit_distance < max_distance;
+}
+
+template <typename T>
+auto OccludesT<T>::operator()(const RectangleT<T> & rectangle) const -> bool
+{
+    T hit_distance = get_rectangle_hit_distance(ray, rectangle);
+    return hit_distance >= EPSILON_V<T> && hit_distance < max_distance;
+}
+
+template <typename T>
+auto OccludesT<T>::operator()(const MeshT<T> & mesh) const -> bool
+{
+    const MeshData & data = *mesh.data;
+    const WatertightRay<T> watertight_ray = WatertightRay<T>(ray);
+
+    const tvec3<T> inv_direction = T(1.0) / ray.direction;
+    // any triangle in range ends the search, the closest one is never needed
+    return data.bvh.traverse_any(0, ray, inv_direction, max_distance, [&](u32 slot) -> bool
+    {
+        T hit_distance = watertight_ray.get_hit_distance(data, data.triangles[slot]);
+        return hit_distance >= EPSILON_V<T> && hit_distance < max_distance;
+    });
+}
+
+template struct OccludesT<f32>;
+template struct OccludesT<f64>;
+
 #pragma endregion intersections
 
 // =============================================================================================
@@ -74,51 +245,141 @@ auto Intersect::operator()(const Rectangle & rectangle) const -> HitInfo
 // =============================================================================================
 #pragma region sample_point
 
-auto VisiblePoint::operator()(const Sphere & sphere) const -> PointInfo
+template <typename T>
+auto VisiblePointT<T>::operator()(const SphereT<T> & sphere) const -> PointInfo
 {
-    f64vec3 normal = {0.0, 0.0, 0.0};
+    tvec3<T> normal = {0.0, 0.0, 0.0};
     do
     {
-        normal = {get_random_double() * 2.0 - 1.0, get_random_double() * 2.0 - 1.0, get_random_double() * 2.0 - 1.0};
-        if(glm::dot(view_point - sphere.origin, normal) < 0.0) { normal = -normal; }
-    } while ((dot(normal, normal) > 1.0) || (glm::dot(view_point - sphere.origin, normal) < 0.0));
+        normal = tvec3<T>(sampler.get_random_double_vec() * 2.0 - 1.0);
+        if(glm::dot(view_point - sphere.origin, normal) < T(0.0)) { normal = -normal; }
+    } while ((dot(normal, normal) > T(1.0)) || (glm::dot(view_point - sphere.origin, normal) < T(0.0)));
 
     normal = glm::normalize(normal);
     return {sphere.origin + normal * sphere.radius, normal};
 }
 
-auto VisiblePoint::operator()(const Rectangle & rectangle) const -> PointInfo
+template <typename T>
+auto VisiblePointT<T>::operator()(const RectangleT<T> &) const -> PointInfo
 {
     throw std::runtime_error("[Rectangle::uniformly_sample_point()] Rectangles as light sources are not yet supported");
 }
 
+template <typename T>
+auto VisiblePointT<T>::operator()(const MeshT<T> &) const -> PointInfo
+{
+    throw std::runtime_error("[Mesh::uniformly_sample_point()] Meshes as light sources are not yet supported");
+}
+
+template struct VisiblePointT<f32>;
+template struct VisiblePointT<f64>;
+
 // =============================================================================================
 // ======================================= POINT PROBABILITY ===================================
 // =============================================================================================
 #pragma region point_probability
 
-auto PointSampleProbability::operator()(const Sphere & sphere) const -> f64
+template <typename T>
+auto PointSampleProbabilityT<T>::operator()(const SphereT<T> & sphere) const -> T
 {
-    return 4.0 * sphere.radius * sphere.radius * M_PI;
+    return T(4.0) * sphere.radius * sphere.radius * T(M_PI);
 }
 
-auto PointSampleProbability::operator()(const Rectangle & rectangle) const -> f64
+template <typename T>
+auto PointSampleProbabilityT<T>::operator()(const RectangleT<T> &) const -> T
 {
     throw std::runtime_error("[Rectangle::sampled_point_probablity()] Rectangles as light sources are not yet supported");
 }
 
+template <typename T>
+auto PointSampleProbabilityT<T>::operator()(const MeshT<T> &) const -> T
+{
+    throw std::runtime_error("[Mesh::sampled_point_probablity()] Meshes as light sources are not yet supported");
+}
+
+template struct PointSampleProbabilityT<f32>;
+template struct PointSampleProbabilityT<f64>;
+
 #pragma endregion point_probability
 
 // =============================================================================================
 // ======================================= LIGHT POWER =========================================
 // =============================================================================================
-auto GetPower::operator()(const Sphere & sphere) const -> f64
+template <typename T>
+auto GetPower::operator()(const SphereT<T> & sphere) const -> f64
+{
+    f64 radius = sphere.radius;
+    return sphere.material->get_average_emmited_radiance() * (4.0 * radius * radius * M_PI) * M_PI;
+}
+
+template <typename T>
+auto GetPower::operator()(const RectangleT<T> &) const -> f64
 {
-    return sphere.material->get_average_emmited_radiance() * (4.0 * sphere.radius * sphere.radius * M_PI) * M_PI;
+    return 0.0;
 }
 
-auto GetPower::operator()(const Rectangle & rectangle) const -> f64
+// emissive meshes are only reached by BRDF sampled rays, they are not part of the light selection
+template <typename T>
+auto GetPower::operator()(const MeshT<T> &) const -> f64
 {
     return 0.0;
 }
 
+template auto GetPower::operator()(const SphereT<f32> & sphere) const -> f64;
+template auto GetPower::operator()(const SphereT<f64> & sphere) const -> f64;
+template auto GetPower::operator()(const RectangleT<f32> & rectangle) const -> f64;
+template auto GetPower::operator()(const RectangleT<f64> & rectangle) const -> f64;
+template auto GetPower::operator()(const MeshT<f32> & mesh) const -> f64;
+template auto GetPower::operator()(const MeshT<f64> & mesh) const -> f64;
+
+// =============================================================================================
+// ======================================= BOUNDS ==============================================
+// =============================================================================================
+#pragma region bounds
+
+template <typename T>
+auto GetBounds::operator()(const SphereT<T> & sphere) const -> AABBT<T>
+{
+    tvec3<T> extent = tvec3<T>(sphere.radius, sphere.radius, sphere.radius);
+    return AABBT<T>{
+        .min = sphere.origin - extent,
+        .max = sphere.origin + extent
+    };
+}
+
+template <typename T>
+auto GetBounds::operator()(const RectangleT<T> & rectangle) const -> AABBT<T>
+{
+    tvec3<T> right = rectangle.right * rectangle.dimensions.x;
+    tvec3<T> forward = rectangle.forward * rectangle.dimensions.y;
+    AABBT<T> bounds = {};
+    bounds.grow(rectangle.origin + right + forward);
+    bounds.grow(rectangle.origin + right - forward);
+    bounds.grow(rectangle.origin - right + forward);
+    bounds.grow(rectangle.origin - right - forward);
+    // rectangles aligned with an axis would produce a flat box, pad it so slab tests stay stable
+    const T pad = std::is_same_v<T, f32> ? T(1.0e-4) : T(1.0e-6);
+    const tvec3<T> padding = tvec3<T>(pad, pad, pad);
+    bounds.min -= padding;
+    bounds.max += padding;
+    return bounds;
+}
+
+template <typename T>
+auto GetBounds::operator()(const MeshT<T> & mesh) const -> AABBT<T>
+{
+    const AABBT<f32> bounds = mesh.data->bvh.get_bounds();
+    return AABBT<T>{
+        .min = tvec3<T>(bounds.min),
+        .max = tvec3<T>(bounds.max)
+    };
+}
+
+template auto GetBounds::operator()(const SphereT<f32> & sphere) const -> AABBT<f32>;
+template auto GetBounds::operator()(const SphereT<f64> & sphere) const -> AABBT<f64>;
+template auto GetBounds::operator()(const RectangleT<f32> & rectangle) const -> AABBT<f32>;
+template auto GetBounds::operator()(const RectangleT<f64> & rectangle) const -> AABBT<f64>;
+template auto GetBounds::operator()(const MeshT<f32> & mesh) const -> AABBT<f32>;
+template auto GetBounds::operator()(const MeshT<f64> & mesh) const -> AABBT<f64>;
+
+#pragma endregion bounds
@@ -6,55 +6,93 @@
 /// @brief Find an intersection with an object and a ray
 /// @return HitInfo structure, if there was no intersection with the object and the ray
 /// hit_distance in HitInfo structure is set to -1.0
-struct Intersect
+template <typename T>
+struct IntersectT
 {
     struct HitInfo
     {
-        f64 hit_distance = -1.0;
-        f64vec3 hit_position = {0.0, 0.0, 0.0};
-        f64vec3 normal = {0.0, 0.0, 0.0};
-        const Material * material = nullptr;
-        const Object * object = nullptr;
+        T hit_distance = -1.0;
+        tvec3<T> hit_position = {0.0, 0.0, 0.0};
+        tvec3<T> normal = {0.0, 0.0, 0.0};
+        const MaterialT<T> * material = nullptr;
+        const ObjectT<T> * object = nullptr;
     };
 
-    Intersect(const Ray & ray) : ray{ray} {}
+    IntersectT(const RayT<T> & ray) : ray{ray} {}
 
-    auto operator()(const Sphere & sphere) const -> HitInfo;
-    auto operator()(const Rectangle & rectangle) const -> HitInfo;
+    auto operator()(const SphereT<T> & sphere) const -> HitInfo;
+    auto operator()(const RectangleT<T> & rectangle) const -> HitInfo;
+    // watertight test against the triangles found through the hierarchy of the mesh
+    auto operator()(const MeshT<T> & mesh) const -> HitInfo;
     private:
-        const Ray ray;
+        const RayT<T> ray;
 };
+using Intersect = IntersectT<f64>;
+
+/// @brief Test whether the object blocks the ray somewhere in [EPSILON, max_distance), the any hit
+/// counterpart of IntersectT for shadow rays - no hit attributes are computed and the triangles of
+/// meshes are only searched until the first hit
+template <typename T>
+struct OccludesT
+{
+    OccludesT(const RayT<T> & ray, T max_distance) : ray{ray}, max_distance{max_distance} {}
+
+    auto operator()(const SphereT<T> & sphere) const -> bool;
+    auto operator()(const RectangleT<T> & rectangle) const -> bool;
+    auto operator()(const MeshT<T> & mesh) const -> bool;
+    private:
+        const RayT<T> ray;
+        const T max_distance;
+};
+using Occludes = OccludesT<f64>;
 
 /// @brief get uniformly sampled point on the object which is visible from the view_point
-struct VisiblePoint
+template <typename T>
+struct VisiblePointT
 {
     struct PointInfo
     {
-        f64vec3 sample = {0.0, 0.0, 0.0};
-        f64vec3 normal = {0.0, 0.0, 0.0};
+        tvec3<T> sample = {0.0, 0.0, 0.0};
+        tvec3<T> normal = {0.0, 0.0, 0.0};
     };
-    VisiblePoint(const f64vec3 & view_point) : view_point{view_point} {}
+    VisiblePointT(const tvec3<T> & view_point, Sampler & sampler) : view_point{view_point}, sampler{sampler} {}
 
-    auto operator()(const Sphere & sphere) const -> PointInfo;
-    auto operator()(const Rectangle & rectangle) const -> PointInfo;
+    auto operator()(const SphereT<T> & sphere) const -> PointInfo;
+    auto operator()(const RectangleT<T> & rectangle) const -> PointInfo;
+    auto operator()(const MeshT<T> & mesh) const -> PointInfo;
     private:
-        const f64vec3 view_point;
+        const tvec3<T> view_point;
+        Sampler & sampler;
 };
+using VisiblePoint = VisiblePointT<f64>;
 
 /// @brief get the probability with which the sampled point would be sampled
-struct PointSampleProbability
+template <typename T>
+struct PointSampleProbabilityT
 {
-    PointSampleProbability(const f64vec3 & point) : point{point} {}
+    PointSampleProbabilityT(const tvec3<T> & point) : point{point} {}
 
-    auto operator()(const Sphere & sphere) const -> f64;
-    auto operator()(const Rectangle & rectangle) const -> f64;
+    auto operator()(const SphereT<T> & sphere) const -> T;
+    auto operator()(const RectangleT<T> & rectangle) const -> T;
+    auto operator()(const MeshT<T> & mesh) const -> T;
     private:
-        const f64vec3 point;
+        const tvec3<T> point;
 };
+using PointSampleProbability = PointSampleProbabilityT<f64>;
 
 /// @brief get the total power corresponding to the light emmited from the object
 struct GetPower
 {
-    auto operator()(const Sphere & sphere) const -> f64;
-    auto operator()(const Rectangle & rectangle) const -> f64;
+    // power is always accumulated in double precision
+    template <typename T> auto operator()(const SphereT<T> & sphere) const -> f64;
+    template <typename T> auto operator()(const RectangleT<T> & rectangle) const -> f64;
+    template <typename T> auto operator()(const MeshT<T> & mesh) const -> f64;
+};
+
+/// @brief get the axis aligned bounding box enclosing the object
+struct GetBounds
+{
+    template <typename T> auto operator()(const SphereT<T> & sphere) const -> AABBT<T>;
+    template <typename T> auto operator()(const RectangleT<T> & rectangle) const -> AABBT<T>;
+    template <typename T> auto operator()(const MeshT<T> & mesh) const -> AABBT<T>;
 };
\ No newline at end of file
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "material.hpp"
+#include "operations.hpp"
+#include "types.hpp"
+
+/// @brief Primary hits of all pixels (G-buffer). The camera rays are the same in every iteration so each
+/// pixel is intersected once and later iterations shade the stored hit, pixels whose ray misses the scene
+/// keep the env map radiance they see. The planes double as the depth, normal and albedo outputs of a render
+template <typename T>
+struct PrimaryHitBufferT
+{
+    static const u32 NO_MATERIAL = ~0u;
+
+    // distance along the camera ray, -1 for misses
+    std::vector<T> distances;
+    std::vector<tvec3<T>> positions;
+    std::vector<tvec3<T>> normals;
+    // index into the materials of the traced scene, NO_MATERIAL for misses
+    std::vector<u32> materials;
+    // env map radiance seen by the pixels whose ray misses the scene, zero without env map
+    std::vector<f32vec3> miss_radiance;
+    // pixels stored since the last invalidate
+    std::vector<u8> valid;
+
+    PrimaryHitBufferT() = default;
+    PrimaryHitBufferT(u32 pixel_count) :
+        distances(pixel_count, T(-1.0)),
+        positions(pixel_count),
+        normals(pixel_count),
+        materials(pixel_count, NO_MATERIAL),
+        miss_radiance(pixel_count),
+        valid(pixel_count, 0)
+    {}
+
+    inline void invalidate() { std::fill(valid.begin(), valid.end(), u8(0)); }
+    [[nodiscard]] inline auto get_pixel_count() const -> u32 { return u32(valid.size()); }
+
+    // no bounds checks, called once per pixel from the render loop
+    inline void store(u32 index, const typename IntersectT<T>::HitInfo & hit, const MaterialT<T> * first_material, const tvec3<T> & radiance)
+    {
+        distances[index] = hit.hit_distance;
+        positions[index] = hit.hit_position;
+        normals[index] = hit.normal;
+        materials[index] = hit.material != nullptr ? u32(hit.material - first_material) : NO_MATERIAL;
+        miss_radiance[index] = f32vec3(radiance);
+        valid[index] = 1;
+    }
+    // the object of the returned hit is not stored and stays null, shading the primary hit does not need it
+    [[nodiscard]] inline auto load(u32 index, const std::vector<MaterialT<T>> & scene_materials) const -> typename IntersectT<T>::HitInfo
+    {
+        return {
+            .hit_distance = distances[index],
+            .hit_position = positions[index],
+            .normal = normals[index],
+            .material = materials[index] != NO_MATERIAL ? &scene_materials[materials[index]] : nullptr
+        };
+    }
+};
@@ -0,0 +1,87 @@
+#include "ray_packet.hpp"
+#include "operations.hpp"
+
+RayPacket::RayPacket(const std::array<Ray, PACKET_SIZE> & rays, u32 active_mask) :
+    rays{rays},
+    active_mask{active_mask}
+{
+    std::array<f64, PACKET_SIZE> components[9];
+    for(u32 lane = 0; lane < PACKET_SIZE; lane++)
+    {
+        const Ray & ray = rays[lane];
+        for(u32 axis = 0; axis < 3; axis++)
+        {
+            components[axis][lane] = ray.start[axis];
+            components[axis + 3][lane] = ray.direction[axis];
+            components[axis + 6][lane] = 1.0 / ray.direction[axis];
+        }
+    }
+    start = {f64x4::load(components[0].data()), f64x4::load(components[1].data()), f64x4::load(components[2].data())};
+    direction = {f64x4::load(components[3].data()), f64x4::load(components[4].data()), f64x4::load(components[5].data())};
+    inv_direction = {f64x4::load(components[6].data()), f64x4::load(components[7].data()), f64x4::load(components[8].data())};
+}
+
+// The packet versions mirror the scalar Intersect functors operation by operation
+// so that the lanes produce the same distances as the single ray path
+
+auto IntersectPacket::operator()(const Sphere & sphere) const -> f64x4
+{
+    const f64x4 zero = f64x4::splat(0.0);
+    const f64x4 two = f64x4::splat(2.0);
+    const f64x4 miss = f64x4::splat(-1.0);
+
+    f64x4vec3 ray_to_sphere = packet.start - f64x4vec3::splat(sphere.origin);
+    f64x4 a = dot(packet.direction, packet.direction);
+    f64x4 b = dot(ray_to_sphere, packet.direction) * two;
+    f64x4 c = dot(ray_to_sphere, ray_to_sphere) - f64x4::splat(sphere.radius * sphere.radius);
+    f64x4 discriminant = b * b - f64x4::splat(4.0) * a * c;
+
+    f64x4 has_roots = discriminant >= zero;
+    f64x4 root = sqrt(max(discriminant, zero));
+    f64x4 t1 = (zero - b + root) / two / a;
+    f64x4 t2 = (zero - b - root) / two / a;
+
+    f64x4 t1_valid = t1 > zero;
+    f64x4 t2_valid = t2 > zero;
+    // closer of the two intersections in front of the ray origin
+    f64x4 hit_distance = select(t1_valid, select(t2_valid, min(t1, t2), t1), t2);
+    f64x4 hit = has_roots & (t1_valid | t2_valid);
+    return select(hit, hit_distance, miss);
+}
+
+auto IntersectPacket::operator()(const Rectangle & rectangle) const -> f64x4
+{
+    const f64x4 miss = f64x4::splat(-1.0);
+    f64x4vec3 normal = f64x4vec3::splat(rectangle.normal);
+
+    f64x4 denominator = dot(normal, packet.direction);
+    f64x4 not_parallel = abs(denominator) >= f64x4::splat(EPSILON);
+
+    f64x4vec3 origin = f64x4vec3::splat(rectangle.origin);
+    f64x4 hit_distance = dot(normal, origin - packet.start) / denominator;
+    f64x4 in_front = hit_distance >= f64x4::splat(0.0);
+
+    f64x4vec3 world_hit_position = {
+        packet.start.x + hit_distance * packet.direction.x,
+        packet.start.y + hit_distance * packet.direction.y,
+        packet.start.z + hit_distance * packet.direction.z
+    };
+    f64x4vec3 local_position = world_hit_position - origin;
+    f64x4 x_proj = dot(local_position, f64x4vec3::splat(rectangle.right));
+    f64x4 y_proj = dot(local_position, f64x4vec3::splat(rectangle.forward));
+    f64x4 inside =
+        (abs(x_proj) <= f64x4::splat(rectangle.dimensions.x)) &
+        (abs(y_proj) <= f64x4::splat(rectangle.dimensions.y));
+
+    return select(not_parallel & in_front & inside, hit_distance, miss);
+}
+
+auto IntersectPacket::operator()(const Mesh & mesh) const -> f64x4
+{
+    std::array<f64, PACKET_SIZE> hit_distance;
+    for(u32 lane = 0; lane < PACKET_SIZE; lane++)
+    {
+        hit_distance[lane] = ((packet.active_mask >> lane) & 1u) ? Intersect{packet.rays[lane]}(mesh).hit_distance : -1.0;
+    }
+    return f64x4::load(hit_distance.data());
+}
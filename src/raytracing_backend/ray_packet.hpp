@@ -0,0 +1,154 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cmath>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "objects.hpp"
+#include "types.hpp"
+
+// number of rays traced together in a packet
+const u32 PACKET_SIZE = 4;
+const u32 PACKET_FULL_MASK = (1u << PACKET_SIZE) - 1;
+
+/// @brief Four f64 lanes, maps to a single ymm register when compiled with AVX2,
+/// otherwise falls back to plain arrays which the compiler is free to vectorize.
+/// Comparisons return masks where each lane has either all or none of its bits set
+struct f64x4
+{
+#if defined(__AVX2__)
+    __m256d value;
+
+    static inline auto splat(f64 scalar) -> f64x4 { return {_mm256_set1_pd(scalar)}; }
+    static inline auto load(const f64 * data) -> f64x4 { return {_mm256_loadu_pd(data)}; }
+    inline void store(f64 * data) const { _mm256_storeu_pd(data, value); }
+    inline auto to_bitmask() const -> u32 { return u32(_mm256_movemask_pd(value)); }
+#else
+    std::array<f64, PACKET_SIZE> value;
+
+    static inline auto splat(f64 scalar) -> f64x4 { return {{scalar, scalar, scalar, scalar}}; }
+    static inline auto load(const f64 * data) -> f64x4 { return {{data[0], data[1], data[2], data[3]}}; }
+    inline void store(f64 * data) const { for(u32 i = 0; i < PACKET_SIZE; i++) { data[i] = value[i]; } }
+    inline auto to_bitmask() const -> u32
+    {
+        u32 mask = 0;
+        for(u32 i = 0; i < PACKET_SIZE; i++) { mask |= u32(std::bit_cast<u64>(value[i]) >> 63) << i; }
+        return mask;
+    }
+#endif
+    static inline auto from_bitmask(u32 mask) -> f64x4
+    {
+        const f64 on = std::bit_cast<f64>(~u64(0));
+        std::array<f64, PACKET_SIZE> lanes;
+        for(u32 i = 0; i < PACKET_SIZE; i++) { lanes[i] = (mask >> i) & 1u ? on : 0.0; }
+        return load(lanes.data());
+    }
+    inline auto lane(u32 index) const -> f64
+    {
+        std::array<f64, PACKET_SIZE> lanes;
+        store(lanes.data());
+        return lanes[index];
+    }
+};
+
+#if defined(__AVX2__)
+inline auto operator+(f64x4 a, f64x4 b) -> f64x4 { return {_mm256_add_pd(a.value, b.value)}; }
+inline auto operator-(f64x4 a, f64x4 b) -> f64x4 { return {_mm256_sub_pd(a.value, b.value)}; }
+inline auto operator*(f64x4 a, f64x4 b) -> f64x4 { return {_mm256_mul_pd(a.value, b.value)}; }
+inline auto operator/(f64x4 a, f64x4 b) -> f64x4 { return {_mm256_div_pd(a.value, b.value)}; }
+inline auto operator<(f64x4 a, f64x4 b) -> f64x4 { return {_mm256_cmp_pd(a.value, b.value, _CMP_LT_OQ)}; }
+inline auto operator<=(f64x4 a, f64x4 b) -> f64x4 { return {_mm256_cmp_pd(a.value, b.value, _CMP_LE_OQ)}; }
+inline auto operator>(f64x4 a, f64x4 b) -> f64x4 { return {_mm256_cmp_pd(a.value, b.value, _CMP_GT_OQ)}; }
+inline auto operator>=(f64x4 a, f64x4 b) -> f64x4 { return {_mm256_cmp_pd(a.value, b.value, _CMP_GE_OQ)}; }
+inline auto operator&(f64x4 a, f64x4 b) -> f64x4 { return {_mm256_and_pd(a.value, b.value)}; }
+inline auto operator|(f64x4 a, f64x4 b) -> f64x4 { return {_mm256_or_pd(a.value, b.value)}; }
+// glm::min/max semantics - the second operand is returned when either one is NaN
+inline auto min(f64x4 a, f64x4 b) -> f64x4 { return {_mm256_min_pd(b.value, a.value)}; }
+inline auto max(f64x4 a, f64x4 b) -> f64x4 { return {_mm256_max_pd(b.value, a.value)}; }
+inline auto sqrt(f64x4 a) -> f64x4 { return {_mm256_sqrt_pd(a.value)}; }
+inline auto abs(f64x4 a) -> f64x4 { return {_mm256_andnot_pd(_mm256_set1_pd(-0.0), a.value)}; }
+// picks lanes of a where the mask is set and lanes of b otherwise
+inline auto select(f64x4 mask, f64x4 a, f64x4 b) -> f64x4 { return {_mm256_blendv_pd(b.value, a.value, mask.value)}; }
+#else
+template <typename Function>
+inline auto f64x4_map(f64x4 a, f64x4 b, Function function) -> f64x4
+{
+    f64x4 result;
+    for(u32 i = 0; i < PACKET_SIZE; i++) { result.value[i] = function(a.value[i], b.value[i]); }
+    return result;
+}
+inline auto f64x4_mask(bool condition) -> f64 { return condition ? std::bit_cast<f64>(~u64(0)) : 0.0; }
+inline auto operator+(f64x4 a, f64x4 b) -> f64x4 { return f64x4_map(a, b, [](f64 x, f64 y) { return x + y; }); }
+inline auto operator-(f64x4 a, f64x4 b) -> f64x4 { return f64x4_map(a, b, [](f64 x, f64 y) { return x - y; }); }
+inline auto operator*(f64x4 a, f64x4 b) -> f64x4 { return f64x4_map(a, b, [](f64 x, f64 y) { return x * y; }); }
+inline auto operator/(f64x4 a, f64x4 b) -> f64x4 { return f64x4_map(a, b, [](f64 x, f64 y) { return x / y; }); }
+inline auto operator<(f64x4 a, f64x4 b) -> f64x4 { return f64x4_map(a, b, [](f64 x, f64 y) { return f64x4_mask(x < y); }); }
+inline auto operator<=(f64x4 a, f64x4 b) -> f64x4 { return f64x4_map(a, b, [](f64 x, f64 y) { return f64x4_mask(x <= y); }); }
+inline auto operator>(f64x4 a, f64x4 b) -> f64x4 { return f64x4_map(a, b, [](f64 x, f64 y) { return f64x4_mask(x > y); }); }
+inline auto operator>=(f64x4 a, f64x4 b) -> f64x4 { return f64x4_map(a, b, [](f64 x, f64 y) { return f64x4_mask(x >= y); }); }
+inline auto operator&(f64x4 a, f64x4 b) -> f64x4
+{
+    return f64x4_map(a, b, [](f64 x, f64 y) { return std::bit_cast<f64>(std::bit_cast<u64>(x) & std::bit_cast<u64>(y)); });
+}
+inline auto operator|(f64x4 a, f64x4 b) -> f64x4
+{
+    return f64x4_map(a, b, [](f64 x, f64 y) { return std::bit_cast<f64>(std::bit_cast<u64>(x) | std::bit_cast<u64>(y)); });
+}
+inline auto min(f64x4 a, f64x4 b) -> f64x4 { return f64x4_map(a, b, [](f64 x, f64 y) { return y < x ? y : x; }); }
+inline auto max(f64x4 a, f64x4 b) -> f64x4 { return f64x4_map(a, b, [](f64 x, f64 y) { return x < y ? y : x; }); }
+inline auto sqrt(f64x4 a) -> f64x4 { return f64x4_map(a, a, [](f64 x, f64) { return std::sqrt(x); }); }
+inline auto abs(f64x4 a) -> f64x4 { return f64x4_map(a, a, [](f64 x, f64) { return std::abs(x); }); }
+inline auto select(f64x4 mask, f64x4 a, f64x4 b) -> f64x4
+{
+    f64x4 result;
+    for(u32 i = 0; i < PACKET_SIZE; i++) { result.value[i] = (std::bit_cast<u64>(mask.value[i]) >> 63) ? a.value[i] : b.value[i]; }
+    return result;
+}
+#endif
+
+/// @brief three component vector of packets - one f64x4 per component
+struct f64x4vec3
+{
+    f64x4 x;
+    f64x4 y;
+    f64x4 z;
+
+    static inline auto splat(const f64vec3 & vector) -> f64x4vec3
+    {
+        return {f64x4::splat(vector.x), f64x4::splat(vector.y), f64x4::splat(vector.z)};
+    }
+};
+inline auto operator-(const f64x4vec3 & a, const f64x4vec3 & b) -> f64x4vec3 { return {a.x - b.x, a.y - b.y, a.z - b.z}; }
+inline auto dot(const f64x4vec3 & a, const f64x4vec3 & b) -> f64x4 { return a.x * b.x + a.y * b.y + a.z * b.z; }
+
+/// @brief Neighbouring camera rays stored in structure of arrays layout
+/// Lanes which are not set in active_mask hold a copy of an active ray so they never produce NaNs
+struct RayPacket
+{
+    f64x4vec3 start;
+    f64x4vec3 direction;
+    f64x4vec3 inv_direction;
+    std::array<Ray, PACKET_SIZE> rays;
+    u32 active_mask;
+
+    RayPacket(const std::array<Ray, PACKET_SIZE> & rays, u32 active_mask);
+};
+
+/// @brief Intersect all lanes of the packet with an object
+/// @return distance of the hit for each lane following the Intersect conventions -
+/// lanes which missed the object are set to -1.0
+struct IntersectPacket
+{
+    IntersectPacket(const RayPacket & packet) : packet{packet} {}
+
+    auto operator()(const Sphere & sphere) const -> f64x4;
+    auto operator()(const Rectangle & rectangle) const -> f64x4;
+    // meshes have their own hierarchy which every active lane traverses as a single ray
+    auto operator()(const Mesh & mesh) const -> f64x4;
+    private:
+        const RayPacket & packet;
+};
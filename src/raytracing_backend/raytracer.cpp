@@ -2,89 +2,535 @@
 #include <omp.h>
 #include <glm/gtx/rotate_vector.hpp>
 #include <glm/gtx/compatibility.hpp>
+#include <algorithm>
+#include <bit>
 #include <cmath>
+#include <limits>
 #include <thread>
+#include <atomic>
+#include <chrono>
 
-Raytracer::Raytracer(const u32vec2 dimensions) :
-    result_image{dimensions.x * dimensions.y}, 
-    working_image{dimensions.x * dimensions.y},
+template <typename T>
+RaytracerT<T>::RaytracerT(const u32vec2 dimensions, u32 thread_count) :
+    accumulation{dimensions.x * dimensions.y},
     sample_ratio{1.0},
     dimensions{dimensions},
-    active_scene{nullptr}
+    active_scene{nullptr},
+    objects{nullptr},
+    materials{nullptr},
+    bvh{nullptr},
+    thread_pool{thread_count}
 {
 }
 
-void Raytracer::set_sample_ratio(f32 sample_ratio)
+// interleaves the bits of x and y, x takes the even bits
+static auto morton_encode(u32vec2 coords) -> u32
+{
+    auto spread_bits = [](u32 value)
+    {
+        value &= 0x0000ffff;
+        value = (value | (value << 8)) & 0x00ff00ff;
+        value = (value | (value << 4)) & 0x0f0f0f0f;
+        value = (value | (value << 2)) & 0x33333333;
+        value = (value | (value << 1)) & 0x55555555;
+        return value;
+    };
+    return spread_bits(coords.x) | (spread_bits(coords.y) << 1);
+}
+
+static auto morton_decode(u32 code) -> u32vec2
+{
+    auto compact_bits = [](u32 value)
+    {
+        value &= 0x55555555;
+        value = (value | (value >> 1)) & 0x33333333;
+        value = (value | (value >> 2)) & 0x0f0f0f0f;
+        value = (value | (value >> 4)) & 0x00ff00ff;
+        value = (value | (value >> 8)) & 0x0000ffff;
+        return value;
+    };
+    return {compact_bits(code), compact_bits(code >> 1)};
+}
+
+template <typename T>
+void RaytracerT<T>::build_tiles(u32 tile_size, TraversalOrder order, u32vec2 region_start, u32vec2 region_end)
+{
+    tiles.clear();
+    for(u32 y = region_start.y; y < region_end.y; y += tile_size)
+    {
+        for(u32 x = region_start.x; x < region_end.x; x += tile_size)
+        {
+            tiles.push_back({
+                .start = {x, y},
+                .end = glm::min(u32vec2(x + tile_size, y + tile_size), region_end)
+            });
+        }
+    }
+    if(order == MORTON)
+    {
+        std::sort(tiles.begin(), tiles.end(), [&](const Tile & first, const Tile & second)
+        {
+            return morton_encode((first.start - region_start) / tile_size) < morton_encode((second.start - region_start) / tile_size);
+        });
+    }
+}
+
+template <typename T>
+void RaytracerT<T>::set_sample_ratio(f32 sample_ratio)
 {
     this->sample_ratio = sample_ratio;
 }
 
-void Raytracer::trace_scene(Scene * scene, const TraceInfo & info)
+template <typename T>
+void RaytracerT<T>::invalidate_primary_hits()
 {
-    const int num_threads = std::thread::hardware_concurrency() * 2;
-    std::vector<std::thread> threads;
+    // no scene matches the empty key so the next trace rebuilds the hits
+    primary_hit_key = {};
+    converted_scene = nullptr;
+}
 
-    auto task = [&](int start, int end, u32 iteration)
+template <typename T>
+void RaytracerT<T>::prepare_scene(Scene * scene)
+{
+    active_scene = scene;
+    if constexpr(std::is_same_v<T, f64>)
     {
-        for(int y = start; y < end; y++)
+        objects = &scene->scene_objects;
+        materials = &scene->scene_materials;
+        bvh = &scene->bvh;
+    }
+    else
+    {
+        // tiled renders trace the same scene once per tile
+        if(scene == converted_scene && scene->scene_objects.size() == converted_object_count &&
+           scene->scene_materials.size() == converted_material_count) { return; }
+
+        converted_materials.clear();
+        converted_materials.reserve(scene->scene_materials.size());
+        for(const auto & material : scene->scene_materials) { converted_materials.emplace_back(material); }
+
+        // objects keep their indices so the emitter list of the scene stays valid
+        auto convert_object = [&](const auto & object) -> ObjectT<T>
+        {
+            const MaterialT<T> * material = &converted_materials.at(object.material - scene->scene_materials.data());
+            using ObjectType = std::decay_t<decltype(object)>;
+            if constexpr(std::is_same_v<ObjectType, Sphere>) { return SphereT<T>(object, material); }
+            else if constexpr(std::is_same_v<ObjectType, Mesh>) { return MeshT<T>(object, material); }
+            else { return RectangleT<T>(object, material); }
+        };
+        converted_objects.clear();
+        converted_objects.reserve(scene->scene_objects.size());
+        for(const auto & object : scene->scene_objects) { converted_objects.push_back(std::visit(convert_object, object)); }
+        converted_bvh.build(converted_objects);
+
+        objects = &converted_objects;
+        materials = &converted_materials;
+        bvh = &converted_bvh;
+        converted_scene = scene;
+        converted_object_count = scene->scene_objects.size();
+        converted_material_count = scene->scene_materials.size();
+    }
+}
+
+template <typename T>
+auto RaytracerT<T>::trace_scene(Scene * scene, const TraceInfo & info) -> TraceSummary
+{
+    const auto start = std::chrono::steady_clock::now();
+    prepare_scene(scene);
+    const bool has_region = info.region_end.x > info.region_start.x && info.region_end.y > info.region_start.y;
+    const u32vec2 region_start = has_region ? glm::min(info.region_start, dimensions) : u32vec2(0, 0);
+    const u32vec2 region_end = has_region ? glm::min(info.region_end, dimensions) : dimensions;
+    // clearing the whole image for every region would make tiled renders scale with the image size
+    if(has_region) { accumulation.clear(dimensions.x, region_start, region_end); }
+    else { accumulation.clear(); }
+    if(info.iterations == 0) { return {}; }
+
+    if(info.cache_primary_hits)
+    {
+        const u32 image_pixel_count = dimensions.x * dimensions.y;
+        if(primary_hits.get_pixel_count() != image_pixel_count) { primary_hits = PrimaryHitBufferT<T>(image_pixel_count); }
+        const PrimaryHitKey key = {
+            .scene = scene,
+            .env_map = scene->env_map.get(),
+            .use_env_map = scene->use_env_map,
+            .camera_origin = scene->camera.origin,
+            .camera_look_at = scene->camera.look_at,
+            .camera_right = scene->camera.right,
+            .camera_up = scene->camera.up,
+            .camera_fov = scene->camera.fov,
+            .dimensions = dimensions,
+            .object_count = scene->scene_objects.size(),
+            .material_count = scene->scene_materials.size()
+        };
+        if(key != primary_hit_key)
+        {
+            primary_hits.invalidate();
+            primary_hit_key = key;
+        }
+    }
+
+    // in adaptive mode tiles may run past info.iterations for as long as the shared budget lasts
+    const u32 min_iterations = glm::min(info.min_iterations, info.iterations);
+    const u32 iteration_count = info.adaptive ? glm::max(info.max_iterations, info.iterations) : info.iterations;
+    const f64 pixel_count = f64(region_end.x - region_start.x) * f64(region_end.y - region_start.y);
+    // iterations of single pixels left after every pixel received its min_iterations, only the thread
+    // scheduling the next adaptive pass touches it
+    i64 remaining_budget = i64(pixel_count) * (info.iterations - min_iterations);
+    // pixels from this index on are left out of the current adaptive pass as the budget ran out before them
+    u32 pass_end = std::numeric_limits<u32>::max();
+
+    // tiles are rebuilt for every trace as their size and order are trace parameters
+    build_tiles(glm::max(info.tile_size, 2u), info.traversal_order, region_start, region_end);
+    // number of tiles which finished the given iteration, used only to report progress
+    std::vector<std::atomic<u32>> finished_tiles(iteration_count);
+    std::atomic<u32> completed_iterations = 0;
+
+    // set once a termination policy is met, tiles check it before starting their next iteration
+    std::atomic<TraceStopReason> stop_reason = ITERATIONS_DONE;
+    const auto deadline = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<f64>(info.time_budget));
+    // sum of the per pixel relative errors over the image and the number of pixels which have one
+    std::atomic<f64> image_error_sum = 0.0;
+    std::atomic<u32> image_error_pixels = 0;
+    // every worker flushes its thread local counters into its own slot after each tile
+    std::vector<TraceStats> worker_stats(thread_pool.get_thread_count());
+
+    auto stop = [&](TraceStopReason reason)
+    {
+        TraceStopReason expected = ITERATIONS_DONE;
+        stop_reason.compare_exchange_strong(expected, reason);
+    };
+    auto is_converged = [&](u32 pixel_index)
+    {
+        // a pixel without an error estimate is never converged, even when min_iterations is below two
+        return accumulation.count[pixel_index] >= min_iterations && accumulation.has_relative_error(pixel_index)
+            && accumulation.get_relative_error(pixel_index) < info.target_relative_error;
+    };
+    std::function<void(u32, u32)> trace_tile;
+    std::function<void(u32)> finish_iteration;
+    // adaptive iterations past min_iterations run as passes over all unfinished tiles, the budget is handed to
+    // the unconverged pixels in pixel order so which pixels are traced does not depend on the thread count
+    auto schedule_pass = [&](u32 iteration)
+    {
+        u64 pass_pixels = 0;
+        pass_end = std::numeric_limits<u32>::max();
+        for(u32 y = region_start.y; y < region_end.y && pass_end == std::numeric_limits<u32>::max(); y++)
+        {
+            for(u32 x = region_start.x; x < region_end.x; x++)
+            {
+                if(is_converged(y * dimensions.x + x)) { continue; }
+                if(remaining_budget == 0)
+                {
+                    pass_end = y * dimensions.x + x;
+                    break;
+                }
+                remaining_budget--;
+                pass_pixels++;
+            }
+        }
+
+        std::vector<ThreadPool::Task> tasks;
+        for(u32 i = 0; i < tiles.size(); i++)
         {
-            for(u32 x = 0; x < dimensions.x; x++)
+            Tile & tile = tiles.at(i);
+            if(tile.done) { continue; }
+            if(pass_pixels > 0)
             {
-                Pixel color = ray_gen(scene->camera.get_ray({x, y}, dimensions), info);
-                // the same weight for all samples for computing mean incrementally
-                f64 weight = 1.0 / iteration;
-                Pixel new_col = color * weight + result_image.at(y * dimensions.x + x) * (1.0 - weight);
-                result_image.at(y * dimensions.x + x) = color * weight + result_image.at(y * dimensions.x + x) * (1.0 - weight);
+                tasks.push_back([&, i](u32 worker) { trace_tile(i, worker); });
+                continue;
             }
+            // the budget is spent, the tile is done and counts as finished for the iterations it skips
+            tile.done = true;
+            for(u32 skipped = iteration; skipped <= iteration_count; skipped++) { finish_iteration(skipped); }
+        }
+        if(!tasks.empty()) { thread_pool.submit(std::move(tasks)); }
+    };
+    finish_iteration = [&](u32 iteration)
+    {
+        if(finished_tiles.at(iteration - 1).fetch_add(1) + 1 == tiles.size())
+        {
+            completed_iterations.store(iteration);
+            // the tile finishing iteration n must have published n - 1 before starting n so there
+            // is never more than one thread publishing at a time
+            if(info.frame_buffer != nullptr) { info.frame_buffer->publish(); }
+            std::cout << "Traced iteration num: " << iteration << std::endl;
+            if(info.adaptive && iteration >= min_iterations && iteration < iteration_count) { schedule_pass(iteration + 1); }
         }
     };
 
-    active_scene = scene;
-    threads.reserve(num_threads);
-    int chunk = dimensions.y / num_threads;
-    int remainder = dimensions.y % num_threads;
-
-    for(u32 iteration = 1; iteration <= info.iterations; iteration++)
+    // each tile advances through the iterations on its own - there is no barrier between
+    // iterations so idle workers can steal tiles from any iteration that is still in flight,
+    // only the adaptive passes past min_iterations wait for each other
+    trace_tile = [&](u32 tile_index, u32 worker_index)
     {
-        std::cout << "Tracing iteration num: " << iteration << std::endl;
-        for(int i = 0; i < num_threads; i++)
+        if(info.cancel != nullptr && info.cancel->load(std::memory_order_relaxed)) { return; }
+        // the deadline waits until every tile finished an iteration so no part of the image is left without samples
+        if(info.time_budget > 0.0 && completed_iterations.load() >= 1 && std::chrono::steady_clock::now() >= deadline) { stop(TIME_BUDGET); }
+        if(stop_reason.load() != ITERATIONS_DONE) { return; }
+
+        Tile & tile = tiles.at(tile_index);
+        u32 iteration = ++tile.iteration;
+        // pixels of the tile which still need more iterations after this one
+        u32 unconverged_pixels = 0;
+        // pixels are processed in 2x2 quads so the primary rays of a quad can be traced as one packet
+        auto trace_quad = [&](u32 x, u32 y)
+        {
+            std::array<u32vec2, PACKET_SIZE> coords;
+            // lanes outside of the tile keep a copy of the first ray
+            const RayT<T> first_ray = RayT<T>(scene->camera.get_ray({x, y}, dimensions));
+            std::array<RayT<T>, PACKET_SIZE> rays = {first_ray, first_ray, first_ray, first_ray};
+            u32 active_mask = 0;
+            for(u32 lane = 0; lane < PACKET_SIZE; lane++)
+            {
+                coords.at(lane) = {x + lane % 2, y + lane / 2};
+                if(coords.at(lane).x >= tile.end.x || coords.at(lane).y >= tile.end.y) { continue; }
+                if(info.adaptive && is_converged(coords.at(lane).y * dimensions.x + coords.at(lane).x)) { continue; }
+                if(info.adaptive && coords.at(lane).y * dimensions.x + coords.at(lane).x >= pass_end)
+                {
+                    unconverged_pixels++;
+                    continue;
+                }
+                active_mask |= 1u << lane;
+                if(lane != 0) { rays.at(lane) = RayT<T>(scene->camera.get_ray(coords.at(lane), dimensions)); }
+            }
+
+            if(active_mask == 0) { return; }
+            // converged pixels can leave the first lane inactive, inactive lanes must hold an active ray
+            if(!(active_mask & 1u))
+            {
+                const RayT<T> active_ray = rays.at(std::countr_zero(active_mask));
+                for(u32 lane = 0; lane < PACKET_SIZE; lane++)
+                {
+                    if(!((active_mask >> lane) & 1u)) { rays.at(lane) = active_ray; }
+                }
+            }
+
+            std::array<HitInfo, PACKET_SIZE> hits;
+            std::array<tvec3<T>, PACKET_SIZE> miss_radiance;
+            // lanes whose primary hit is not cached yet
+            u32 trace_mask = active_mask;
+            if(info.cache_primary_hits)
+            {
+                for(u32 lane = 0; lane < PACKET_SIZE; lane++)
+                {
+                    const u32 pixel_index = coords.at(lane).y * dimensions.x + coords.at(lane).x;
+                    if(!((active_mask >> lane) & 1u) || !primary_hits.valid[pixel_index]) { continue; }
+                    hits.at(lane) = primary_hits.load(pixel_index, *materials);
+                    miss_radiance.at(lane) = tvec3<T>(primary_hits.miss_radiance[pixel_index]);
+                    trace_mask &= ~(1u << lane);
+                    TRACE_STAT(CACHED_PRIMARY_HITS);
+                }
+            }
+
+            if(trace_mask != 0)
+            {
+                std::array<HitInfo, PACKET_SIZE> packet_hits;
+                bool traced_as_packet = false;
+                if constexpr(std::is_same_v<T, f64>)
+                {
+                    if(info.use_ray_packets)
+                    {
+                        packet_hits = trace_ray_packet(RayPacket(rays, trace_mask));
+                        traced_as_packet = true;
+                    }
+                }
+                for(u32 lane = 0; lane < PACKET_SIZE; lane++)
+                {
+                    if(!((trace_mask >> lane) & 1u)) { continue; }
+                    hits.at(lane) = traced_as_packet ? packet_hits.at(lane) : trace_ray(rays.at(lane));
+                    const bool sees_env_map = hits.at(lane).hit_distance < T(0.0) && active_scene->use_env_map;
+                    miss_radiance.at(lane) = sees_env_map ? miss_ray(rays.at(lane)) : tvec3<T>(0.0);
+                    if(info.cache_primary_hits)
+                    {
+                        primary_hits.store(coords.at(lane).y * dimensions.x + coords.at(lane).x, hits.at(lane), materials->data(), miss_radiance.at(lane));
+                    }
+                }
+            }
+
+            for(u32 lane = 0; lane < PACKET_SIZE; lane++)
+            {
+                if(!((active_mask >> lane) & 1u)) { continue; }
+                u32 pixel_index = coords.at(lane).y * dimensions.x + coords.at(lane).x;
+                // pixels skip iterations in adaptive mode so they track their own iteration count
+                Sampler sampler = Sampler(info.seed, pixel_index, accumulation.count[pixel_index] + 1);
+                TRACE_STAT(PRIMARY_RAYS);
+                Pixel color;
+                if(hits[lane].hit_distance < T(0.0))
+                {
+                    TRACE_STAT(PRIMARY_MISSES);
+                    color = Pixel(miss_radiance[lane]);
+                }
+                else { color = ray_gen(rays[lane], hits[lane], info, sampler); }
+                accumulation.add(pixel_index, color.R, color.G, color.B);
+                if(info.adaptive && !is_converged(pixel_index)) { unconverged_pixels++; }
+            }
+        };
+
+        if(info.traversal_order == MORTON)
+        {
+            // the curve covers the power of two square around the quads of the tile, codes outside are skipped
+            const u32vec2 quad_count = (tile.end - tile.start + 1u) / 2u;
+            const u32 curve_size = std::bit_ceil(glm::max(quad_count.x, quad_count.y));
+            for(u32 code = 0; code < curve_size * curve_size; code++)
+            {
+                const u32vec2 quad = morton_decode(code);
+                if(quad.x < quad_count.x && quad.y < quad_count.y) { trace_quad(tile.start.x + quad.x * 2, tile.start.y + quad.y * 2); }
+            }
+        }
+        else
+        {
+            for(u32 y = tile.start.y; y < tile.end.y; y += 2)
+            {
+                for(u32 x = tile.start.x; x < tile.end.x; x += 2) { trace_quad(x, y); }
+            }
+        }
+
+        if(info.frame_buffer != nullptr)
         {
-            if(i != num_threads - 1)
+            for(u32 y = tile.start.y; y < tile.end.y; y++)
             {
-                threads.push_back(std::thread(task, i * chunk, (i+1) * chunk, iteration));
-            } else
+                for(u32 x = tile.start.x; x < tile.end.x; x++)
+                {
+                    info.frame_buffer->store_pixel(y * dimensions.x + x, accumulation.get_mean(y * dimensions.x + x));
+                }
+            }
+        }
+
+#if defined(RSO_ENABLE_TRACE_STATS)
+        worker_stats[worker_index].merge(thread_trace_stats);
+        thread_trace_stats = {};
+#endif
+
+        // adaptive tiles continue for as long as they have unconverged pixels, past min_iterations
+        // their next iteration is scheduled with the next pass once every tile finished this one
+        const bool continue_tile = iteration < iteration_count && (!info.adaptive || unconverged_pixels > 0);
+        const bool wait_for_pass = info.adaptive && iteration >= min_iterations;
+        tile.done = !continue_tile;
+
+        if(info.target_noise > 0.0f)
+        {
+            f64 error_sum = 0.0;
+            u32 error_pixels = 0;
+            for(u32 y = tile.start.y; y < tile.end.y; y++)
             {
-                threads.push_back(std::thread(task, i * chunk, ((i+1) * chunk) + remainder, iteration));
+                for(u32 x = tile.start.x; x < tile.end.x; x++)
+                {
+                    if(!accumulation.has_relative_error(y * dimensions.x + x)) { continue; }
+                    error_sum += accumulation.get_relative_error(y * dimensions.x + x);
+                    error_pixels++;
+                }
             }
+            f64 image_error = image_error_sum.fetch_add(error_sum - tile.error_sum) + error_sum - tile.error_sum;
+            u32 image_pixels = image_error_pixels.fetch_add(error_pixels - tile.error_pixels) + error_pixels - tile.error_pixels;
+            tile.error_sum = error_sum;
+            tile.error_pixels = error_pixels;
+            // pixels report no error until their second iteration so the estimate is trusted only after that
+            if(completed_iterations.load() >= 2 && image_pixels > 0 && image_error / image_pixels <= info.target_noise) { stop(NOISE_TARGET); }
+        }
+
+        // finishing the iteration can schedule the next pass, the tile must not be touched after it
+        finish_iteration(iteration);
+        if(continue_tile && !wait_for_pass)
+        {
+            thread_pool.push(worker_index, [&, tile_index](u32 worker) { trace_tile(tile_index, worker); });
+        }
+        else if(!continue_tile)
+        {
+            // the tile is done, count it as finished for the iterations it skips so progress is still published
+            for(u32 skipped = iteration + 1; skipped <= iteration_count; skipped++) { finish_iteration(skipped); }
         }
-        for(int i = 0; i < num_threads; i++)
+    };
+
+    if(info.traversal_order == MORTON)
+    {
+        // contiguous runs of the curve per worker so each worker keeps to its own part of the image
+        const u32 worker_count = thread_pool.get_thread_count();
+        for(u32 i = 0; i < tiles.size(); i++)
         {
-            threads.at(i).join();
+            thread_pool.push(u32(u64(i) * worker_count / tiles.size()), [&, i](u32 worker) { trace_tile(i, worker); });
         }
-        threads.clear();
     }
+    else
+    {
+        std::vector<ThreadPool::Task> tasks;
+        tasks.reserve(tiles.size());
+        for(u32 i = 0; i < tiles.size(); i++)
+        {
+            tasks.push_back([&, i](u32 worker) { trace_tile(i, worker); });
+        }
+        thread_pool.submit(std::move(tasks));
+    }
+    thread_pool.wait_idle();
+
+    // pixels outside of the region keep the estimates of earlier traces, only the region is summarised
+    f64 region_error_sum = 0.0;
+    u32 region_error_pixels = 0;
+    for(u32 y = region_start.y; y < region_end.y; y++)
+    {
+        for(u32 x = region_start.x; x < region_end.x; x++)
+        {
+            if(!accumulation.has_relative_error(y * dimensions.x + x)) { continue; }
+            region_error_sum += accumulation.get_relative_error(y * dimensions.x + x);
+            region_error_pixels++;
+        }
+    }
+    TraceSummary summary = {
+        .stop_reason = stop_reason.load(),
+        .completed_iterations = completed_iterations.load(),
+        .total_samples = 0,
+        .seconds = 0.0,
+        .mean_relative_error = region_error_pixels > 0 ? region_error_sum / region_error_pixels : 0.0,
+        .error_coverage = region_error_pixels / pixel_count
+    };
+    for(const auto & stats : worker_stats) { summary.stats.merge(stats); }
+    if(info.cancel != nullptr && info.cancel->load()) { summary.stop_reason = CANCELLED; }
+    // tiles stopped by a policy do not finish the iteration they were on, publish the image they left
+    else if(summary.stop_reason != ITERATIONS_DONE && info.frame_buffer != nullptr) { info.frame_buffer->publish(); }
+    for(u32 iterations : accumulation.count) { summary.total_samples += u64(iterations) * info.samples; }
+    summary.seconds = std::chrono::duration<f64>(std::chrono::steady_clock::now() - start).count();
     std::cout << "scene trace done!" << std::endl;
+    return summary;
 }
 
-auto Raytracer::miss_ray(const Ray & ray) -> f64vec3
+template <typename T>
+auto RaytracerT<T>::miss_ray(const RayT<T> & ray) -> tvec3<T>
 {
-    u32 coord = active_scene->env_map.coord_1d_from_direction(ray.direction);
-    return {active_scene->env_map.image.at(coord),
-            active_scene->env_map.image.at(coord + 1),
-            active_scene->env_map.image.at(coord + 2)};
+    u32 coord = active_scene->env_map->coord_1d_from_direction(f64vec3(ray.direction));
+    return {active_scene->env_map->image.at(coord),
+            active_scene->env_map->image.at(coord + 1),
+            active_scene->env_map->image.at(coord + 2)};
 }
 
-auto Raytracer::get_ray_radiance(const GetRayRadianceInfo & info) -> f64vec3
+template <typename T>
+auto RaytracerT<T>::get_ray_radiance(const GetRayRadianceInfoT<T> & info) -> tvec3<T>
 {
-    f64 cos_theta_surface = glm::dot(info.prev_hit.normal, info.bounce_info.ray.direction);
-    if(cos_theta_surface <= 0.0) { return {0.0, 0.0, 0.0}; }
+    T cos_theta_surface = glm::dot(info.prev_hit.normal, info.bounce_info.ray.direction);
+    if(cos_theta_surface <= T(0.0))
+    {
+        TRACE_STAT(RADIANCE_SURFACE_BACKFACING);
+        return {0.0, 0.0, 0.0};
+    }
 
-    auto new_hit = trace_ray(info.bounce_info.ray);
+    TRACE_STAT(SECONDARY_RAYS);
+    HitInfo new_hit;
+    if(info.bounce_gen_method == TraceMethod::LIGHT_SOURCE)
+    {
+        const auto light_hit = trace_light_sample(info.bounce_info);
+        if(!light_hit.has_value())
+        {
+            TRACE_STAT(RADIANCE_OCCLUDED);
+            return {0.0, 0.0, 0.0};
+        }
+        new_hit = light_hit.value();
+    }
+    else
+    {
+        new_hit = trace_ray(info.bounce_info.ray);
+    }
 
-    f64vec3 Le = f64vec3(0.0, 0.0, 0.0);
-    f64vec3 new_hit_normal = f64vec3(0.0, 0.0, 0.0);
+    tvec3<T> Le = tvec3<T>(0.0, 0.0, 0.0);
+    tvec3<T> new_hit_normal = tvec3<T>(0.0, 0.0, 0.0);
 
-    if(new_hit.hit_distance == -1.0)
+    if(new_hit.hit_distance == T(-1.0))
     {
         // ray hit nothing in the scene
         if(active_scene->use_env_map)
@@ -93,10 +539,15 @@ auto Raytracer::get_ray_radiance(const GetRayRadianceInfo & info) -> f64vec3
             new_hit_normal = -info.bounce_info.ray.direction;
         }
         // if we are not using env map return 0
-        else { return {0.0, 0.0, 0.0}; }
+        else
+        {
+            TRACE_STAT(RADIANCE_MISS);
+            return {0.0, 0.0, 0.0};
+        }
     } 
-    else if (new_hit.hit_distance < EPSILON || new_hit.material->get_average_emmited_radiance() <= 0) {
+    else if (new_hit.hit_distance < EPSILON_V<T> || new_hit.material->get_average_emmited_radiance() <= 0) {
         // ray hit either too close or the material is not emmisive
+        TRACE_STAT(RADIANCE_NON_EMISSIVE);
         return {0.0, 0.0, 0.0};
     } 
     else {
@@ -105,27 +556,41 @@ auto Raytracer::get_ray_radiance(const GetRayRadianceInfo & info) -> f64vec3
         new_hit_normal = new_hit.normal;
     }
 
-    f64 distance_square = new_hit.hit_distance * new_hit.hit_distance;
-    f64 cos_theta_light = glm::dot(new_hit_normal, -info.bounce_info.ray.direction);
-    if(cos_theta_light <= EPSILON) { return {0.0, 0.0, 0.0}; }
+    T distance_square = new_hit.hit_distance * new_hit.hit_distance;
+    T cos_theta_light = glm::dot(new_hit_normal, -info.bounce_info.ray.direction);
+    if(cos_theta_light <= EPSILON_V<T>)
+    {
+        TRACE_STAT(RADIANCE_LIGHT_BACKFACING);
+        return {0.0, 0.0, 0.0};
+    }
 
-    f64vec3 brdf_factor = info.prev_hit.material->BRDF({ info.prev_hit.normal, -info.prev_ray.direction, info.bounce_info.ray.direction});
-    f64vec3 f = Le * brdf_factor * cos_theta_surface;
+    tvec3<T> brdf_factor = info.prev_hit.material->BRDF({ info.prev_hit.normal, -info.prev_ray.direction, info.bounce_info.ray.direction});
+    tvec3<T> f = Le * brdf_factor * cos_theta_surface;
     
-    f64 pdf_brdf_sampling = info.bounce_info.brdf_sample_prob;
-    if(pdf_brdf_sampling == 0 && info.bounce_gen_method == TraceMethod::BRDF) { return {0.0, 0.0, 0.0}; }
+    T pdf_brdf_sampling = info.bounce_info.brdf_sample_prob;
+    if(pdf_brdf_sampling == 0 && info.bounce_gen_method == TraceMethod::BRDF)
+    {
+        TRACE_STAT(RADIANCE_ZERO_PDF);
+        return {0.0, 0.0, 0.0};
+    }
 
-    f64 pdf_light_sampling = info.bounce_info.light_sample_prob;
+    T pdf_light_sampling = info.bounce_info.light_sample_prob;
     if(!active_scene->use_env_map) { pdf_light_sampling *= distance_square / cos_theta_light; }
-    if(new_hit.hit_distance > EPSILON && info.method == TraceMethod::BRDF)
+    if(new_hit.hit_distance > EPSILON_V<T> && info.method == TraceMethod::BRDF)
     {
-        auto power_to_total_ratio = std::visit(GetPower{}, *new_hit.object) / active_scene->total_power;
+        const f64 power = std::visit(GetPower{}, *new_hit.object);
+        // objects without power (emissive meshes) are never picked by light sampling and have no point probability
+        if(power <= 0.0) { pdf_light_sampling = 0.0; }
+        else
+        {
+            auto power_to_total_ratio = T(power / active_scene->total_power);
 
-        f64 light_sample_probability = std::visit(PointSampleProbability{new_hit.hit_position}, *new_hit.object);
-        pdf_light_sampling = (power_to_total_ratio / light_sample_probability) * distance_square / cos_theta_light;
+            T light_sample_probability = std::visit(PointSampleProbabilityT<T>{new_hit.hit_position}, *new_hit.object);
+            pdf_light_sampling = (power_to_total_ratio / light_sample_probability) * distance_square / cos_theta_light;
+        }
     } 
 
-    f64 final_pdf = 0.0;
+    T final_pdf = 0.0;
     if(info.method == TraceMethod::MULTI_IMPORTANCE_WEIGHTS)      { final_pdf = pdf_brdf_sampling + pdf_light_sampling; }
     else if (info.bounce_gen_method == TraceMethod::BRDF)         { final_pdf = pdf_brdf_sampling; }
     else if (info.bounce_gen_method == TraceMethod::LIGHT_SOURCE) { final_pdf = pdf_light_sampling; }
@@ -133,19 +598,14 @@ auto Raytracer::get_ray_radiance(const GetRayRadianceInfo & info) -> f64vec3
     return f / (final_pdf);
 }
 
-auto Raytracer::ray_gen(const Ray & ray, const TraceInfo & info) -> Pixel
+template <typename T>
+auto RaytracerT<T>::ray_gen(const RayT<T> & ray, const HitInfo & hit, const TraceInfo & info, Sampler & sampler) -> Pixel
 {
-    auto hit = trace_ray(ray);
-    if(hit.hit_distance < 0.0) 
-    {
-        if(active_scene->use_env_map) { return Pixel(miss_ray(ray)); }
-        else { return Pixel(0.0, 0.0, 0.0); }
-    }
-
-    f64vec3 radiance_emitted = hit.material->Le;
+    tvec3<T> radiance_emitted = hit.material->Le;
     // if albedo is low no energy will be reflected return only energy emitted by the material
-    if(hit.material->get_average_diffuse_albedo() < EPSILON && hit.material->get_average_specular_albedo() < EPSILON )
+    if(hit.material->get_average_diffuse_albedo() < EPSILON_V<T> && hit.material->get_average_specular_albedo() < EPSILON_V<T> )
     {
+        TRACE_STAT(NON_REFLECTIVE_HITS);
         return Pixel(radiance_emitted);
     }
 
@@ -153,32 +613,44 @@ auto Raytracer::ray_gen(const Ray & ray, const TraceInfo & info) -> Pixel
     for(int i = 0; i < info.samples; i++)
     {
         TraceMethod bounce_method = i < brdf_sample_threshold ? TraceMethod::LIGHT_SOURCE : TraceMethod::BRDF;
-        const auto bounce_info_opt = bounced_ray({.hit = hit, .incoming_ray = ray, .method = bounce_method});
+        sampler.start_sample(i);
+        TRACE_STAT(bounce_method == TraceMethod::LIGHT_SOURCE ? LIGHT_SOURCE_SAMPLES : BRDF_SAMPLES);
+        const auto bounce_info_opt = bounced_ray({.hit = hit, .incoming_ray = ray, .method = bounce_method, .sampler = sampler});
 
-        if( !bounce_info_opt.has_value()) { continue; }
+        if( !bounce_info_opt.has_value())
+        {
+            TRACE_STAT(bounce_method == TraceMethod::LIGHT_SOURCE ? LIGHT_SOURCE_WASTED : BRDF_WASTED);
+            continue;
+        }
         const auto bounce_info = bounce_info_opt.value();
 
-        f64vec3 ray_radiance = get_ray_radiance({
+        tvec3<T> ray_radiance = get_ray_radiance({
             .bounce_info = bounce_info,
             .prev_ray = ray,
             .prev_hit = hit,
             .method = info.method,
             .bounce_gen_method = bounce_method
         });
-        radiance_emitted += ray_radiance / static_cast<f64>(info.samples);
+        if(TRACE_STATS_ENABLED && ray_radiance == tvec3<T>(0.0))
+        {
+            TRACE_STAT(bounce_method == TraceMethod::LIGHT_SOURCE ? LIGHT_SOURCE_WASTED : BRDF_WASTED);
+        }
+        radiance_emitted += ray_radiance / static_cast<T>(info.samples);
     }
 
     return static_cast<Pixel>(radiance_emitted);
 }
 
-auto Raytracer::bounced_ray(const GetBouncedRayInfo & info) const -> std::optional<BouncedRayInfo>
+template <typename T>
+auto RaytracerT<T>::bounced_ray(const GetBouncedRayInfoT<T> & info) const -> std::optional<BouncedRayInfoT<T>>
 {
-    auto get_new_lightsource_sample_env = [&]() -> BouncedRayInfo
+    auto get_new_lightsource_sample_env = [&]() -> BouncedRayInfoT<T>
     {
-        f32vec3 direction = active_scene->env_map.sample_direction();
+        f32vec3 sampled_direction = active_scene->env_map->sample_direction(info.sampler);
+        tvec3<T> direction = tvec3<T>(sampled_direction);
         return {
-            .ray = Ray(info.hit.hit_position + 0.01 * info.hit.normal, direction),
-            .light_sample_prob = active_scene->env_map.sample_probability(direction) * active_scene->env_map.width * active_scene->env_map.height,
+            .ray = RayT<T>(info.hit.hit_position + T(0.01) * info.hit.normal, direction),
+            .light_sample_prob = T(active_scene->env_map->sample_probability(sampled_direction) * active_scene->env_map->width * active_scene->env_map->height),
             .brdf_sample_prob = info.hit.material->sample_probability({
                 .normal = info.hit.normal,
                 .view_direction = -info.incoming_ray.direction,
@@ -186,51 +658,44 @@ auto Raytracer::bounced_ray(const GetBouncedRayInfo & info) const -> std::option
             })
         };
     };
-    auto get_new_lightsource_sample = [&]() -> BouncedRayInfo
+    auto get_new_lightsource_sample = [&]() -> std::optional<BouncedRayInfoT<T>>
     {
-        while(true)
+        if(active_scene->emitters.empty())
         {
-            f64 threshold = active_scene->total_power * get_random_double();
-            f64 running_power = 0.0;
-            if(active_scene->use_env_map)
-            {
-                return {};
-            } 
-            else 
-            {
-                for(const auto & object : active_scene->scene_objects)
-                {
-                    running_power += std::visit(GetPower{}, object);
-                    if(running_power > threshold)
-                    {
-                        const auto light_sample = std::visit(VisiblePoint{info.hit.hit_position}, object );
-                        const auto power_to_total_ratio = std::visit(GetPower{}, object) / active_scene->total_power;
-                        const Ray bounced_ray = Ray(info.hit.hit_position + 0.01 * info.hit.normal, light_sample.sample - info.hit.hit_position);
-
-                        const f64 brdf_probability = info.hit.material->sample_probability({
-                            .normal = info.hit.normal,
-                            .view_direction = -info.incoming_ray.direction,
-                            .light_direction = bounced_ray.direction
-                        });
-
-                        return BouncedRayInfo{
-                            .ray = bounced_ray,
-                            .light_sample_prob = power_to_total_ratio / std::visit(PointSampleProbability{light_sample.sample}, object),
-                            .brdf_sample_prob = brdf_probability
-                        };
-                    }
-                }
-            }
+            TRACE_STAT(NO_EMITTERS);
+            return std::nullopt;
         }
+
+        // pick the emitter with probability proportional to its power
+        const auto emitter_sample = active_scene->emitter_table.sample(info.sampler.get_random_double());
+        const Scene::Emitter & emitter = active_scene->emitters[emitter_sample.index];
+        const ObjectT<T> & object = (*objects)[emitter.object_index];
+
+        const auto light_sample = std::visit(VisiblePointT<T>{info.hit.hit_position, info.sampler}, object);
+        const T power_to_total_ratio = T(emitter.power / active_scene->total_power);
+        const RayT<T> bounced_ray = RayT<T>(info.hit.hit_position + T(0.01) * info.hit.normal, light_sample.sample - info.hit.hit_position);
+
+        const T brdf_probability = info.hit.material->sample_probability({
+            .normal = info.hit.normal,
+            .view_direction = -info.incoming_ray.direction,
+            .light_direction = bounced_ray.direction
+        });
+
+        return BouncedRayInfoT<T>{
+            .ray = bounced_ray,
+            .light_sample_prob = power_to_total_ratio / std::visit(PointSampleProbabilityT<T>{light_sample.sample}, object),
+            .brdf_sample_prob = brdf_probability,
+            .light_object = &object
+        };
     };
 
-    auto get_new_brdf_sample = [&]() -> std::optional<BouncedRayInfo>
+    auto get_new_brdf_sample = [&]() -> std::optional<BouncedRayInfoT<T>>
     {
-        auto ray_dir = info.hit.material->sample_direction(info.hit.normal, -info.incoming_ray.direction);
+        auto ray_dir = info.hit.material->sample_direction(info.hit.normal, -info.incoming_ray.direction, info.sampler);
         if(!ray_dir.has_value()) { return std::nullopt; }
 
-        const Ray bounced_ray = Ray(info.hit.hit_position, ray_dir.value());
-        const f64 brdf_probability = info.hit.material->sample_probability({
+        const RayT<T> bounced_ray = RayT<T>(info.hit.hit_position, ray_dir.value());
+        const T brdf_probability = info.hit.material->sample_probability({
             .normal = info.hit.normal,
             .view_direction = -info.incoming_ray.direction,
             .light_direction = bounced_ray.direction
@@ -239,10 +704,10 @@ auto Raytracer::bounced_ray(const GetBouncedRayInfo & info) const -> std::option
 
         if(active_scene->use_env_map)
         {
-            light_sample_prob = active_scene->env_map.sample_probability(bounced_ray.direction) * active_scene->env_map.width * active_scene->env_map.height;
+            light_sample_prob = active_scene->env_map->sample_probability(f64vec3(bounced_ray.direction)) * active_scene->env_map->width * active_scene->env_map->height;
         }
 
-        return BouncedRayInfo{
+        return BouncedRayInfoT<T>{
             .ray = bounced_ray,
             .light_sample_prob = light_sample_prob,
             .brdf_sample_prob = brdf_probability
@@ -274,20 +739,57 @@ auto Raytracer::bounced_ray(const GetBouncedRayInfo & info) const -> std::option
     }
 }
 
-auto Raytracer::trace_ray(const Ray & ray) -> Intersect::HitInfo
+template <typename T>
+auto RaytracerT<T>::trace_ray(const RayT<T> & ray) -> HitInfo
 {
-    Intersect::HitInfo closest_hit {};
-    for(const auto & object : active_scene->scene_objects)
-    {
-        Intersect::HitInfo hit = std::visit(Intersect{ray}, object);
-        if(active_scene->use_env_map == true && std::holds_alternative<Sphere>(object)) { continue; }
+    return bvh->closest_hit(typename BVHT<T>::TraceInfo{
+        .ray = ray,
+        .objects = *objects,
+        .skip_spheres = active_scene->use_env_map
+    });
+}
 
-        if(hit.hit_distance < EPSILON) { continue; }
-        if(closest_hit.hit_distance < 0.0 || hit.hit_distance < closest_hit.hit_distance)
-        {
-            closest_hit = hit;
-            closest_hit.object = &object;
-        }
+template <typename T>
+auto RaytracerT<T>::occluded(const RayT<T> & ray, T max_distance) -> bool
+{
+    return bvh->occluded(typename BVHT<T>::TraceInfo{
+        .ray = ray,
+        .objects = *objects,
+        .skip_spheres = active_scene->use_env_map
+    }, max_distance);
+}
+
+template <typename T>
+auto RaytracerT<T>::trace_light_sample(const BouncedRayInfoT<T> & bounce_info) -> std::optional<HitInfo>
+{
+    TRACE_STAT(SHADOW_RAYS);
+    // env map sample - the sampled direction only contributes when the ray leaves the scene
+    if(bounce_info.light_object == nullptr)
+    {
+        if(occluded(bounce_info.ray, T(INFINITY))) { return std::nullopt; }
+        return HitInfo{};
     }
-    return closest_hit;
-}
\ No newline at end of file
+
+    // emitter sample - the closest hit on the emitter is exactly what trace_ray finds unless something
+    // lies in front of it, a blocker which is itself emissive was sampled with a different pdf and is dropped
+    TRACE_STAT(OBJECT_TESTS);
+    HitInfo light_hit = std::visit(IntersectT<T>{bounce_info.ray}, *bounce_info.light_object);
+    if(light_hit.hit_distance < EPSILON_V<T>) { return light_hit; }
+    if(occluded(bounce_info.ray, light_hit.hit_distance)) { return std::nullopt; }
+    light_hit.object = bounce_info.light_object;
+    return light_hit;
+}
+
+template <typename T>
+auto RaytracerT<T>::trace_ray_packet(const RayPacket & packet) -> std::array<HitInfo, PACKET_SIZE>
+    requires std::is_same_v<T, f64>
+{
+    return bvh->closest_hit(typename BVHT<T>::PacketTraceInfo{
+        .packet = packet,
+        .objects = *objects,
+        .skip_spheres = active_scene->use_env_map
+    });
+}
+
+template struct RaytracerT<f32>;
+template struct RaytracerT<f64>;
\ No newline at end of file
@@ -1,8 +1,14 @@
 #pragma once
 
+#include <atomic>
 #include <stdexcept>
 
+#include "accumulation_buffer.hpp"
+#include "frame_buffer.hpp"
+#include "primary_hit_buffer.hpp"
 #include "scene.hpp"
+#include "thread_pool.hpp"
+#include "trace_stats.hpp"
 #include "types.hpp"
 
 
@@ -14,70 +20,221 @@ enum TraceMethod
     MULTI_IMPORTANCE_WEIGHTS
 };
 
-struct BouncedRayInfo
+// order in which the tiles of the image and the 2x2 pixel quads inside each tile are traced
+enum TraversalOrder
 {
-    Ray ray {{0.0, 0.0, 0.0} , {0.0, 0.0, 0.0}};
-    f64 light_sample_prob = 0.0;
-    f64 brdf_sample_prob = 0.0;
+    SCANLINE,
+    // Z-order curve, neighbouring rays stay close in screen space so the BVH nodes, materials
+    // and env map texels they touch are still in the caches, each worker gets a contiguous part of the curve
+    MORTON
 };
 
-struct GetRayRadianceInfo
+// the condition which ended a trace_scene call
+enum TraceStopReason
 {
-    BouncedRayInfo bounce_info;
-    Ray prev_ray;
-    Intersect::HitInfo prev_hit;
+    ITERATIONS_DONE,
+    TIME_BUDGET,
+    NOISE_TARGET,
+    CANCELLED
+};
+
+template <typename T>
+struct BouncedRayInfoT
+{
+    RayT<T> ray {{0.0, 0.0, 0.0} , {0.0, 0.0, 0.0}};
+    T light_sample_prob = 0.0;
+    T brdf_sample_prob = 0.0;
+    // emitter the light sample was taken on, the ray is intersected with it directly and the rest of the
+    // scene is only tested for occlusion - null for brdf samples and samples of the env map
+    const ObjectT<T> * light_object = nullptr;
+};
+using BouncedRayInfo = BouncedRayInfoT<f64>;
+
+template <typename T>
+struct GetRayRadianceInfoT
+{
+    BouncedRayInfoT<T> bounce_info;
+    RayT<T> prev_ray;
+    typename IntersectT<T>::HitInfo prev_hit;
     TraceMethod method;
     TraceMethod bounce_gen_method;
 };
+using GetRayRadianceInfo = GetRayRadianceInfoT<f64>;
 
-
-struct GetBouncedRayInfo
+template <typename T>
+struct GetBouncedRayInfoT
 {
-    const Intersect::HitInfo & hit;
-    const Ray & incoming_ray;
+    const typename IntersectT<T>::HitInfo & hit;
+    const RayT<T> & incoming_ray;
     TraceMethod method;
+    Sampler & sampler;
 };
+using GetBouncedRayInfo = GetBouncedRayInfoT<f64>;
 
-struct Raytracer
+/// @brief Renders the scene with all shading math in the precision T, the scene itself is
+/// always stored in double precision and is converted once per trace_scene call for f32
+template <typename T>
+struct RaytracerT
 {
+    using HitInfo = typename IntersectT<T>::HitInfo;
+
     struct TraceInfo
     {
         u32 samples = 100;
         u32 iterations = 10;
         TraceMethod method = LIGHT_SOURCE;
+        // renders with the same seed are identical regardless of the number of threads used
+        u32 seed = 123;
+        // trace the primary rays of 2x2 pixel quads together as SIMD packets, double precision only
+        bool use_ray_packets = true;
+        // keep the primary hits in primary_hits and shade them again in the following iterations and
+        // traces instead of intersecting the camera rays every time
+        bool cache_primary_hits = true;
+        // edge of the square tiles which are the unit of work of the worker threads
+        u32 tile_size = 16;
+        TraversalOrder traversal_order = SCANLINE;
+        // adaptive sampling - once a pixel has min_iterations estimates and its relative error is below
+        // target_relative_error it stops being traced, the iterations it saves out of the
+        // iterations * pixel count budget are spent on the pixels which are still noisy, one iteration per
+        // pass in pixel order so the image does not depend on the thread count
+        bool adaptive = false;
+        f32 target_relative_error = 0.02f;
+        u32 min_iterations = 4;
+        // upper bound on the iterations a single pixel can receive in adaptive mode
+        u32 max_iterations = 64;
+        // termination policies - the render stops at the next tile boundary once the wall clock
+        // time in seconds runs out or the mean relative error of the image drops below target_noise,
+        // iterations stays the upper bound, 0 disables the policy - the first iteration of every tile is
+        // always finished so the time budget can be overrun by up to one iteration
+        f64 time_budget = 0.0;
+        f32 target_noise = 0.0f;
+        // optional - receives the resolved image every time all tiles finish an iteration
+        FrameBuffer * frame_buffer = nullptr;
+        // optional - when set the render stops after the tiles currently in flight
+        const std::atomic<bool> * cancel = nullptr;
+        // optional - only the pixels in [region_start, region_end) are cleared and traced, used to split a frame
+        // between several processes, the other pixels keep the estimates of earlier traces and the adaptive
+        // budget is shared by the pixels of the region only - an empty region traces the whole image
+        u32vec2 region_start = {0, 0};
+        u32vec2 region_end = {0, 0};
     };
 
     struct Pixel
     {
-        f64 R = 0.0;
-        f64 G = 0.0;
-        f64 B = 0.0;
+        T R = 0.0;
+        T G = 0.0;
+        T B = 0.0;
 
         Pixel() = default;
-        Pixel(const f64 & R, const f64 & G, const f64 & B) : R{R}, G{G}, B{B} {}
-        explicit Pixel(const f64vec3 & color) : R{color.r}, G{color.g}, B{color.b} {}
-        Pixel operator *(const f64 val) { f64vec3 tmp{R, G, B}; return static_cast<Pixel>(tmp * val); }
+        Pixel(const T & R, const T & G, const T & B) : R{R}, G{G}, B{B} {}
+        explicit Pixel(const tvec3<T> & color) : R{color.r}, G{color.g}, B{color.b} {}
+        Pixel operator *(const T val) { tvec3<T> tmp{R, G, B}; return static_cast<Pixel>(tmp * val); }
         Pixel operator +(const Pixel & other) { return { R + other.R, G + other.G, B + other.B }; }
     };
 
-    std::vector<Pixel> result_image;
+    struct TraceSummary
+    {
+        TraceStopReason stop_reason = ITERATIONS_DONE;
+        // iterations finished by every tile, tiles stopped by a policy may be one iteration ahead
+        u32 completed_iterations = 0;
+        // samples traced over all pixels
+        u64 total_samples = 0;
+        f64 seconds = 0.0;
+        // averaged over the pixels with at least two iterations, error_coverage is their fraction of the traced pixels
+        f64 mean_relative_error = 0.0;
+        f64 error_coverage = 0.0;
+        // counters merged from all worker threads, all zero when built without RSO_ENABLE_TRACE_STATS
+        TraceStats stats = {};
+    };
+
+    // iteration estimates of the last trace, resolve pixels with get_pixel
+    AccumulationBuffer accumulation;
+    // primary hits of the pixels traced with cache_primary_hits, stays valid until the camera, the scene
+    // or its env map change, empty until the first trace which uses it
+    PrimaryHitBufferT<T> primary_hits;
 
-    Raytracer(const u32vec2 dimensions);
+    // thread_count = 0 uses one worker thread per hardware thread
+    RaytracerT(const u32vec2 dimensions, u32 thread_count = 0);
 
     void set_sample_ratio(f32 sample_ratio);
-    void trace_scene(Scene * scene, const TraceInfo & info);
+    // the cached primary hits (and for f32 the converted scene) are rebuilt when the camera, the scene or its
+    // env map change, objects or materials which are modified in place need to invalidate them
+    void invalidate_primary_hits();
+    auto trace_scene(Scene * scene, const TraceInfo & info) -> TraceSummary;
+    // mean of the iterations accumulated in the pixel
+    [[nodiscard]] inline auto get_pixel(u32 pixel_index) const -> Pixel { return Pixel(tvec3<T>(accumulation.get_mean(pixel_index))); }
 
     private:
+        struct Tile
+        {
+            u32vec2 start;
+            u32vec2 end;
+            // last iteration traced for this tile, tiles progress through the iterations independently
+            u32 iteration = 0;
+            // sum of the relative errors of the tile pixels and the number of pixels which have one,
+            // only tracked for the noise target
+            f64 error_sum = 0.0;
+            u32 error_pixels = 0;
+            // adaptive tile without unconverged pixels or budget left, it is not scheduled again
+            bool done = false;
+        };
+
+        // state of the scene the cached primary hits were traced with
+        struct PrimaryHitKey
+        {
+            const Scene * scene = nullptr;
+            const EnvironmentMap * env_map = nullptr;
+            bool use_env_map = false;
+            f64vec3 camera_origin = {0.0, 0.0, 0.0};
+            f64vec3 camera_look_at = {0.0, 0.0, 0.0};
+            f64vec3 camera_right = {0.0, 0.0, 0.0};
+            f64vec3 camera_up = {0.0, 0.0, 0.0};
+            f64 camera_fov = 0.0;
+            // the aspect ratio of the camera rays follows from the image dimensions
+            u32vec2 dimensions = {0, 0};
+            size_t object_count = 0;
+            size_t material_count = 0;
+
+            auto operator==(const PrimaryHitKey & other) const -> bool = default;
+        };
 
-        std::vector<Pixel> working_image;
         f32 sample_ratio;
         u32vec2 dimensions;
         // TODO(msakmary) think of a way to store active scene better
         Scene * active_scene;
-
-        auto ray_gen(const Ray & ray, const TraceInfo & info) -> Pixel;
-        auto trace_ray(const Ray & ray) -> Intersect::HitInfo;
-        auto miss_ray(const Ray & ray) -> f64vec3;
-        auto bounced_ray(const GetBouncedRayInfo & info) const -> std::optional<BouncedRayInfo>;
-        auto get_ray_radiance(const GetRayRadianceInfo & info) -> f64vec3;
+        // scene geometry in the precision of the raytracer - for f64 these point directly into the
+        // active scene, for f32 into the converted copies below
+        const std::vector<ObjectT<T>> * objects;
+        const std::vector<MaterialT<T>> * materials;
+        const BVHT<T> * bvh;
+        std::vector<MaterialT<T>> converted_materials;
+        std::vector<ObjectT<T>> converted_objects;
+        BVHT<T> converted_bvh;
+        // scene the converted copies were made from, traces of the same scene reuse them
+        const Scene * converted_scene = nullptr;
+        size_t converted_object_count = 0;
+        size_t converted_material_count = 0;
+        std::vector<Tile> tiles;
+        PrimaryHitKey primary_hit_key;
+        // worker threads live as long as the raytracer so they are not recreated for every iteration
+        ThreadPool thread_pool;
+
+        // points objects and bvh to the scene geometry in the precision of the raytracer, f32 converts the
+        // scene only when it differs from the one of the previous trace
+        void prepare_scene(Scene * scene);
+        // splits the region of the image into tiles stored in the order they are traced
+        void build_tiles(u32 tile_size, TraversalOrder order, u32vec2 region_start, u32vec2 region_end);
+        // shades the primary hit of the ray, the radiance of misses is resolved by the caller
+        auto ray_gen(const RayT<T> & ray, const HitInfo & hit, const TraceInfo & info, Sampler & sampler) -> Pixel;
+        auto trace_ray(const RayT<T> & ray) -> HitInfo;
+        // any hit test of the scene in [EPSILON, max_distance)
+        auto occluded(const RayT<T> & ray, T max_distance) -> bool;
+        // the hit trace_ray would return for a ray generated by light sampling, nullopt when the
+        // light is blocked
+        auto trace_light_sample(const BouncedRayInfoT<T> & bounce_info) -> std::optional<HitInfo>;
+        auto trace_ray_packet(const RayPacket & packet) -> std::array<HitInfo, PACKET_SIZE> requires std::is_same_v<T, f64>;
+        auto miss_ray(const RayT<T> & ray) -> tvec3<T>;
+        auto bounced_ray(const GetBouncedRayInfoT<T> & info) const -> std::optional<BouncedRayInfoT<T>>;
+        auto get_ray_radiance(const GetRayRadianceInfoT<T> & info) -> tvec3<T>;
 };
+using Raytracer = RaytracerT<f64>;
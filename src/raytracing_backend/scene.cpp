@@ -1,47 +1,65 @@
 #include "scene.hpp"
+#include "mesh.hpp"
+#include "trace_stats.hpp"
 
 #include <iostream>
+#include <array>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <type_traits>
+#include <unordered_map>
 
-void EnvironmentMap::ProbabilityColumn::init(const std::span<f64> column, f64 total_col_intensity) 
+auto EnvironmentMap::ProbabilityColumn::sample(f64 u) const -> SampleRet
 {
-    samples_cnt = std::vector<i32>(column.size(),0);
-    CDF = std::vector<f64>(column.size() + 1);
-    probability.reserve(column.size());
-    std::copy(column.begin(), column.end(), std::back_inserter(probability));
+    auto sample = std::lower_bound(CDF.begin(), CDF.end(), glm::clamp(u * column_sum, 0.0, CDF.back())); 
+    i32 offset = sample == CDF.end() ? CDF.size() - 3 : i32(std::distance(CDF.begin(), sample) - 1);
+    f64 g = (u - CDF[offset] / (CDF[offset + 1] - CDF[offset]));
+    g = glm::clamp(g, 0.0, 1.0);
 
-    for(int i = 0; i < column.size(); i++)
-    {
-        CDF.at(i + 1) = (CDF.at(i) + column[i]);
-    }
-    column_sum = total_col_intensity;
+    return {
+        .sample = f64(offset) + g,
+        .probability = probability[offset] / column_sum
+    };
 }
 
-auto EnvironmentMap::ProbabilityColumn::sample(f64 u) -> SampleRet
+auto EnvironmentMap::get_top_level() -> ProbabilityColumn
 {
-    auto sample = std::lower_bound(CDF.begin(), CDF.end(), glm::clamp(u * column_sum, 0.0, CDF.at(CDF.size() - 1))); 
-    i32 offset = sample == CDF.end() ? CDF.size() - 3 : i32(std::distance(CDF.begin(), sample) - 1);
-    samples_cnt.at(offset) += 1;
-    f64 g = (u - CDF.at(offset) / (CDF.at(offset + 1) - CDF.at(offset)));
-    g = glm::clamp(g, 0.0, 1.0);
+    return {
+        .CDF = std::span<const f64>(cdf_data.begin(), width + 1),
+        .probability = column_power,
+        .column_sum = total_power
+    };
+}
 
+auto EnvironmentMap::get_column(u32 x) -> ProbabilityColumn
+{
     return {
-        .sample = f64(offset) + g,
-        .probability = probability.at(offset) / column_sum
+        .CDF = std::span<const f64>(cdf_data.begin() + (width + 1) + x * (height + 1), height + 1),
+        .probability = std::span<const f64>(lum_image.begin() + x * height, height),
+        .column_sum = column_power.at(x)
     };
 }
 
+// running sum of the values starting with zero, cdf has one more element than values
+static void build_cdf(std::span<const f64> values, std::span<f64> cdf)
+{
+    cdf[0] = 0.0;
+    for(size_t i = 0; i < values.size(); i++) { cdf[i + 1] = cdf[i] + values[i]; }
+}
+
 void EnvironmentMap::init()
 {
     lum_image = std::vector<f64>(width * height);
-    columns = std::vector<ProbabilityColumn>(width);
-    std::vector<f64> top_level_intensities(width);
+    column_power = std::vector<f64>(width);
+    cdf_data = std::vector<f64>((width + 1) + width * (height + 1));
     total_power = 0.0f;
 
-    for(size_t x = 0; x < width; x++)
+    for(i32 x = 0; x < width; x++)
     {
         f64 total_col_intensity = 0;
-        f64 CDF = 0;
-        for(size_t y = 0; y < height; y++)
+        for(i32 y = 0; y < height; y++)
         {
             // y = 0        -> angle = 0
             // y = height/2 -> angle = pi/2
@@ -62,10 +80,21 @@ void EnvironmentMap::init()
             total_power += lum_image.at(luminance_idx);
             total_col_intensity += lum_image.at(luminance_idx);
         }
-        top_level_intensities.at(x) = total_col_intensity; 
-        columns.at(x).init(std::span<f64>(lum_image.begin() + x * height, height), total_col_intensity);
+        column_power.at(x) = total_col_intensity; 
+        build_cdf(
+            std::span<const f64>(lum_image.begin() + x * height, height),
+            std::span<f64>(cdf_data.begin() + (width + 1) + x * (height + 1), height + 1));
+    }
+    build_cdf(column_power, std::span<f64>(cdf_data.begin(), width + 1));
+
+    column_alias.init(column_power);
+    row_alias = std::vector<AliasEntry>(width * height);
+    for(i32 x = 0; x < width; x++)
+    {
+        build_alias_table(
+            std::span<const f64>(lum_image.begin() + x * height, height),
+            std::span<AliasEntry>(row_alias.begin() + x * height, height));
     }
-    top_level.init(std::span<f64>(top_level_intensities.begin(), top_level_intensities.size()), total_power);
 
     // image = std::vector<f32>(width * height * 3);
     // for(int i = 0; i < 100000; i++)
@@ -117,24 +146,48 @@ auto EnvironmentMap::sample_probability(const f64vec3 direction) -> f64
     u32vec2 uv = res.first;
     f64 theta = res.second;
 
-    f64 pdf = (top_level.probability.at(uv.x) * columns.at(uv.x).probability.at(uv.y)) /
-              (top_level.column_sum * columns.at(uv.x).column_sum) * 
+    f64 pdf = (column_power.at(uv.x) * lum_image.at(uv.x * height + uv.y)) /
+              (f64(total_power) * column_power.at(uv.x)) * 
               ( 1.0 / (2.0 * M_PI * M_PI * sin(theta)));
     return pdf;
 }
 
-auto EnvironmentMap::sample_direction() -> f64vec3
+auto EnvironmentMap::sample_direction(Sampler & sampler) -> f64vec3
+{
+    TRACE_STAT(ENV_MAP_SAMPLES);
+    if(sampling_method == EnvMapSampling::ALIAS) { return sample_direction_alias(sampler); }
+    return sample_direction_cdf(sampler);
+}
+
+auto EnvironmentMap::sample_direction_alias(Sampler & sampler) const -> f64vec3
 {
-    f64 rand_one = get_random_double();
-    f64 rand_two = get_random_double();
-    auto row_sample = top_level.sample(rand_one);
+    f64 rand_one = sampler.get_random_double();
+    f64 rand_two = sampler.get_random_double();
+    auto column_sample = column_alias.sample(rand_one);
+    auto row_sample = sample_alias_table(
+        std::span<const AliasEntry>(row_alias.begin() + column_sample.index * height, height), rand_two);
 
-    i32 row_idx = glm::clamp(i32(row_sample.sample), 0, i32(top_level.CDF.size() - 2));
-    auto column_sample = columns.at(row_idx).sample(rand_two);
+    // the remainders place the direction uniformly inside of the selected texel, this matches
+    // the texel lookup in coords_2d_from_direction used by sample_probability
+    f64 theta = (f64(row_sample.index) + row_sample.remainder) / f64(height) * M_PI;
+    f64 phi = (f64(column_sample.index) + column_sample.remainder) / f64(width) * M_PI * 2.0;
+    f64 sin_theta = glm::sin(theta);
 
+    return f64vec3(sin_theta * glm::cos(phi), sin_theta * glm::sin(phi), glm::cos(theta));
+}
 
-    f64 theta = column_sample.sample / (columns.at(row_idx).CDF.size() - 2) * M_PI;
-    f64 phi = row_sample.sample / (top_level.CDF.size() - 2) * M_PI * 2.0f;
+auto EnvironmentMap::sample_direction_cdf(Sampler & sampler) -> f64vec3
+{
+    f64 rand_one = sampler.get_random_double();
+    f64 rand_two = sampler.get_random_double();
+    auto row_sample = get_top_level().sample(rand_one);
+
+    i32 row_idx = glm::clamp(i32(row_sample.sample), 0, width - 1);
+    auto column_sample = get_column(row_idx).sample(rand_two);
+
+
+    f64 theta = column_sample.sample / (height - 1) * M_PI;
+    f64 phi = row_sample.sample / (width - 1) * M_PI * 2.0f;
     f64 cos_theta = glm::cos(theta);
     f64 sin_theta = glm::sin(theta);
     f64 cos_phi = glm::cos(phi);
@@ -145,25 +198,681 @@ auto EnvironmentMap::sample_direction() -> f64vec3
     return out_dir;
 }
 
-Scene::Scene(const Camera & camera) : camera{camera}, total_power{0.0}, use_env_map{true}
+#pragma region env_map_cache
+// the cache is a header followed by the arrays returned by get_cache_sections, every array
+// starts at a cache line boundary so the file can also be mapped into memory and used in place
+const std::array<char, 8> ENV_MAP_CACHE_MAGIC = {'R', 'S', 'O', 'E', 'N', 'V', 'M', 'P'};
+// needs to be increased whenever the layout or the content of the tables changes
+const u32 ENV_MAP_CACHE_VERSION = 1;
+const u64 ENV_MAP_CACHE_ALIGNMENT = 64;
+
+struct EnvMapCacheHeader
+{
+    std::array<char, 8> magic;
+    u32 version;
+    i32 width;
+    i32 height;
+    f32 total_power;
+    // size of the source .hdr file, guards against a source replaced by an older file
+    u64 source_size;
+};
+
+static auto align_cache_offset(u64 offset) -> u64
+{
+    return (offset + ENV_MAP_CACHE_ALIGNMENT - 1) / ENV_MAP_CACHE_ALIGNMENT * ENV_MAP_CACHE_ALIGNMENT;
+}
+
+// raw bytes of all cached arrays in the order in which they are stored in the file
+template <typename EnvMap>
+static auto get_cache_sections(EnvMap & map)
+{
+    using Byte = std::conditional_t<std::is_const_v<EnvMap>, const char, char>;
+    auto section = [](auto & data) { return std::span<Byte>(reinterpret_cast<Byte *>(data.data()), data.size() * sizeof(data[0])); };
+    return std::array{
+        section(map.image),
+        section(map.lum_image),
+        section(map.column_power),
+        section(map.cdf_data),
+        section(map.column_alias.entries),
+        section(map.row_alias)
+    };
+}
+
+auto EnvironmentMap::load_cache(const std::string & cache_path, const std::string & source_path) -> bool
+{
+    std::error_code error;
+    auto cache_time = std::filesystem::last_write_time(cache_path, error);
+    if(error) { return false; }
+    auto source_time = std::filesystem::last_write_time(source_path, error);
+    if(error || cache_time <= source_time) { return false; }
+    u64 source_size = std::filesystem::file_size(source_path, error);
+    if(error) { return false; }
+    u64 cache_size = std::filesystem::file_size(cache_path, error);
+    if(error) { return false; }
+
+    std::ifstream cache_file(cache_path, std::ios::binary);
+    EnvMapCacheHeader header;
+    if(!cache_file.read(reinterpret_cast<char *>(&header), sizeof(header))) { return false; }
+    if(header.magic != ENV_MAP_CACHE_MAGIC || header.version != ENV_MAP_CACHE_VERSION ||
+       header.source_size != source_size || header.width <= 0 || header.height <= 0)
+    {
+        return false;
+    }
+
+    // the header is validated against the file size before anything is allocated so a corrupt
+    // cache falls back to decoding the .hdr instead of allocating whatever the header claims
+    const u64 cache_width = u64(header.width);
+    const u64 cache_height = u64(header.height);
+    const u64 pixel_count = cache_width * cache_height;
+    // every pixel takes more than a byte, also keeps the section sizes below from overflowing
+    if(pixel_count > cache_size) { return false; }
+    // byte sizes of the arrays in the order of get_cache_sections
+    const std::array<u64, 6> section_sizes = {
+        pixel_count * 3 * sizeof(decltype(image)::value_type),
+        pixel_count * sizeof(decltype(lum_image)::value_type),
+        cache_width * sizeof(decltype(column_power)::value_type),
+        ((cache_width + 1) + cache_width * (cache_height + 1)) * sizeof(decltype(cdf_data)::value_type),
+        cache_width * sizeof(decltype(column_alias.entries)::value_type),
+        pixel_count * sizeof(decltype(row_alias)::value_type)
+    };
+    u64 offset = align_cache_offset(sizeof(header));
+    for(u64 section_size : section_sizes) { offset = align_cache_offset(offset + section_size); }
+    if(offset != align_cache_offset(cache_size)) { return false; }
+
+    width = header.width;
+    height = header.height;
+    total_power = header.total_power;
+    image.resize(pixel_count * 3);
+    lum_image.resize(pixel_count);
+    column_power.resize(cache_width);
+    cdf_data.resize((cache_width + 1) + cache_width * (cache_height + 1));
+    column_alias.entries.resize(cache_width);
+    row_alias.resize(pixel_count);
+
+    // every array is filled by a single read directly into its final storage
+    auto sections = get_cache_sections(*this);
+    offset = align_cache_offset(sizeof(header));
+    for(const auto & section : sections)
+    {
+        cache_file.seekg(offset);
+        if(!cache_file.read(section.data(), section.size())) { return false; }
+        offset = align_cache_offset(offset + section.size());
+    }
+    return true;
+}
+
+void EnvironmentMap::save_cache(const std::string & cache_path, const std::string & source_path) const
+{
+    EnvMapCacheHeader header = {
+        .magic = ENV_MAP_CACHE_MAGIC,
+        .version = ENV_MAP_CACHE_VERSION,
+        .width = width,
+        .height = height,
+        .total_power = total_power,
+        .source_size = 0
+    };
+    std::error_code error;
+    header.source_size = std::filesystem::file_size(source_path, error);
+    if(error) { return; }
+
+    // written under a temporary name and renamed so a reader never sees a partially written cache
+    const std::string temporary_path = cache_path + ".tmp";
+    {
+        std::ofstream cache_file(temporary_path, std::ios::binary | std::ios::trunc);
+        if(!cache_file)
+        {
+            std::cout << "[EnvironmentMap::save_cache()] Could not write cache " << cache_path << std::endl;
+            return;
+        }
+        const std::array<char, ENV_MAP_CACHE_ALIGNMENT> padding{};
+        cache_file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        u64 offset = sizeof(header);
+        for(const auto & section : get_cache_sections(*this))
+        {
+            cache_file.write(padding.data(), align_cache_offset(offset) - offset);
+            offset = align_cache_offset(offset);
+            cache_file.write(section.data(), section.size());
+            offset += section.size();
+        }
+        if(!cache_file) { std::filesystem::remove(temporary_path, error); return; }
+    }
+    std::filesystem::rename(temporary_path, cache_path, error);
+    if(error) { std::filesystem::remove(temporary_path, error); }
+}
+#pragma endregion env_map_cache
+
+auto EnvironmentMap::get_memory_size() const -> size_t
+{
+    size_t size = 0;
+    for(const auto & section : get_cache_sections(*this)) { size += section.size(); }
+    return size;
+}
+
+void EnvironmentMap::load(const std::string & path)
+{
+    const std::string cache_path = path + ".emcache";
+    if(load_cache(cache_path, path)) { return; }
+
+    load_hdr_image(path, image, width, height);
+    init();
+    save_cache(cache_path, path);
+}
+
+auto get_env_map_path(u32 index) -> std::string
+{
+    const std::array<std::string, ENV_MAP_COUNT> img_num { "001", "004", "007", "010", "011", "013", "015", "016", "020", "023", "024" };
+    return "assets/textures/EM/raw" + img_num.at(index) + ".hdr";
+}
+
+Scene::Scene(const Camera & camera) : env_map{std::make_shared<EnvironmentMap>()}, use_env_map{true}, camera{camera}, total_power{0.0}
 {
 }
 
 void Scene::calculate_total_power()
 {
     total_power = 0.0;
-    for(const auto & object : scene_objects)
+    emitters.clear();
+    std::vector<f64> emitter_powers;
+    for(u32 i = 0; i < scene_objects.size(); i++)
     {
-        total_power += std::visit(GetPower{}, object);
+        f64 power = std::visit(GetPower{}, scene_objects.at(i));
+        if(power <= 0.0) { continue; }
+        emitters.push_back({.object_index = i, .power = power});
+        emitter_powers.push_back(power);
+        total_power += power;
     }
+    emitter_table.init(emitter_powers);
     std::cout << "total scene power : " << total_power << std::endl;
 }
 
-void Scene::load_scene_from_file()
+auto Scene::create_default_scene() -> Scene
 {
-    throw std::runtime_error("[Scene::load_scene_from_file()] not yet implemented");
+    Scene scene = Scene(Camera::CameraInfo{
+        .origin = {0.0, 6.0, 18.0},
+        .look_at = {0.0, 0.0, 0.0},
+        .up = {0.0, 1.0, 0.0},
+        .fov = 35.0 * M_PI / 180.0
+    });
+
+    Material::MaterialCreateInfo mat_table_info = {
+        .Le = {0.0, 0.0, 0.0},
+        .diffuse_albedo = {0.8, 0.8, 0.8},
+        .specular_albedo = {0.2, 0.2, 0.2},
+        .shininess = 500.0
+    };
+
+    Material::MaterialCreateInfo mat_light_base_info = {
+        .Le = {1.0, 1.0, 1.0},
+        .diffuse_albedo = {0.0, 0.0, 0.0},
+        .specular_albedo = {0.0, 0.0, 0.0},
+        .shininess = 0.0
+    };
+
+    scene.scene_materials.reserve(8);
+    mat_light_base_info.Le = {531.715, 265.857, 132.929};
+    scene.scene_materials.emplace_back(mat_light_base_info);
+    mat_light_base_info.Le = {50.8868, 101.774, 25.4434};
+    scene.scene_materials.emplace_back(mat_light_base_info);
+    mat_light_base_info.Le = {8.14188, 4.07094, 16.2838};
+    scene.scene_materials.emplace_back(mat_light_base_info);
+    mat_light_base_info.Le = {2.6054, 0.65135, 1.3027};
+    scene.scene_materials.emplace_back(mat_light_base_info);
+
+    scene.scene_materials.emplace_back(mat_table_info);
+    mat_table_info.shininess = 1000.0;
+    mat_table_info.diffuse_albedo = {0.7, 0.7, 0.7},
+    mat_table_info.specular_albedo = {0.3, 0.3, 0.3},
+    scene.scene_materials.emplace_back(mat_table_info);
+    mat_table_info.shininess = 5000.0;
+    mat_table_info.diffuse_albedo = {0.5, 0.5, 0.5},
+    mat_table_info.specular_albedo = {0.5, 0.5, 0.5},
+    scene.scene_materials.emplace_back(mat_table_info);
+    mat_table_info.shininess = 10000.0;
+    mat_table_info.diffuse_albedo = {0.2, 0.2, 0.2},
+    mat_table_info.specular_albedo = {0.8, 0.8, 0.8},
+    scene.scene_materials.emplace_back(mat_table_info);
+    f64vec3 light_center_pos = {0, 4, -6};
+
+    scene.scene_objects.emplace_back(Rectangle({ 
+        .material = &scene.scene_materials.at(4),
+        .origin = {0.0, -4.0,  2.0 },
+        .normal = {0.0, 0.9935, 0.1131},
+        .dimensions = {8.0, 1.0}}));
+
+    scene.scene_objects.emplace_back(Rectangle({ 
+        .material = &scene.scene_materials.at(5),
+        .origin = {0.0, -3.5, -2.0},
+        .normal = {0.0, 0.9496, 0.3133},
+        .dimensions = {8.0, 1.0}}));
+
+    scene.scene_objects.emplace_back(Rectangle({
+        .material = &scene.scene_materials.at(6),
+        .origin = {0.0, -2.5, -6.0},
+        .normal = {0.0, 0.8166, 0.5751},
+        .dimensions = {8.0, 1.0}}));
+
+    scene.scene_objects.emplace_back(Rectangle({
+        .material = &scene.scene_materials.at(7),
+        .origin = {0.0, -1.0, -10.0},
+        .normal = {0.0, 0.5400, 0.8416},
+        .dimensions = {8.0, 1.0}}));
+
+    scene.scene_objects.emplace_back(Sphere({
+        .material = &scene.scene_materials.at(0), 
+        .origin = light_center_pos + f64vec3{-4.5, 0.0, 0.0},
+        .radius = 0.07}));
+
+    scene.scene_objects.emplace_back(Sphere({
+        .material = &scene.scene_materials.at(1),
+        .origin = light_center_pos + f64vec3{-1.5, 0.0, 0.0},
+        .radius = 0.16}));
+
+    scene.scene_objects.emplace_back(Sphere({
+        .material = &scene.scene_materials.at(2),
+        .origin = light_center_pos + f64vec3{ 1.5, 0.0, 0.0},
+        .radius = 0.4}));
+
+    scene.scene_objects.emplace_back(Sphere({
+        .material = &scene.scene_materials.at(3), 
+        .origin = light_center_pos + f64vec3{ 4.5, 0.0, 0.0},
+        .radius = 1.0}));
+
+    scene.finalize();
+    return scene;
+}
+
+void Scene::finalize()
+{
+    calculate_total_power();
+    bvh.build(scene_objects);
+    std::cout << "BVH built with " << bvh.nodes.size() << " nodes over " << scene_objects.size() << " objects" << std::endl;
 }
-void Scene::save_scene_to_file()
+
+#pragma region scene_file
+// Text format - one entry per line, # starts a comment, materials are numbered in the order they appear
+//   camera <origin x y z> <look_at x y z> <up x y z> <fov in degrees>
+//   env_map <path to .hdr>
+//   material <Le r g b> <diffuse albedo r g b> <specular albedo r g b> <shininess>
+//   sphere <material index> <origin x y z> <radius>
+//   rectangle <material index> <origin x y z> <normal x y z> <width> <height>
+//   mesh <material index> <path to .obj or .ply>
+//
+// Binary format - header followed by the material records, the object records and the string data
+// (the env map path and the mesh paths), the whole file is read with a single call and the objects
+// are constructed straight from the records
+const std::array<char, 8> SCENE_FILE_MAGIC = {'R', 'S', 'O', 'S', 'C', 'E', 'N', 'E'};
+// needs to be increased whenever the layout of the records changes
+const u32 SCENE_FILE_VERSION = 2;
+
+enum SceneFileObjectType : u32
+{
+    SCENE_FILE_SPHERE,
+    SCENE_FILE_RECTANGLE,
+    SCENE_FILE_MESH
+};
+
+struct SceneFileHeader
+{
+    std::array<char, 8> magic;
+    u32 version;
+    u32 material_count;
+    u32 object_count;
+    // the env map path is at the start of the string data
+    u32 env_map_path_size;
+    f64vec3 camera_origin;
+    f64vec3 camera_look_at;
+    f64vec3 camera_up;
+    f64 camera_fov;
+};
+
+struct SceneFileMaterial
 {
-    throw std::runtime_error("[Scene::save_scene_to_file()] not yet implemented");
-}
\ No newline at end of file
+    f64vec3 Le;
+    f64vec3 diffuse_albedo;
+    f64vec3 specular_albedo;
+    f64 shininess;
+};
+
+// spheres use only origin and radius, rectangles origin, normal and dimensions and meshes
+// the path to their file stored in the string data
+struct SceneFileObject
+{
+    SceneFileObjectType type = SCENE_FILE_SPHERE;
+    u32 material = 0;
+    u32 path_offset = 0;
+    u32 path_size = 0;
+    f64vec3 origin = {0.0, 0.0, 0.0};
+    f64vec3 normal = {0.0, 0.0, 0.0};
+    f64vec2 dimensions = {0.0, 0.0};
+    f64 radius = 0.0;
+};
+
+// meshes loaded for the scene by their path, objects using the same file share its buffers
+using SceneMeshes = std::unordered_map<std::string, std::shared_ptr<const MeshData>>;
+
+static auto is_binary_scene_file(const std::string & path) -> bool
+{
+    return std::filesystem::path(path).extension() == ".rsoscene";
+}
+
+static auto scene_file_error(const std::string & path, const std::string & message) -> std::runtime_error
+{
+    return std::runtime_error("[Scene::load_scene_from_file()] " + path + ": " + message);
+}
+
+static void add_scene_material(Scene & scene, const SceneFileMaterial & material)
+{
+    scene.scene_materials.emplace_back(Material::MaterialCreateInfo{
+        .Le = material.Le,
+        .diffuse_albedo = material.diffuse_albedo,
+        .specular_albedo = material.specular_albedo,
+        .shininess = material.shininess
+    });
+}
+
+/// @brief all materials need to be added before the first object so the material pointers stay valid
+/// @param error creates the exception thrown for an invalid record from its message
+template <typename Error>
+static void add_scene_object(Scene & scene, const SceneFileObject & object, std::string_view string_data, SceneMeshes & meshes, const Error & error)
+{
+    if(object.material >= scene.scene_materials.size()) { throw error("Invalid material index " + std::to_string(object.material)); }
+    const Material * material = &scene.scene_materials[object.material];
+    switch(object.type)
+    {
+        case SCENE_FILE_SPHERE:
+        {
+            scene.scene_objects.emplace_back(Sphere({.material = material, .origin = object.origin, .radius = object.radius}));
+            break;
+        }
+        case SCENE_FILE_RECTANGLE:
+        {
+            scene.scene_objects.emplace_back(Rectangle({
+                .material = material,
+                .origin = object.origin,
+                .normal = object.normal,
+                .dimensions = object.dimensions}));
+            break;
+        }
+        case SCENE_FILE_MESH:
+        {
+            if(u64(object.path_offset) + object.path_size > string_data.size()) { throw error("Invalid mesh path"); }
+            std::string mesh_path = std::string(string_data.substr(object.path_offset, object.path_size));
+            auto & mesh = meshes[mesh_path];
+            if(mesh == nullptr) { mesh = load_mesh(mesh_path); }
+            scene.scene_objects.emplace_back(Mesh({.material = material, .data = mesh}));
+            break;
+        }
+        default: { throw error("Unknown object type"); }
+    }
+}
+
+static auto load_binary_scene(const std::string & path) -> Scene
+{
+    std::ifstream scene_file(path, std::ios::binary | std::ios::ate);
+    if(!scene_file) { throw scene_file_error(path, "Failed to open file"); }
+    std::vector<char> file_data(static_cast<size_t>(scene_file.tellg()));
+    scene_file.seekg(0);
+    if(!scene_file.read(file_data.data(), file_data.size())) { throw scene_file_error(path, "Failed to read file"); }
+
+    SceneFileHeader header;
+    if(file_data.size() < sizeof(header)) { throw scene_file_error(path, "Unexpected end of file"); }
+    std::memcpy(&header, file_data.data(), sizeof(header));
+    if(header.magic != SCENE_FILE_MAGIC) { throw scene_file_error(path, "Not a scene file"); }
+    if(header.version != SCENE_FILE_VERSION) { throw scene_file_error(path, "Unsupported version " + std::to_string(header.version)); }
+    const u64 materials_offset = sizeof(header);
+    const u64 objects_offset = materials_offset + u64(header.material_count) * sizeof(SceneFileMaterial);
+    const u64 string_data_offset = objects_offset + u64(header.object_count) * sizeof(SceneFileObject);
+    if(file_data.size() < string_data_offset + header.env_map_path_size) { throw scene_file_error(path, "File size does not match the header"); }
+    const std::string_view string_data = std::string_view(file_data.data() + string_data_offset, file_data.size() - string_data_offset);
+
+    Scene scene = Scene(Camera::CameraInfo{
+        .origin = header.camera_origin,
+        .look_at = header.camera_look_at,
+        .up = header.camera_up,
+        .fov = header.camera_fov
+    });
+    scene.env_map_path = std::string(string_data.substr(0, header.env_map_path_size));
+
+    scene.scene_materials.reserve(header.material_count);
+    for(u32 i = 0; i < header.material_count; i++)
+    {
+        SceneFileMaterial material;
+        std::memcpy(&material, file_data.data() + materials_offset + i * sizeof(SceneFileMaterial), sizeof(material));
+        add_scene_material(scene, material);
+    }
+
+    SceneMeshes meshes;
+    scene.scene_objects.reserve(header.object_count);
+    for(u32 i = 0; i < header.object_count; i++)
+    {
+        SceneFileObject object;
+        std::memcpy(&object, file_data.data() + objects_offset + i * sizeof(SceneFileObject), sizeof(object));
+        add_scene_object(scene, object, string_data, meshes, [&](const std::string & message)
+        {
+            return scene_file_error(path, "object " + std::to_string(i) + ": " + message);
+        });
+    }
+    return scene;
+}
+
+static auto load_text_scene(const std::string & path) -> Scene
+{
+    std::ifstream scene_file(path);
+    if(!scene_file) { throw scene_file_error(path, "Failed to open file"); }
+
+    struct ObjectEntry
+    {
+        SceneFileObject object;
+        u32 line;
+    };
+    // objects are created once all materials are known so the material pointers stay valid
+    std::vector<SceneFileMaterial> materials;
+    std::vector<ObjectEntry> objects;
+    std::optional<Camera::CameraInfo> camera_info;
+    std::string env_map_path;
+    // mesh paths referenced by the object records
+    std::string string_data;
+
+    std::string line;
+    for(u32 line_number = 1; std::getline(scene_file, line); line_number++)
+    {
+        line = line.substr(0, line.find('#'));
+        std::istringstream tokens(line);
+        std::string keyword;
+        if(!(tokens >> keyword)) { continue; }
+
+        auto error = [&](const std::string & message) { return scene_file_error(path, "line " + std::to_string(line_number) + ": " + message); };
+        auto read_vec3 = [&]()
+        {
+            f64vec3 value;
+            tokens >> value.x >> value.y >> value.z;
+            return value;
+        };
+
+        if(keyword == "camera")
+        {
+            f64vec3 origin = read_vec3();
+            f64vec3 look_at = read_vec3();
+            f64vec3 up = read_vec3();
+            f64 fov_degrees;
+            tokens >> fov_degrees;
+            camera_info.emplace(Camera::CameraInfo{.origin = origin, .look_at = look_at, .up = up, .fov = fov_degrees * M_PI / 180.0});
+        }
+        else if(keyword == "env_map") { tokens >> env_map_path; }
+        else if(keyword == "material")
+        {
+            SceneFileMaterial material;
+            material.Le = read_vec3();
+            material.diffuse_albedo = read_vec3();
+            material.specular_albedo = read_vec3();
+            tokens >> material.shininess;
+            materials.push_back(material);
+        }
+        else if(keyword == "sphere")
+        {
+            SceneFileObject object = {.type = SCENE_FILE_SPHERE};
+            tokens >> object.material;
+            object.origin = read_vec3();
+            tokens >> object.radius;
+            objects.push_back({object, line_number});
+        }
+        else if(keyword == "rectangle")
+        {
+            SceneFileObject object = {.type = SCENE_FILE_RECTANGLE};
+            tokens >> object.material;
+            object.origin = read_vec3();
+            object.normal = read_vec3();
+            tokens >> object.dimensions.x >> object.dimensions.y;
+            objects.push_back({object, line_number});
+        }
+        else if(keyword == "mesh")
+        {
+            SceneFileObject object = {.type = SCENE_FILE_MESH};
+            std::string mesh_path;
+            tokens >> object.material >> mesh_path;
+            object.path_offset = u32(string_data.size());
+            object.path_size = u32(mesh_path.size());
+            string_data += mesh_path;
+            objects.push_back({object, line_number});
+        }
+        else { throw error("Unknown entry " + keyword); }
+
+        if(tokens.fail()) { throw error("Missing or invalid values for " + keyword); }
+    }
+    if(!camera_info.has_value()) { throw scene_file_error(path, "Missing camera"); }
+
+    Scene scene = Scene(camera_info.value());
+    scene.env_map_path = env_map_path;
+    scene.scene_materials.reserve(materials.size());
+    for(const auto & material : materials) { add_scene_material(scene, material); }
+
+    SceneMeshes meshes;
+    scene.scene_objects.reserve(objects.size());
+    for(const auto & [object, line_number] : objects)
+    {
+        add_scene_object(scene, object, string_data, meshes, [&](const std::string & message)
+        {
+            return scene_file_error(path, "line " + std::to_string(line_number) + ": " + message);
+        });
+    }
+    return scene;
+}
+
+auto Scene::load_scene_from_file(const std::string & path, bool load_env_map) -> Scene
+{
+    Scene scene = is_binary_scene_file(path) ? load_binary_scene(path) : load_text_scene(path);
+    scene.use_env_map = load_env_map && !scene.env_map_path.empty();
+    if(scene.use_env_map) { scene.env_map->load(scene.env_map_path); }
+    scene.finalize();
+    return scene;
+}
+
+void Scene::save_scene_to_file(const std::string & path) const
+{
+    // starts with the env map path, the mesh paths are appended by to_record
+    std::string string_data = env_map_path;
+    auto get_material_index = [&](const Material * material) { return u32(material - scene_materials.data()); };
+    auto to_record = [&](const auto & object) -> SceneFileObject
+    {
+        using ObjectType = std::decay_t<decltype(object)>;
+        SceneFileObject record = {.material = get_material_index(object.material)};
+        if constexpr(std::is_same_v<ObjectType, Sphere>)
+        {
+            record.type = SCENE_FILE_SPHERE;
+            record.origin = object.origin;
+            record.radius = object.radius;
+        }
+        else if constexpr(std::is_same_v<ObjectType, Mesh>)
+        {
+            record.type = SCENE_FILE_MESH;
+            record.path_offset = u32(string_data.size());
+            record.path_size = u32(object.data->source_path.size());
+            string_data += object.data->source_path;
+        }
+        else
+        {
+            record.type = SCENE_FILE_RECTANGLE;
+            record.origin = object.origin;
+            record.normal = object.normal;
+            record.dimensions = object.dimensions;
+        }
+        return record;
+    };
+
+    if(is_binary_scene_file(path))
+    {
+        std::ofstream scene_file(path, std::ios::binary | std::ios::trunc);
+        if(!scene_file) { throw std::runtime_error("[Scene::save_scene_to_file()] Failed to open file " + path); }
+        SceneFileHeader header = {
+            .magic = SCENE_FILE_MAGIC,
+            .version = SCENE_FILE_VERSION,
+            .material_count = u32(scene_materials.size()),
+            .object_count = u32(scene_objects.size()),
+            .env_map_path_size = u32(env_map_path.size()),
+            .camera_origin = camera.origin,
+            .camera_look_at = camera.look_at,
+            .camera_up = camera.world_up,
+            .camera_fov = camera.fov
+        };
+        std::vector<SceneFileMaterial> materials;
+        materials.reserve(scene_materials.size());
+        for(const auto & material : scene_materials)
+        {
+            materials.push_back({material.Le, material.diffuse_albedo, material.specular_albedo, material.shininess});
+        }
+        std::vector<SceneFileObject> objects;
+        objects.reserve(scene_objects.size());
+        for(const auto & object : scene_objects) { objects.push_back(std::visit(to_record, object)); }
+
+        scene_file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        scene_file.write(reinterpret_cast<const char *>(materials.data()), materials.size() * sizeof(SceneFileMaterial));
+        scene_file.write(reinterpret_cast<const char *>(objects.data()), objects.size() * sizeof(SceneFileObject));
+        scene_file.write(string_data.data(), string_data.size());
+        if(!scene_file) { throw std::runtime_error("[Scene::save_scene_to_file()] Failed to write file " + path); }
+        return;
+    }
+
+    std::ofstream scene_file(path, std::ios::trunc);
+    if(!scene_file) { throw std::runtime_error("[Scene::save_scene_to_file()] Failed to open file " + path); }
+    // enough digits for the values to survive the round trip exactly
+    scene_file.precision(17);
+    auto write_vec3 = [&](const f64vec3 & value) { scene_file << " " << value.x << " " << value.y << " " << value.z; };
+
+    scene_file << "camera";
+    write_vec3(camera.origin);
+    write_vec3(camera.look_at);
+    write_vec3(camera.world_up);
+    scene_file << " " << camera.fov * 180.0 / M_PI << "\n";
+    if(!env_map_path.empty()) { scene_file << "env_map " << env_map_path << "\n"; }
+    for(const auto & material : scene_materials)
+    {
+        scene_file << "material";
+        write_vec3(material.Le);
+        write_vec3(material.diffuse_albedo);
+        write_vec3(material.specular_albedo);
+        scene_file << " " << material.shininess << "\n";
+    }
+    for(const auto & object : scene_objects)
+    {
+        SceneFileObject record = std::visit(to_record, object);
+        if(record.type == SCENE_FILE_SPHERE)
+        {
+            scene_file << "sphere " << record.material;
+            write_vec3(record.origin);
+            scene_file << " " << record.radius << "\n";
+        }
+        else if(record.type == SCENE_FILE_MESH)
+        {
+            scene_file << "mesh " << record.material << " " << string_data.substr(record.path_offset, record.path_size) << "\n";
+        }
+        else
+        {
+            scene_file << "rectangle " << record.material;
+            write_vec3(record.origin);
+            write_vec3(record.normal);
+            scene_file << " " << record.dimensions.x << " " << record.dimensions.y << "\n";
+        }
+    }
+    if(!scene_file) { throw std::runtime_error("[Scene::save_scene_to_file()] Failed to write file " + path); }
+}
+#pragma endregion scene_file
@@ -4,8 +4,11 @@
 #include <stdexcept>
 #include <memory>
 #include <span>
+#include <string>
 
 #include "operations.hpp"
+#include "bvh.hpp"
+#include "alias_table.hpp"
 #include "objects.hpp"
 #include "material.hpp"
 #include "camera.hpp"
@@ -17,17 +20,25 @@ struct SampleRet
     f64 probability;
 };
 
+enum class EnvMapSampling
+{
+    // binary search through the column and row CDFs
+    CDF,
+    // constant time Walker/Vose alias tables
+    ALIAS
+};
+
 struct EnvironmentMap
 {
+    /// @brief View of one level of the CDF sampling hierarchy, the data itself is
+    /// stored in the flat arrays of the environment map
     struct ProbabilityColumn
     {
-        std::vector<i32> samples_cnt;
-        std::vector<f64> CDF;
-        std::vector<f64> probability;
+        std::span<const f64> CDF;
+        std::span<const f64> probability;
         f64 column_sum;
 
-        void init(const std::span<f64> intensities, f64 total_col_intensity);
-        [[nodiscard]] auto sample(f64 u) -> SampleRet;
+        [[nodiscard]] auto sample(f64 u) const -> SampleRet;
     };
 
     i32 height;
@@ -35,30 +46,77 @@ struct EnvironmentMap
     float total_power;
     std::vector<f32> image;
     std::vector<f64> lum_image;
-    std::vector<f64> row_prob;
-    std::vector<ProbabilityColumn> columns;
-    ProbabilityColumn top_level;
+    // summed luminance of each column - probabilities of the top level
+    std::vector<f64> column_power;
+    // CDF of the top level (width + 1 values) followed by the CDFs of all columns (height + 1 values each)
+    std::vector<f64> cdf_data;
+    // alias tables with the same probabilities as top_level and columns, the row tables of all
+    // columns are stored in one array in the same column major layout as lum_image
+    AliasTable column_alias;
+    std::vector<AliasEntry> row_alias;
+    EnvMapSampling sampling_method = EnvMapSampling::ALIAS;
 
     void init();
-    [[nodiscard]] auto sample_direction() -> f64vec3;
+    // loads the sampling tables from the cache next to the .hdr image when it is up to date,
+    // otherwise decodes the image, builds the tables and writes the cache
+    void load(const std::string & path);
+    // bytes held by the image and the sampling tables
+    [[nodiscard]] auto get_memory_size() const -> size_t;
+    [[nodiscard]] auto get_top_level() -> ProbabilityColumn;
+    [[nodiscard]] auto get_column(u32 x) -> ProbabilityColumn;
+    [[nodiscard]] auto sample_direction(Sampler & sampler) -> f64vec3;
+    [[nodiscard]] auto sample_direction_cdf(Sampler & sampler) -> f64vec3;
+    [[nodiscard]] auto sample_direction_alias(Sampler & sampler) const -> f64vec3;
     [[nodiscard]] auto sample_probability(const f64vec3 direction) -> f64;
     [[nodiscard]] auto coords_2d_from_direction(const f64vec3 direction) -> std::pair<u32vec2, f64>;
     [[nodiscard]] auto coord_1d_from_direction(const f64vec3 direction) -> u32;
+
+    private:
+        // @return false when the cache is missing, older than the source image or has a different version
+        auto load_cache(const std::string & cache_path, const std::string & source_path) -> bool;
+        void save_cache(const std::string & cache_path, const std::string & source_path) const;
 };
 
+// number of bundled environment maps in assets/textures/EM
+const u32 ENV_MAP_COUNT = 11;
+auto get_env_map_path(u32 index) -> std::string;
+
 struct Scene
 {
+    struct Emitter
+    {
+        u32 object_index;
+        f64 power;
+    };
+
     std::vector<Object> scene_objects;
     std::vector<Material> scene_materials;
+    BVH bvh;
 
-    EnvironmentMap env_map;
+    // shared with the env map cache, never null
+    std::shared_ptr<EnvironmentMap> env_map;
     bool use_env_map;
+    // .hdr image the env map was loaded from, stored in the scene files, empty when the scene has none
+    std::string env_map_path;
     Camera camera;
     f64 total_power;
+    // objects with non zero power, light sampling selects from them using the alias table
+    std::vector<Emitter> emitters;
+    AliasTable emitter_table;
 
     Scene(const Camera & camera);
-    void load_scene_from_file();
-    void save_scene_to_file();
+    // the table scene with four spherical light sources of different size
+    static auto create_default_scene() -> Scene;
+    /// @brief files with the .rsoscene extension use the binary format, everything else the text format
+    /// described in scene.cpp - materials are referenced by their index, the env map is loaded when the
+    /// scene names one and the returned scene is finalized
+    /// @param load_env_map false only keeps the env map path of the file for callers which replace the env map
+    /// or load it themselves, the scene then does not use an env map until the caller sets one
+    static auto load_scene_from_file(const std::string & path, bool load_env_map = true) -> Scene;
+    void save_scene_to_file(const std::string & path) const;
+    // also builds the emitter list and the light selection table
     void calculate_total_power();
+    // needs to be called after all objects were added and before the scene is traced
+    void finalize();
     
 };
\ No newline at end of file
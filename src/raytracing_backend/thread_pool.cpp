@@ -0,0 +1,104 @@
+#include "thread_pool.hpp"
+
+ThreadPool::ThreadPool(u32 thread_count) :
+    queued_tasks{0},
+    pending_tasks{0},
+    stop{false}
+{
+    if(thread_count == 0) { thread_count = glm::max(std::thread::hardware_concurrency(), 1u); }
+
+    queues.reserve(thread_count);
+    for(u32 i = 0; i < thread_count; i++) { queues.push_back(std::make_unique<WorkerQueue>()); }
+
+    threads.reserve(thread_count);
+    for(u32 i = 0; i < thread_count; i++) { threads.emplace_back(&ThreadPool::worker_loop, this, i); }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard lock(sleep_mutex);
+        stop = true;
+    }
+    wake_condition.notify_all();
+    for(auto & thread : threads) { thread.join(); }
+}
+
+void ThreadPool::submit(std::vector<Task> && tasks)
+{
+    for(u32 i = 0; i < tasks.size(); i++)
+    {
+        push(i % get_thread_count(), std::move(tasks.at(i)));
+    }
+}
+
+void ThreadPool::push(u32 worker_index, Task && task)
+{
+    pending_tasks.fetch_add(1);
+    queued_tasks.fetch_add(1);
+    {
+        WorkerQueue & queue = *queues.at(worker_index);
+        std::lock_guard lock(queue.mutex);
+        queue.tasks.push_back(std::move(task));
+    }
+    {
+        // take the lock so a worker that just found all queues empty can not miss the wake up
+        std::lock_guard lock(sleep_mutex);
+    }
+    wake_condition.notify_one();
+}
+
+void ThreadPool::wait_idle()
+{
+    std::unique_lock lock(sleep_mutex);
+    idle_condition.wait(lock, [&]{ return pending_tasks.load() == 0; });
+}
+
+auto ThreadPool::try_pop(u32 worker_index, Task & task) -> bool
+{
+    WorkerQueue & queue = *queues.at(worker_index);
+    std::lock_guard lock(queue.mutex);
+    if(queue.tasks.empty()) { return false; }
+    task = std::move(queue.tasks.front());
+    queue.tasks.pop_front();
+    return true;
+}
+
+auto ThreadPool::try_steal(u32 worker_index, Task & task) -> bool
+{
+    for(u32 offset = 1; offset < get_thread_count(); offset++)
+    {
+        WorkerQueue & queue = *queues.at((worker_index + offset) % get_thread_count());
+        std::lock_guard lock(queue.mutex);
+        if(queue.tasks.empty()) { continue; }
+        // tiles queue their next iteration at the back, the front holds the tile furthest behind
+        task = std::move(queue.tasks.front());
+        queue.tasks.pop_front();
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::worker_loop(u32 worker_index)
+{
+    Task task;
+    while(true)
+    {
+        if(try_pop(worker_index, task) || try_steal(worker_index, task))
+        {
+            queued_tasks.fetch_sub(1);
+            task(worker_index);
+            task = nullptr;
+            if(pending_tasks.fetch_sub(1) == 1)
+            {
+                std::lock_guard lock(sleep_mutex);
+                idle_condition.notify_all();
+            }
+            continue;
+        }
+
+        std::unique_lock lock(sleep_mutex);
+        wake_condition.wait(lock, [&]{ return stop || queued_tasks.load() > 0; });
+        if(stop) { return; }
+    }
+}
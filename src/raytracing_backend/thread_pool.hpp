@@ -0,0 +1,59 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "types.hpp"
+
+/// @brief Persistent pool of worker threads with one task queue per worker
+/// Workers take tasks from the front of their own queue and steal from the front
+/// of other queues once their own queue runs dry
+struct ThreadPool
+{
+    // the argument is the index of the worker executing the task
+    using Task = std::function<void(u32)>;
+
+    // thread_count = 0 uses one worker per hardware thread
+    ThreadPool(u32 thread_count = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool & operator=(const ThreadPool &) = delete;
+
+    // distributes the tasks round robin over the worker queues
+    void submit(std::vector<Task> && tasks);
+    // pushes a task to the queue of the given worker, used by tasks to schedule follow up work
+    void push(u32 worker_index, Task && task);
+    // blocks until all submitted tasks (including the ones they pushed) have finished
+    void wait_idle();
+    [[nodiscard]] inline auto get_thread_count() const -> u32 { return u32(threads.size()); }
+
+    private:
+        struct WorkerQueue
+        {
+            std::mutex mutex;
+            std::deque<Task> tasks;
+        };
+
+        std::vector<std::unique_ptr<WorkerQueue>> queues;
+        std::vector<std::thread> threads;
+
+        // tasks sitting in the queues
+        std::atomic<u64> queued_tasks;
+        // tasks sitting in the queues or currently being executed
+        std::atomic<u64> pending_tasks;
+        std::mutex sleep_mutex;
+        std::condition_variable wake_condition;
+        std::condition_variable idle_condition;
+        bool stop;
+
+        void worker_loop(u32 worker_index);
+        auto try_pop(u32 worker_index, Task & task) -> bool;
+        auto try_steal(u32 worker_index, Task & task) -> bool;
+};
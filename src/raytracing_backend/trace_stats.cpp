@@ -0,0 +1,66 @@
+#include "trace_stats.hpp"
+
+#include <sstream>
+
+auto TraceStats::get_counter_name(TraceCounter counter) -> std::string
+{
+    switch(counter)
+    {
+        case PRIMARY_RAYS:                { return "primary_rays"; }
+        case PRIMARY_MISSES:              { return "primary_misses"; }
+        case CACHED_PRIMARY_HITS:         { return "cached_primary_hits"; }
+        case SECONDARY_RAYS:              { return "secondary_rays"; }
+        case SHADOW_RAYS:                 { return "shadow_rays"; }
+        case BVH_NODE_TESTS:              { return "bvh_node_tests"; }
+        case OBJECT_TESTS:                { return "object_tests"; }
+        case PACKET_NODE_TESTS:           { return "packet_node_tests"; }
+        case PACKET_OBJECT_TESTS:         { return "packet_object_tests"; }
+        case TRIANGLE_TESTS:              { return "triangle_tests"; }
+        case LIGHT_SOURCE_SAMPLES:        { return "light_source_samples"; }
+        case BRDF_SAMPLES:                { return "brdf_samples"; }
+        case LIGHT_SOURCE_WASTED:         { return "light_source_wasted"; }
+        case BRDF_WASTED:                 { return "brdf_wasted"; }
+        case ENV_MAP_SAMPLES:             { return "env_map_samples"; }
+        case NON_REFLECTIVE_HITS:         { return "non_reflective_hits"; }
+        case BRDF_SAMPLE_REJECTED:        { return "brdf_sample_rejected"; }
+        case NO_EMITTERS:                 { return "no_emitters"; }
+        case RADIANCE_SURFACE_BACKFACING: { return "radiance_surface_backfacing"; }
+        case RADIANCE_MISS:               { return "radiance_miss"; }
+        case RADIANCE_NON_EMISSIVE:       { return "radiance_non_emissive"; }
+        case RADIANCE_OCCLUDED:           { return "radiance_occluded"; }
+        case RADIANCE_LIGHT_BACKFACING:   { return "radiance_light_backfacing"; }
+        case RADIANCE_ZERO_PDF:           { return "radiance_zero_pdf"; }
+        default:                          { return "unknown"; }
+    }
+}
+
+auto TraceStats::get_wasted_sample_rate() const -> f64
+{
+    u64 samples = counters[LIGHT_SOURCE_SAMPLES] + counters[BRDF_SAMPLES];
+    if(samples == 0) { return 0.0; }
+    return f64(counters[LIGHT_SOURCE_WASTED] + counters[BRDF_WASTED]) / f64(samples);
+}
+
+auto TraceStats::get_wasted_sample_rate(TraceCounter samples, TraceCounter wasted) const -> f64
+{
+    if(counters[samples] == 0) { return 0.0; }
+    return f64(counters[wasted]) / f64(counters[samples]);
+}
+
+auto TraceStats::to_json(u32 indent) const -> std::string
+{
+    const std::string padding = std::string(indent, ' ');
+    std::ostringstream json;
+    json.precision(6);
+    json << "{\n";
+    json << padding << "  \"enabled\": " << (TRACE_STATS_ENABLED ? "true" : "false") << ",\n";
+    for(u32 counter = 0; counter < TRACE_COUNTER_COUNT; counter++)
+    {
+        json << padding << "  \"" << get_counter_name(TraceCounter(counter)) << "\": " << counters[counter] << ",\n";
+    }
+    json << padding << "  \"light_source_wasted_rate\": " << get_wasted_sample_rate(LIGHT_SOURCE_SAMPLES, LIGHT_SOURCE_WASTED) << ",\n";
+    json << padding << "  \"brdf_wasted_rate\": " << get_wasted_sample_rate(BRDF_SAMPLES, BRDF_WASTED) << ",\n";
+    json << padding << "  \"wasted_sample_rate\": " << get_wasted_sample_rate() << "\n";
+    json << padding << "}";
+    return json.str();
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <array>
+#include <string>
+
+#include "types.hpp"
+
+enum TraceCounter : u32
+{
+    // rays
+    PRIMARY_RAYS,
+    PRIMARY_MISSES,
+    // primary hits shaded from the primary hit buffer instead of being traced
+    CACHED_PRIMARY_HITS,
+    SECONDARY_RAYS,
+    // secondary rays toward a sampled light which only needed an any hit occlusion test
+    SHADOW_RAYS,
+    // traversal
+    BVH_NODE_TESTS,
+    OBJECT_TESTS,
+    PACKET_NODE_TESTS,
+    PACKET_OBJECT_TESTS,
+    // triangles tested inside the acceleration structures of meshes
+    TRIANGLE_TESTS,
+    // samples by the method their bounced ray was generated with
+    LIGHT_SOURCE_SAMPLES,
+    BRDF_SAMPLES,
+    // samples which contributed no radiance by the method their bounced ray was generated with
+    LIGHT_SOURCE_WASTED,
+    BRDF_WASTED,
+    ENV_MAP_SAMPLES,
+    // primary hits on surfaces reflecting no light, only their emission is returned
+    NON_REFLECTIVE_HITS,
+    // reasons of the wasted samples - no bounced ray could be generated
+    BRDF_SAMPLE_REJECTED,
+    NO_EMITTERS,
+    // reasons of the wasted samples - the bounced ray carries no radiance
+    RADIANCE_SURFACE_BACKFACING,
+    RADIANCE_MISS,
+    RADIANCE_NON_EMISSIVE,
+    RADIANCE_OCCLUDED,
+    RADIANCE_LIGHT_BACKFACING,
+    RADIANCE_ZERO_PDF,
+    TRACE_COUNTER_COUNT
+};
+
+/// @brief Counters of the work done by a trace, every thread counts into its own thread local
+/// instance which the raytracer merges once the tiles are done so counting never touches shared memory.
+/// Building without RSO_ENABLE_TRACE_STATS compiles all counting out
+struct TraceStats
+{
+    std::array<u64, TRACE_COUNTER_COUNT> counters = {};
+
+    inline void merge(const TraceStats & other)
+    {
+        for(u32 i = 0; i < TRACE_COUNTER_COUNT; i++) { counters[i] += other.counters[i]; }
+    }
+    // samples which did not contribute any radiance relative to all samples
+    [[nodiscard]] auto get_wasted_sample_rate() const -> f64;
+    // wasted rate of the samples generated with the given bounce method, LIGHT_SOURCE or BRDF
+    [[nodiscard]] auto get_wasted_sample_rate(TraceCounter samples, TraceCounter wasted) const -> f64;
+    /// @brief counters and derived rates as a JSON object
+    /// @param indent number of spaces the members are indented by
+    [[nodiscard]] auto to_json(u32 indent = 2) const -> std::string;
+
+    static auto get_counter_name(TraceCounter counter) -> std::string;
+};
+
+#if defined(RSO_ENABLE_TRACE_STATS)
+const bool TRACE_STATS_ENABLED = true;
+// constant initialized and trivially destructible so accessing it needs no TLS wrapper call
+inline thread_local TraceStats thread_trace_stats = {};
+#define TRACE_STAT(counter) (thread_trace_stats.counters[counter]++)
+#else
+const bool TRACE_STATS_ENABLED = false;
+#define TRACE_STAT(counter) ((void)0)
+#endif
@@ -1,5 +1,6 @@
 #pragma once
 #include <cstdint>
+#include <type_traits>
 #include <variant>
 #include <glm/glm.hpp>
 
@@ -34,20 +35,63 @@ using u32vec2 = glm::uvec2;
 using u32vec3 = glm::uvec3;
 using u32vec4 = glm::uvec4;
 
-struct Ray
+template <typename T> using tvec2 = glm::vec<2, T>;
+template <typename T> using tvec3 = glm::vec<3, T>;
+
+template <typename T>
+struct RayT
 {
-    f64vec3 start = {0.0, 0.0, 0.0};
-    f64vec3 direction = {0.0, 0.0, 0.0};
+    tvec3<T> start = {0.0, 0.0, 0.0};
+    tvec3<T> direction = {0.0, 0.0, 0.0};
 
-    Ray(const f64vec3 & start, const f64vec3 & direction) :
+    RayT(const tvec3<T> & start, const tvec3<T> & direction) :
         start{start}, direction{glm::normalize(direction)} 
     {
     }
+    // converts the ray from other precision, the direction is normalized again in the new one
+    template <typename U>
+    explicit RayT(const RayT<U> & other) : RayT(tvec3<T>(other.start), tvec3<T>(other.direction)) {}
 };
+using Ray = RayT<f64>;
+
+// tolerance for self intersections and parallel rays, single precision needs a much larger one
+template <typename T>
+constexpr T EPSILON_V = std::is_same_v<T, f32> ? T(1.0e-4) : T(1.0e-9);
+const f64 EPSILON = EPSILON_V<f64>;
+
+/// @brief Axis aligned bounding box, empty box has min > max
+template <typename T>
+struct AABBT
+{
+    tvec3<T> min = {  INFINITY,  INFINITY,  INFINITY };
+    tvec3<T> max = { -INFINITY, -INFINITY, -INFINITY };
 
-const f64 EPSILON = 1.0e-9;
+    inline void grow(const tvec3<T> & point)
+    {
+        min = glm::min(min, point);
+        max = glm::max(max, point);
+    }
+    inline void grow(const AABBT & other)
+    {
+        min = glm::min(min, other.min);
+        max = glm::max(max, other.max);
+    }
+    inline auto centroid() const -> tvec3<T> { return (min + max) * T(0.5); }
+    inline auto surface_area() const -> T
+    {
+        if(min.x > max.x) { return T(0.0); }
+        tvec3<T> extent = max - min;
+        return T(2.0) * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+    }
+};
+using AABB = AABBT<f64>;
 
-// forward declare all object types
-struct Sphere;
-struct Rectangle;
-using Object = std::variant<Sphere, Rectangle>;
\ No newline at end of file
+// forward declare all object types, the backend can be instantiated in single or double precision
+template <typename T> struct SphereT;
+template <typename T> struct RectangleT;
+template <typename T> struct MeshT;
+template <typename T> using ObjectT = std::variant<SphereT<T>, RectangleT<T>, MeshT<T>>;
+using Sphere = SphereT<f64>;
+using Rectangle = RectangleT<f64>;
+using Mesh = MeshT<f64>;
+using Object = ObjectT<f64>;
\ No newline at end of file
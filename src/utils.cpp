@@ -3,273 +3,435 @@
 #include <iostream>
 #include <utility>
 #include <functional>
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <span>
+#include <string_view>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
 
-static std::mt19937 engine = std::mt19937(123);
-static std::uniform_real_distribution distribution = std::uniform_real_distribution<f64>(0.0, 1.0);
+// scanlines of these widths may use the adaptive run length encoding
+const i32 MINELEN = 8;
+const i32 MAXELEN = 0x7fff;
 
-auto save_hdr_image(const std::string & path, std::vector<float> & image, i32 width, i32 height) -> void
+#pragma region hdr_saving
+// runs shorter than this are cheaper to store as a part of a literal span
+const u32 MINRUN = 4;
+// number of scanlines encoded together by one worker
+const i32 HDR_ROWS_PER_CHUNK = 16;
+
+static auto float_to_rgbe(const f32 * rgb, u8 * rgbe) -> void
 {
-#if defined(_WIN32)
-    FILE* fp;
-    auto err = fopen_s(&fp, path.c_str(), "wb");
-#else
-    auto fp = fopen(path.c_str(), "wb");
-#endif
-    if (fp)
+    f32 v = glm::max(rgb[0], glm::max(rgb[1], rgb[2]));
+    if(v < 1e-32f)
+    {
+        rgbe[0] = rgbe[1] = rgbe[2] = rgbe[3] = 0;
+        return;
+    }
+    // v = m * 2^e with m in [0.5, 1) -> the largest component maps to m * 256, the exponent is
+    // read directly from the float bits, v >= 1e-32 is always a normal number
+    i32 e = i32((std::bit_cast<u32>(v) >> 23) & 0xff) - 126;
+    f32 scale = std::bit_cast<f32>(u32(127 + 8 - e) << 23);
+    rgbe[0] = u8(rgb[0] * scale);
+    rgbe[1] = u8(rgb[1] * scale);
+    rgbe[2] = u8(rgb[2] * scale);
+    rgbe[3] = u8(e + 128);
+}
+
+// encodes one channel of a scanline as runs (count + 128, value) and literal spans (count, values...)
+static auto rle_encode_channel(std::span<const u8> data, std::vector<u8> & out) -> void
+{
+    const u32 size = u32(data.size());
+    u32 current = 0;
+    while(current < size)
     {
-        size_t nmemb = width * height;
-        typedef unsigned char RGBE[4];
-        RGBE *data = new RGBE[nmemb];
-        for (int ii = 0; ii < nmemb; ii++)
+        // find the next run of at least MINRUN equal bytes
+        u32 run_start = current;
+        u32 run_count = 0;
+        u32 previous_run_count = 0;
+        while(run_count < MINRUN && run_start < size)
         {
-            RGBE &rgbe = data[ii];
-            int x = (ii % width);
-            int y = height - (ii / width) - 1;
-            f32vec3 vv;
-            vv = reinterpret_cast<f32vec3*>(image.data())[y * height + x];
-            float v;
-            int e;
-            v = vv.x;
-            if (vv.y > v)
-                v = vv.y;
-            if (vv.z > v)
-                v = vv.z;
-            if (v < 1e-32)
-            {
-                rgbe[0] = rgbe[1] = rgbe[2] = rgbe[3] = 0x0;
-            }
-            else
-            {
-                v = (float)(frexp(v, &e) * 256.0 / v);
-                rgbe[0] = (unsigned char)(vv.x * v);
-                rgbe[1] = (unsigned char)(vv.y * v);
-                rgbe[2] = (unsigned char)(vv.z * v);
-                rgbe[3] = (unsigned char)(e + 128);
-            }
+            run_start += run_count;
+            previous_run_count = run_count;
+            run_count = 1;
+            while(run_start + run_count < size && run_count < 127 && data[run_start] == data[run_start + run_count]) { run_count++; }
         }
-        fflush(stdout);
-        const char *programtype = "RADIANCE";
-        if (fprintf(fp, "#?%s\n", programtype) < 0)
+        // a short run directly before the long one is still worth storing as a run
+        if(previous_run_count > 1 && previous_run_count == run_start - current)
         {
-            abort();
+            out.push_back(u8(128 + previous_run_count));
+            out.push_back(data[current]);
+            current = run_start;
         }
-        float gamma = 2.2;
-        float exposure = 1.0;
-        if (fprintf(fp, "GAMMA=%g\n", gamma) < 0)
+        while(current < run_start)
         {
-            abort();
+            u32 literal_count = glm::min(128u, run_start - current);
+            out.push_back(u8(literal_count));
+            out.insert(out.end(), data.begin() + current, data.begin() + current + literal_count);
+            current += literal_count;
         }
-        if (fprintf(fp, "EXPOSURE=%g\n", exposure) < 0)
+        if(run_count >= MINRUN)
         {
-            abort();
+            out.push_back(u8(128 + run_count));
+            out.push_back(data[run_start]);
+            current += run_count;
         }
-        if (fprintf(fp, "FORMAT=32-bit_rle_rgbe\n\n") < 0)
+    }
+}
+
+// converts and encodes the scanline, rgbe is a scratch buffer of width * 4 bytes
+static auto encode_scanline(std::span<const f32> rgb, std::span<u8> rgbe, i32 width, std::vector<u8> & out) -> void
+{
+    const bool use_rle = width >= MINELEN && width <= MAXELEN;
+    // the run length encoding stores the four channels one after another
+    for(i32 x = 0; x < width; x++)
+    {
+        u8 pixel[4];
+        float_to_rgbe(rgb.data() + x * 3, pixel);
+        for(u32 channel = 0; channel < 4; channel++)
         {
-            abort();
+            if(use_rle) { rgbe[channel * width + x] = pixel[channel]; }
+            else        { rgbe[x * 4 + channel] = pixel[channel]; }
         }
-        if (fprintf(fp, "-Y %d +X %d\n", height, width) < 0)
+    }
+    if(!use_rle)
+    {
+        out.insert(out.end(), rgbe.begin(), rgbe.end());
+        return;
+    }
+    out.push_back(2);
+    out.push_back(2);
+    out.push_back(u8(width >> 8));
+    out.push_back(u8(width & 0xff));
+    for(u32 channel = 0; channel < 4; channel++)
+    {
+        rle_encode_channel(rgbe.subspan(channel * width, width), out);
+    }
+}
+
+auto save_hdr_image(const std::string & path, const HDRRowReader & read_row, i32 width, i32 height) -> void
+{
+    if(width <= 0 || height <= 0) { throw std::runtime_error("[save_hdr_image()] Invalid image dimensions"); }
+    std::ofstream hdr_file(path, std::ios::binary | std::ios::trunc);
+    if(!hdr_file) { throw std::runtime_error("[save_hdr_image()] Failed to open file " + path); }
+
+    hdr_file << "#?RADIANCE\n"
+             << "GAMMA=2.2\n"
+             << "EXPOSURE=1\n"
+             << "FORMAT=32-bit_rle_rgbe\n\n"
+             << "-Y " << height << " +X " << width << "\n";
+
+    // scanlines are encoded in chunks by worker threads and written in order by this thread as soon
+    // as they are ready, at most max_chunks_in_flight encoded chunks are kept in memory
+    const i32 chunk_count = (height + HDR_ROWS_PER_CHUNK - 1) / HDR_ROWS_PER_CHUNK;
+    const u32 worker_count = glm::clamp(std::thread::hardware_concurrency(), 1u, u32(chunk_count));
+    const i32 max_chunks_in_flight = i32(worker_count) * 2;
+
+    std::vector<std::vector<u8>> encoded_chunks(chunk_count);
+    std::vector<u8> chunk_ready(chunk_count, 0);
+    std::mutex chunk_mutex;
+    std::condition_variable chunk_condition;
+    i32 next_chunk = 0;
+    i32 written_chunks = 0;
+    std::exception_ptr error = nullptr;
+
+    auto encode_chunks = [&]()
+    {
+        std::vector<f32> rgb(width * 3);
+        std::vector<u8> rgbe(width * 4);
+        while(true)
+        {
+            i32 chunk;
+            {
+                std::unique_lock lock(chunk_mutex);
+                chunk_condition.wait(lock, [&]{ return next_chunk - written_chunks < max_chunks_in_flight || error; });
+                if(next_chunk == chunk_count || error) { return; }
+                chunk = next_chunk++;
+            }
+            std::vector<u8> encoded;
+            try
+            {
+                encoded.reserve(HDR_ROWS_PER_CHUNK * width * 4);
+                for(i32 row = chunk * HDR_ROWS_PER_CHUNK; row < glm::min((chunk + 1) * HDR_ROWS_PER_CHUNK, height); row++)
+                {
+                    // images are stored bottom row first as drawn by glDrawPixels, hdr files top row first
+                    read_row(height - row - 1, rgb);
+                    encode_scanline(rgb, rgbe, width, encoded);
+                }
+            }
+            catch(...)
+            {
+                std::lock_guard lock(chunk_mutex);
+                if(!error) { error = std::current_exception(); }
+                chunk_condition.notify_all();
+                return;
+            }
+            {
+                std::lock_guard lock(chunk_mutex);
+                encoded_chunks.at(chunk) = std::move(encoded);
+                chunk_ready.at(chunk) = 1;
+            }
+            chunk_condition.notify_all();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for(u32 i = 0; i < worker_count; i++) { workers.emplace_back(encode_chunks); }
+
+    for(i32 chunk = 0; chunk < chunk_count; chunk++)
+    {
+        std::vector<u8> encoded;
         {
-            abort();
+            std::unique_lock lock(chunk_mutex);
+            chunk_condition.wait(lock, [&]{ return chunk_ready.at(chunk) || error; });
+            if(error) { break; }
+            encoded = std::move(encoded_chunks.at(chunk));
         }
-        // Write data
-        size_t kk = fwrite(data, (size_t)4, nmemb, fp);
-        fclose(fp);
-        if (kk != nmemb)
+        hdr_file.write(reinterpret_cast<const char *>(encoded.data()), encoded.size());
         {
-            std::cout << "ERROR - was not able to save all kk= " << (int)nmemb << "entries to file, exiting" << std::endl;
-            fflush(stdout);
-            abort(); // error
+            std::lock_guard lock(chunk_mutex);
+            written_chunks++;
+            if(!hdr_file && !error) { error = std::make_exception_ptr(std::runtime_error("[save_hdr_image()] Failed to write file " + path)); }
         }
+        chunk_condition.notify_all();
     }
+    for(auto & worker : workers) { worker.join(); }
+    if(error) { std::rethrow_exception(error); }
 }
 
-f64 get_random_double()
+auto save_hdr_image(const std::string & path, std::span<const f32> image, i32 width, i32 height) -> void
 {
-    // return (double)rand() / RAND_MAX;
-    return distribution(engine);
+    if(image.size() < size_t(width) * height * 3) { throw std::runtime_error("[save_hdr_image()] Image is smaller than its dimensions"); }
+    save_hdr_image(path, [&](i32 y, std::span<f32> rgb)
+    {
+        std::copy_n(image.begin() + size_t(y) * width * 3, width * 3, rgb.begin());
+    }, width, height);
 }
+#pragma endregion hdr_saving
 
-f64vec3 get_random_double_vec()
+#pragma region sampler
+const u32 PHILOX_M0 = 0xD2511F53;
+const u32 PHILOX_M1 = 0xCD9E8D57;
+const u32 PHILOX_W0 = 0x9E3779B9;
+const u32 PHILOX_W1 = 0xBB67AE85;
+const u32 PHILOX_ROUNDS = 10;
+
+static inline auto philox4x32(u32vec4 counter, u32vec2 key) -> u32vec4
 {
-    return {get_random_double(), get_random_double(), get_random_double()};
+    for(u32 round = 0; round < PHILOX_ROUNDS; round++)
+    {
+        u64 product_0 = u64(PHILOX_M0) * counter.x;
+        u64 product_1 = u64(PHILOX_M1) * counter.z;
+        counter = u32vec4(
+            u32(product_1 >> 32) ^ counter.y ^ key.x,
+            u32(product_1),
+            u32(product_0 >> 32) ^ counter.w ^ key.y,
+            u32(product_0)
+        );
+        key += u32vec2(PHILOX_W0, PHILOX_W1);
+    }
+    return counter;
 }
 
-#pragma region hdr_loading
-const u64 MINELEN = 8;
-const u64 MAXELEN = 0x7fff;
+// use the top 53 bits of the two words to build double in range [0, 1)
+static inline auto u32_pair_to_double(u32 high, u32 low) -> f64
+{
+    return f64(((u64(high) << 32) | u64(low)) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+Sampler::Sampler(u32 seed, u32 pixel, u32 iteration) :
+    seed{seed},
+    pixel{pixel},
+    iteration{iteration},
+    sample{0},
+    dimension{0},
+    cached_double{0.0},
+    has_cached_double{false}
+{
+}
 
-struct HDR_Pixel
+void Sampler::start_sample(u32 sample)
 {
-    char R;
-    char G;
-    char B;
-    char E;
+    this->sample = sample;
+    dimension = 0;
+    has_cached_double = false;
+}
 
-    auto at(u32 i) -> char &
+auto Sampler::get_random_double() -> f64
+{
+    if(has_cached_double)
     {
-        switch (i)
-        {
-        case 0:
-            return R;
-        case 1:
-            return G;
-        case 2:
-            return B;
-        case 3:
-            return E;
-        default:
-            return E;
-        }
+        has_cached_double = false;
+        return cached_double;
     }
-};
+    u32vec4 bits = philox4x32({pixel, iteration, sample, dimension++}, {seed, 0x5EED5EED});
+    cached_double = u32_pair_to_double(bits.z, bits.w);
+    has_cached_double = true;
+    return u32_pair_to_double(bits.x, bits.y);
+}
 
+auto Sampler::get_random_double_vec() -> f64vec3
+{
+    return {get_random_double(), get_random_double(), get_random_double()};
+}
+#pragma endregion sampler
 
-auto old_decrunch(std::vector<HDR_Pixel> & line, std::ifstream & hdr_file, bool first_occupied = false) -> void
+#pragma region hdr_loading
+
+// value of a mantissa byte is (mantissa / 256) * 2^(exponent - 128), the whole scale factor
+// only depends on the exponent byte so it is precomputed for all 256 of them
+static const std::array<f32, 256> RGBE_EXPONENT_SCALE = []()
 {
-    int rshift = 0;
-    for(int i = first_occupied ? 1 : 0; i < line.size();)
+    std::array<f32, 256> scale;
+    for(i32 exponent = 0; exponent < 256; exponent++) { scale[exponent] = std::ldexp(1.0f, exponent - 136); }
+    return scale;
+}();
+
+static auto hdr_error(const char * message) -> std::runtime_error
+{
+    return std::runtime_error(std::string("[load_hdr_image()] ") + message);
+}
+
+// Scanlines are decoded into planar layout - width R bytes followed by width G, B and E bytes
+
+// uncompressed or old style run length encoded scanline, runs are marked by pixels (1, 1, 1, count)
+// and consecutive run markers form the higher bytes of the repeat count
+static auto old_decrunch(std::span<const u8> & data, std::span<u8> scanline, u32 width) -> void
+{
+    u32 shift = 0;
+    for(u32 x = 0; x < width;)
     {
-        if(hdr_file.peek() == EOF) { throw std::runtime_error("[old_decrunch()] TODO: Msakmary fix this"); }
-        hdr_file.read(reinterpret_cast<char*>(&line.at(i).R), 1);
-        hdr_file.read(reinterpret_cast<char*>(&line.at(i).G), 1);
-        hdr_file.read(reinterpret_cast<char*>(&line.at(i).B), 1);
-        hdr_file.read(reinterpret_cast<char*>(&line.at(i).E), 1);
-
-        if (line.at(i).R == 1 &&
-            line.at(i).G == 1 &&
-            line.at(i).B == 1)
+        if(data.size() < 4) { throw hdr_error("Unexpected end of file"); }
+        const u8 * rgbe = data.data();
+        data = data.subspan(4);
+
+        if(rgbe[0] == 1 && rgbe[1] == 1 && rgbe[2] == 1)
         {
-            for(int j = line.at(i).E << rshift; j > 0; j--)
+            u32 count = u32(rgbe[3]) << shift;
+            if(x == 0 || count > width - x) { throw hdr_error("Invalid run in scanline"); }
+            for(u32 channel = 0; channel < 4; channel++)
             {
-                memcpy(&line.at(i).R, &line.at(i - 1).R, 4);
-                i++;
+                u8 * plane = scanline.data() + channel * width;
+                memset(plane + x, plane[x - 1], count);
             }
-            rshift += 8;
+            x += count;
+            shift += 8;
         }
-        else 
+        else
         {
-            i++;
-            rshift = 0;
+            for(u32 channel = 0; channel < 4; channel++) { scanline[channel * width + x] = rgbe[channel]; }
+            x++;
+            shift = 0;
         }
     }
 }
 
-auto hdr_decrunch(std::vector<HDR_Pixel> & line, std::ifstream & hdr_file) -> void
+static auto hdr_decrunch(std::span<const u8> & data, std::span<u8> scanline, u32 width) -> void
 {
-    if(line.size() < MINELEN || line.size() > MAXELEN)
-    {
-        old_decrunch(line, hdr_file);
-        return;
-    }
-    char c;
-    hdr_file.read(&c, 1);
-    if(c != 2)
-    {
-        hdr_file.seekg(-1, std::ios_base::cur);
-        old_decrunch(line, hdr_file);
-        return;
-    }
-    hdr_file.read(&line.at(0).G, 1);
-    hdr_file.read(&line.at(0).B, 1);
-    hdr_file.read(&c, 1);
-    if(line.at(0).G != 2 || line.at(0).B & 128)
+    // adaptive encoding starts with (2, 2, width high byte, width low byte), anything else is an old style scanline
+    bool adaptive_rle = 
+        width >= MINELEN && width <= MAXELEN && data.size() >= 4 &&
+        data[0] == 2 && data[1] == 2 && !(data[2] & 128);
+    if(!adaptive_rle)
     {
-        line.at(0).R = 2;
-        line.at(0).E = c;
-        old_decrunch(line, hdr_file, true);
+        old_decrunch(data, scanline, width);
         return;
     }
+    if(((u32(data[2]) << 8) | data[3]) != width) { throw hdr_error("Scanline width mismatch"); }
+    data = data.subspan(4);
 
-    for (int i = 0; i < 4; i++)
+    // each channel is encoded separately as a sequence of runs (code > 128) and literal spans
+    for(u32 channel = 0; channel < 4; channel++)
     {
-        for (int j = 0; j < line.size(); )
+        u8 * plane = scanline.data() + channel * width;
+        for(u32 x = 0; x < width;)
         {
-            unsigned char code; 
-            hdr_file.read(reinterpret_cast<char*>(&code), 1);
-            std::cout << int(code) << std::endl;
+            if(data.empty()) { throw hdr_error("Unexpected end of file"); }
+            u32 code = data[0];
             if(code > 128)
             {
-                code &= 127;
-                unsigned char val; 
-                hdr_file.read(reinterpret_cast<char*>(&val), 1);
-                while (code--) { line.at(j++).at(i) = val; }
-            } else
+                u32 count = code & 127;
+                if(data.size() < 2 || count > width - x) { throw hdr_error("Invalid run in scanline"); }
+                memset(plane + x, data[1], count);
+                data = data.subspan(2);
+                x += count;
+            }
+            else
             {
-                while(code--)
-                {
-                    hdr_file.read(reinterpret_cast<char*>(&line.at(j++).at(i)), 1);
-                }
+                u32 count = code;
+                if(count == 0 || count > width - x || data.size() < count + 1) { throw hdr_error("Invalid span in scanline"); }
+                memcpy(plane + x, data.data() + 1, count);
+                data = data.subspan(count + 1);
+                x += count;
             }
         }
     }
-    if(hdr_file.peek() != EOF) { throw std::runtime_error("[decrunch()] TODO: Msakmary fix this"); }
 }
 
-auto convert_component(int expo, int val) -> float
-{
-    float v = val / 256.0f;
-	float d = (float) pow(2, expo);
-	return v * d;
-}
-auto work_on_rgbe(std::vector<HDR_Pixel> & row, std::vector<float> & image) -> void
+static auto work_on_rgbe(std::span<const u8> scanline, u32 width, f32 * row) -> void
 {
-    for(int i = 0; i < row.size(); i++)
+    const u8 * red = scanline.data();
+    const u8 * green = red + width;
+    const u8 * blue = green + width;
+    const u8 * exponent = blue + width;
+    for(u32 x = 0; x < width; x++)
     {
-        int exposure = static_cast<unsigned char>(row.at(i).E) - 128;
-        image.emplace_back(convert_component(exposure, static_cast<unsigned char>(row.at(i).R)));
-        image.emplace_back(convert_component(exposure, static_cast<unsigned char>(row.at(i).G)));
-        image.emplace_back(convert_component(exposure, static_cast<unsigned char>(row.at(i).B)));
+        f32 scale = RGBE_EXPONENT_SCALE[exponent[x]];
+        row[x * 3] = f32(red[x]) * scale;
+        row[x * 3 + 1] = f32(green[x]) * scale;
+        row[x * 3 + 2] = f32(blue[x]) * scale;
     }
 }
 
 auto load_hdr_image(const std::string & path, std::vector<float> & image, i32 & width, i32 & height) -> void
 {
-    image.clear();
-    char buff[200];
-    std::ifstream hdr_file(path, std::ios::binary);
+    // the whole file is read with a single call and decoded from memory
+    std::ifstream hdr_file(path, std::ios::binary | std::ios::ate);
     if(!hdr_file) { throw std::runtime_error("[load_hdr_image()] Failed to open file " + path); }
-
-    hdr_file.read(buff, 10);
-    if(memcmp(buff, "#?RADIANCE", 10))
+    std::vector<u8> file_data(static_cast<size_t>(hdr_file.tellg()));
+    hdr_file.seekg(0);
+    if(!hdr_file.read(reinterpret_cast<char *>(file_data.data()), file_data.size()))
     {
-        throw std::runtime_error("[load_hdr_image()] Invalid hdr header");
+        throw std::runtime_error("[load_hdr_image()] Failed to read file " + path);
     }
-    hdr_file.seekg(1, std::ios_base::cur);
+    hdr_file.close();
 
-    // read until we find two LF symbols
-    for(char c = 0, c_old = 0; !(c == 0xa && c_old == 0xa);)
-    {
-        c_old = c;
-        hdr_file.read(&c, 1);
-    } 
+    std::string_view text(reinterpret_cast<const char *>(file_data.data()), file_data.size());
+    if(!text.starts_with("#?RADIANCE")) { throw hdr_error("Invalid hdr header"); }
 
-    int j = 0;
-    for(int i = 0; ;i++)
-    {
-        hdr_file.read(&buff[i], 1);
-        if(buff[i] == 0xa) { break; }
-    }
+    // header lines are terminated by an empty line followed by the resolution line
+    size_t header_end = text.find("\n\n");
+    if(header_end == std::string_view::npos) { throw hdr_error("Invalid hdr header"); }
+    size_t resolution_start = header_end + 2;
+    size_t resolution_end = text.find('\n', resolution_start);
+    if(resolution_end == std::string_view::npos) { throw hdr_error("Invalid header info"); }
+    std::string resolution(text.substr(resolution_start, resolution_end - resolution_start));
 
-    i64 size_x;
-    i64 size_y;
+    i32 size_x;
+    i32 size_y;
 #if defined(_WIN32)
-    if(!sscanf_s(buff, "-Y %lld +X %lld", &size_y, &size_x))
+    if(sscanf_s(resolution.c_str(), "-Y %d +X %d", &size_y, &size_x) != 2 || size_x <= 0 || size_y <= 0)
 #else
-    if(!sscanf(buff, "-Y %ld +X %ld", &size_y, &size_x))
+    if(sscanf(resolution.c_str(), "-Y %d +X %d", &size_y, &size_x) != 2 || size_x <= 0 || size_y <= 0)
 #endif
     {
-        hdr_file.close();
-        throw std::runtime_error("[laod_hdr_image()] Invalid header info");
+        throw hdr_error("Invalid header info");
     }
     width = size_x;
     height = size_y;
 
-    image.reserve(size_x * size_y * 3);
-    std::vector<HDR_Pixel> row(size_x);
-    for(int y = size_y - 1; y >= 0; y--)
+    std::span<const u8> data = std::span<const u8>(file_data).subspan(resolution_end + 1);
+    image.resize(size_t(width) * height * 3);
+    std::vector<u8> scanline(size_t(width) * 4);
+    // rows are stored in file order - top row first
+    for(i32 y = 0; y < height; y++)
     {
-        hdr_decrunch(row, hdr_file);
-        work_on_rgbe(row, image);
+        hdr_decrunch(data, scanline, width);
+        work_on_rgbe(scanline, width, image.data() + size_t(y) * width * 3);
     }
-    row.clear();
-}
\ No newline at end of file
+}
+#pragma endregion hdr_loading
\ No newline at end of file
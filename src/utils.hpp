@@ -1,14 +1,44 @@
 #pragma once
 
-#include <random>
 #include <string>
+#include <vector>
 #include <stdexcept>
 #include <fstream>
+#include <functional>
+#include <span>
 
 #include "types.hpp"
-// returns random number using uniform sampling in range [0, 1)
-f64 get_random_double();
-f64vec3 get_random_double_vec();
+
+/// @brief Stateless counter based random number generator (Philox4x32-10)
+/// Every returned value is a pure function of the seed and the counter formed by
+/// (pixel, iteration, sample, dimension), so a render does not depend on which thread
+/// evaluates a pixel or in which order the pixels are evaluated
+struct Sampler
+{
+    Sampler(u32 seed, u32 pixel, u32 iteration);
+
+    // resets the dimension counter, needs to be called before each new sample of the pixel
+    void start_sample(u32 sample);
+    // returns random number using uniform sampling in range [0, 1)
+    auto get_random_double() -> f64;
+    auto get_random_double_vec() -> f64vec3;
+
+    private:
+        u32 seed;
+        u32 pixel;
+        u32 iteration;
+        u32 sample;
+        u32 dimension;
+        // each philox block yields two doubles, the second one is kept for the next call
+        f64 cached_double;
+        bool has_cached_double;
+};
 
 auto load_hdr_image(const std::string & path, std::vector<float> & image, i32 & width, i32 & height) -> void;
-auto save_hdr_image(const std::string & path, std::vector<float> & image, i32 width, i32 height) -> void;
\ No newline at end of file
+// fills rgb (width * 3 floats) with row y of the image, called concurrently from several threads
+using HDRRowReader = std::function<void(i32 y, std::span<f32> rgb)>;
+/// @brief Writes the image as run length encoded Radiance .hdr, scanlines are encoded in parallel
+/// and streamed to the file in order. Row 0 of the image is the bottom row of the saved picture
+auto save_hdr_image(const std::string & path, const HDRRowReader & read_row, i32 width, i32 height) -> void;
+// convenience overload for images stored as interleaved RGB floats
+auto save_hdr_image(const std::string & path, std::span<const f32> image, i32 width, i32 height) -> void;
\ No newline at end of file